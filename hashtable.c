@@ -1,13 +1,166 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 #include "hashtable.h"
+#include "hashtable_internal.h"
 #include "lookup3.h"
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
+
+#if defined(HAVE_UNISTD_H) || defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>      // sysconf, for counting CPUs
+#endif
+
 extern uint32_t hashtable_seed;
-static hashtable_t *_hashtable_grow(hashtable_t *table);
+static int _hashtable_grow(hashtable_t *table);
+static int _prefilter_build(hashtable_t *table);
 
 #define hash_str_key(str, len) hashlittle((str), (len), (hashtable_seed))
+#define _hashtable_is_bounded(table) ((table)->max_items != 0 || (table)->max_bytes != 0)
+
+#define HASH_ITEM_REFERENCED 0x1     // CLOCK reference bit
+#define HASH_ITEM_TIMED      0x2     // linked into a timer wheel slot
+#define HASH_ITEM_FRONT_CODED 0x4    // the key is a hash_front_coded_key_t, see hashtable_set_key_prefixes
+#define HASH_ITEM_INLINE     0x8     // the value is bytes in the key's allocation, see hashtable_set_inline
+#define HASH_ITEM_EXTENDED   0x10    // the item is the head of a hash_item_ext_t
+#define HASH_ITEM_INLINE_SHIFT 16    // bits 16-23 hold their length
+#define HASH_ITEM_INLINE_BITS (HASH_ITEM_INLINE | ((hashtable_flag)0xff << HASH_ITEM_INLINE_SHIFT))
+#define HASH_ITEM_SLOT_SHIFT 8       // bits 8-15 hold that slot, so that it can be unlinked in O(1)
+
+/* a hierarchical timer wheel, level n slots span 64^n ticks */
+#define WHEEL_BITS   6
+#define WHEEL_SLOTS  (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+
+/* blocked Bloom filter prefilter, each key sets PREFILTER_PROBES bits within one 512 bit block */
+#define PREFILTER_BLOCK_WORDS 8
+#define PREFILTER_PROBES      6
+
+/* the item of a bounded table, or of one with a timer wheel. Only these tables pay for the recency and timer links,
+ * every other item is a bare hash_item_t */
+typedef struct hashtable_item_ext
+{
+    hash_item_t item;                   // first, so that the two are interchangeable by a cast
+    hash_item_t *lru_prev;              // recency list, only maintained for bounded tables
+    hash_item_t *lru_next;
+
+    uint64_t expires_at;                // 0 if the item never expires
+    hash_item_t *timer_prev;            // timer wheel slot list, only for items which expire
+    hash_item_t *timer_next;
+}hash_item_ext_t;
+
+#define _item_ext(item) ((hash_item_ext_t *)(item))
+#define _hashtable_wants_ext(table) (_hashtable_is_bounded(table) || (table)->wheel != NULL)
+
+/* multimap value runs live in the key's allocation, just after the (8 byte aligned) key */
+typedef struct hashtable_value_run
+{
+    size_t count;
+    size_t capacity;
+    void *values[];
+}hash_value_run_t;
+
+#define VALUE_RUN_OFFSET(keylen) (((keylen) + 1 + 7) & ~(size_t)7)
+#define VALUE_RUN_INITIAL 2
+
+/* a front coded key, its prefix shared through the table's prefix pool and the rest of the key stored here */
+typedef struct hashtable_front_coded_key
+{
+    char *prefix;
+    char suffix[];      // keylen - length of prefix bytes, then a null
+}hash_front_coded_key_t;
+
+#ifdef HAVE_PTHREAD
+/* a background resize, see hashtable_set_background_resize. Old bucket i and every new bucket its items move to
+ * are guarded by locks[i % RESIZE_STRIPES], which the migrator holds while it moves that bucket */
+#define RESIZE_STRIPES 64
+
+typedef struct hashtable_resize
+{
+    hashtable_t *table;
+    bucket_t **new_buckets;
+    size_t new_size;
+
+    _Atomic size_t migrated;      // old buckets [0, migrated) now live in the new array
+    atomic_int done;              // the migrator has stopped, successfully or not
+    int joined;
+    pthread_t thread;
+
+    pthread_mutex_t locks[RESIZE_STRIPES];
+}hashtable_resize_t;
+
+static void _resize_start(hashtable_t *table);
+static void _resize_join(hashtable_resize_t *resize);
+static void _resize_free(hashtable_resize_t *resize);
+#endif
+
+/* hashtable_build_parallel gives each worker at least this many keys, below that threads cost more than they save */
+#define BUILD_MIN_PER_THREAD 4096
+#define BUILD_LOAD_FACTOR    4       // the maximum load factor of the tables it builds
+
+typedef struct hashtable_timer_wheel
+{
+    uint64_t current;                             // the last tick processed, whose slot is scanned again
+    uint64_t occupied[WHEEL_LEVELS];              // bitmap of non-empty slots at each level
+    hash_item_t *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+}hashtable_timer_wheel_t;
+
+
+/* _hashtable_threads
+ *
+ * Resolve a requested thread count, 0 meaning one per online CPU.
+ * */
+static size_t _hashtable_threads(size_t nthreads)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    if(nthreads == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = cpus > 0 ? (size_t)cpus : 1;
+    }
+#endif
+
+    if(nthreads == 0)
+        nthreads = 1;
+    if(nthreads > HASHTABLE_MAX_THREADS)
+        nthreads = HASHTABLE_MAX_THREADS;
+
+    return nthreads;
+}
+
+
+/* _hashtable_run_parallel
+ *
+ * Call 'fn' once for each of 'nthreads' workers, worker i being passed 'args' + i * 'arg_size', and wait for them
+ * all to finish. The calling thread runs worker 0 itself. Without HAVE_PTHREAD, or if a thread cannot be
+ * started, the work is simply done here in turn, so callers never need a fallback of their own.
+ * */
+static void _hashtable_run_parallel(void *(*fn)(void*), void *args, size_t arg_size, size_t nthreads)
+{
+#ifdef HAVE_PTHREAD
+    pthread_t threads[HASHTABLE_MAX_THREADS];
+    int started[HASHTABLE_MAX_THREADS];
+
+    for(size_t i = 1; i < nthreads; i++)
+        started[i] = pthread_create(&threads[i], NULL, fn, (char *)args + i * arg_size) == 0;
+
+    fn(args);
+
+    for(size_t i = 1; i < nthreads; i++)
+    {
+        if(started[i])
+            pthread_join(threads[i], NULL);
+        else fn((char *)args + i * arg_size);
+    }
+#else
+    for(size_t i = 0; i < nthreads; i++)
+        fn((char *)args + i * arg_size);
+#endif
+}
 
 
 /* _internal_strdup
@@ -73,20 +226,68 @@ static int _bucket_insert(bucket_t *bucket, hash_item_t *item)  // linked list i
     return 0;
 }
 
+/* _bucket_unlink
+ *
+ * Remove 'item' from the bucket, 'prev' being the item before it in the LL (NULL if it is the head).
+ * */
+static inline void _bucket_unlink(bucket_t *bucket, hash_item_t *prev, hash_item_t *item)
+{
+    if(prev == NULL)
+        bucket->head = item->next;
+    else prev->next = item->next;
+
+    if(bucket->tail == item)
+        bucket->tail = prev;
+
+    bucket->size -= 1;
+}
+
+
+/* _front_coded_matches
+ *
+ * Compare a key against a front coded item key, the shared prefix first and then the suffix.
+ * */
+static int _front_coded_matches(hash_item_t const *item, char const *key, size_t keylen)
+{
+    hash_front_coded_key_t const *coded = (hash_front_coded_key_t const *)item->key;
+    size_t prefix_len = _keypool_keylen(coded->prefix);
+
+    return memcmp(coded->prefix, key, prefix_len) == 0
+           && memcmp(coded->suffix, key + prefix_len, keylen - prefix_len) == 0;
+}
+
+
+/* _key_matches
+ *
+ * Compare the cached hash and length before the key itself, so that most mismatches never touch the key. A key
+ * shared through a key pool may be the item's own copy, which needs no comparison at all.
+ * */
+static inline int _key_matches(hash_item_t const *item, uint32_t hash, char const *key, size_t keylen)
+{
+    if(item->hash != hash || item->keylen != keylen)
+        return 0;
+
+    if(item->flags & HASH_ITEM_FRONT_CODED)
+        return _front_coded_matches(item, key, keylen);
+
+    return item->key == key || memcmp(item->key, key, keylen) == 0;
+}
+
 /*
  * key_in_bucket
  *
  * return 1 if a value with the key 'key' exists in the bucket - we also set the value of pair to a
  * pointer to this item, return 0 if not.
  * */
-static inline int _key_in_bucket(bucket_t *bucket, char const *key, size_t keylen, hash_item_t **pair)
+static inline int _key_in_bucket(bucket_t *bucket, uint32_t hash, char const *key, size_t keylen,
+                                 hash_item_t **pair)
 {
     if(!bucket || !key) return -1;
     hash_item_t *temp = bucket->head;
 
     while(temp != NULL)
     {
-        if(strncmp(temp->key, key, keylen) == 0){
+        if(_key_matches(temp, hash, key, keylen)){
             *pair = temp;
             return 1;
         }
@@ -97,28 +298,192 @@ static inline int _key_in_bucket(bucket_t *bucket, char const *key, size_t keyle
 }
 
 
+static inline hash_value_run_t *_value_run(hash_item_t const *item)
+{
+    return (hash_value_run_t *)(item->key + VALUE_RUN_OFFSET(item->keylen));
+}
+
+
+/* _multimap_key_create
+ *
+ * Copy a key for a multimap item, leaving room after it for a run of 'capacity' values.
+ * */
+static char *_multimap_key_create(char const *key, size_t keylen, size_t capacity, void *value)
+{
+    char *key_copy = malloc(VALUE_RUN_OFFSET(keylen) + sizeof(hash_value_run_t) + capacity * sizeof(void*));
+    if(!key_copy)
+        return NULL;
+
+    memcpy(key_copy, key, keylen);
+    key_copy[keylen] = '\0';
+
+    hash_value_run_t *run = (hash_value_run_t *)(key_copy + VALUE_RUN_OFFSET(keylen));
+    run->count = 1;
+    run->capacity = capacity;
+    run->values[0] = value;
+
+    return key_copy;
+}
+
+
+/* _key_prefix_len
+ *
+ * Length of the prefix a key would share through the table's prefix pool: everything up to and including the
+ * last separator. 0 if the key is not to be front coded, including when its prefix is too short to be worth it.
+ * */
+static size_t _key_prefix_len(hashtable_t const *table, char const *key, size_t keylen)
+{
+    size_t len = keylen;
+
+    while(len > 0 && key[len - 1] != table->prefix_separator)
+        len--;
+
+    return len > sizeof(char*) ? len : 0;
+}
+
+
+/* _front_coded_key_create
+ *
+ * Front code a key as a reference to its prefix in the table's prefix pool followed by a copy of the rest. Keys
+ * sharing a prefix tend to arrive together, so the prefix of the last key is tried before hashing this one's. The
+ * pool belongs to this table alone, which is used by one thread at a time, so it is never locked.
+ * */
+static char *_front_coded_key_create(hashtable_t *table, char const *key, size_t keylen, size_t prefix_len)
+{
+    hash_front_coded_key_t *coded = malloc(sizeof(hash_front_coded_key_t) + keylen - prefix_len + 1);
+    if(!coded)
+        return NULL;
+
+    if(table->last_prefix && _keypool_keylen(table->last_prefix) == prefix_len
+       && memcmp(table->last_prefix, key, prefix_len) == 0)
+        coded->prefix = _keypool_retain_unlocked(table->last_prefix);
+    else
+    {
+        coded->prefix = _keypool_acquire_unlocked(table->prefixes, key, prefix_len, hash_str_key(key, prefix_len));
+        if(!coded->prefix)
+        {
+            free(coded);
+            return NULL;
+        }
+
+        if(table->last_prefix)
+            _keypool_release_unlocked(table->prefixes, table->last_prefix);
+        table->last_prefix = _keypool_retain_unlocked(coded->prefix);
+    }
+
+    memcpy(coded->suffix, key + prefix_len, keylen - prefix_len);
+    coded->suffix[keylen - prefix_len] = '\0';
+
+    return (char *)coded;
+}
+
+
+static inline void _hash_item_ext_init(hash_item_ext_t *ext)
+{
+    ext->lru_prev = NULL;
+    ext->lru_next = NULL;
+    ext->expires_at = 0;
+    ext->timer_prev = NULL;
+    ext->timer_next = NULL;
+}
+
+
+/* _hash_item_alloc
+ *
+ * Allocate an item, extended if the table keeps recency or timer links for its items.
+ * */
+static inline hash_item_t *_hash_item_alloc(hashtable_t const *table)
+{
+    hash_item_ext_t *ext;
+
+    if(!_hashtable_wants_ext(table))
+    {
+        hash_item_t *item = malloc(sizeof(hash_item_t));
+        if(item)
+            item->flags = 0;
+        return item;
+    }
+
+    ext = malloc(sizeof(hash_item_ext_t));
+    if(!ext)
+        return NULL;
+
+    ext->item.flags = HASH_ITEM_EXTENDED;
+    _hash_item_ext_init(ext);
+
+    return &ext->item;
+}
+
+
+static inline void _hash_item_init(hash_item_t *item, char *key_copy, size_t keylen, uint32_t hash, void *value,
+                                   hashtable_flag flags)
+{
+    item->value  = value;
+    item->key    = key_copy;
+    item->keylen = keylen;
+    item->hash   = hash;
+    item->flags  = (item->flags & HASH_ITEM_EXTENDED) | flags;
+}
+
+
 /* hash_item_create
  *
  * Create a pair (key, value) to be entered into the table. Note that we create a copy of the 'key', but use
  * the actual 'value' supplied.
  * */
-static hash_item_t *_hash_item_create(char const *key, size_t keylen,  void *value)
+static hash_item_t *_hash_item_create(hashtable_t *table, char const *key, size_t keylen, uint32_t hash,
+                                      void *value)
 {
     char *key_copy;
-    hash_item_t *new_pair = malloc(sizeof(hash_item_t));
+    size_t prefix_len = 0;
+    hash_item_t *new_pair = _hash_item_alloc(table);
     if(!new_pair)
         return NULL;
 
-    key_copy = _internal_strdup(key, keylen);
+    if(table->flags & HASHTABLE_MULTIMAP)
+        key_copy = _multimap_key_create(key, keylen, VALUE_RUN_INITIAL, value);
+    else if(table->keypool)
+        key_copy = _keypool_acquire(table->keypool, key, keylen, hash);
+    else if(table->prefixes && (prefix_len = _key_prefix_len(table, key, keylen)) != 0)
+        key_copy = _front_coded_key_create(table, key, keylen, prefix_len);
+    else key_copy = _internal_strdup(key, keylen);
+
+    if(!key_copy)
+    {
+        free(new_pair);
+        return NULL;
+    }
+
+    _hash_item_init(new_pair, key_copy, keylen, hash, value, prefix_len ? HASH_ITEM_FRONT_CODED : 0);
+
+    return new_pair;
+}
+
+
+/* _hash_item_create_inline
+ *
+ * Create an item holding a copy of 'key' and, in the same allocation after it (8 byte aligned), a copy of the
+ * 'len' bytes at 'bytes' as its value.
+ * */
+static hash_item_t *_hash_item_create_inline(hashtable_t const *table, char const *key, size_t keylen, uint32_t hash,
+                                             const void *bytes, size_t len)
+{
+    size_t offset = VALUE_RUN_OFFSET(keylen);
+    hash_item_t *new_pair = _hash_item_alloc(table);
+    char *key_copy = new_pair ? malloc(offset + (len ? len : 1)) : NULL;
+
     if(!key_copy)
     {
         free(new_pair);
         return NULL;
     }
 
-    new_pair->value  = value;
-    new_pair->key    = key_copy;
-    new_pair->keylen = keylen;
+    memcpy(key_copy, key, keylen);
+    key_copy[keylen] = '\0';
+    memcpy(key_copy + offset, bytes, len);
+
+    _hash_item_init(new_pair, key_copy, keylen, hash, key_copy + offset,
+                    HASH_ITEM_INLINE | ((hashtable_flag)len << HASH_ITEM_INLINE_SHIFT));
 
     return new_pair;
 }
@@ -127,13 +492,20 @@ static hash_item_t *_hash_item_create(char const *key, size_t keylen,  void *val
 /*_hash_item_desttoy
 *
 * destroy a hash_item_t object. We are not responsible for the memory of item->value in
-* this case.
+* this case. A pooled key is only freed once no item of any table holds it.
 * */
-static inline int _hash_item_destroy(hash_item_t *item)
+static inline int _hash_item_destroy(hashtable_t const *table, hash_item_t *item)
 {
     if(!item) return -1;
 
-    if(item->key != NULL)
+    if(item->key != NULL && table->keypool)
+        _keypool_release(table->keypool, item->key);
+    else if(item->key != NULL && (item->flags & HASH_ITEM_FRONT_CODED))
+    {
+        _keypool_release_unlocked(table->prefixes, ((hash_front_coded_key_t *)item->key)->prefix);
+        free(item->key);
+    }
+    else if(item->key != NULL)
         free(item->key);
 
     free(item);
@@ -141,242 +513,2073 @@ static inline int _hash_item_destroy(hash_item_t *item)
 }
 
 
-hashtable_t *hashtable_create(size_t initial_size, uint32_t max_loadfactor)
+/* _hash_item_release
+ *
+ * Hand every value held by an item (its whole run, for a multimap) to 'deallocator', if that is not NULL.
+ * */
+static void _hash_item_release(hashtable_t const *table, hash_item_t *item, void (*deallocator)(void*))
 {
-    hashtable_t *table = malloc(sizeof(hashtable_t));
-    if(!table)
-        return NULL;
-
-    table->table_size = initial_size;
-    table->num_items = 0;
-    table->max_load_factor = max_loadfactor;
+    if(deallocator == NULL || (item->flags & HASH_ITEM_INLINE))    // inline bytes go with the key
+        return;
 
-    table->buckets = calloc(initial_size, sizeof(bucket_t*)); // important that we init to 0
-
-    if(table->buckets == NULL)
+    if(table->flags & HASHTABLE_MULTIMAP)
     {
-        free(table);
-        return NULL;
+        hash_value_run_t *run = _value_run(item);
+        for(size_t i = 0; i < run->count; i++)
+            deallocator(run->values[i]);
     }
-
-    return table;
+    else deallocator(item->value);
 }
 
 
-int hashtable_destroy(hashtable_t *table, void (*deallocator)(void*))
+/* _hashtable_slot_acquire / _hashtable_slot_release
+ *
+ * Find the bucket pointer for 'hash'. While a background resize is running this takes the stripe lock of the
+ * key's old bucket and picks whichever array the key currently lives in, so every bucket access between the two
+ * calls is consistent with the migrator. Otherwise this is just an index into the bucket array.
+ * */
+static bucket_t **_hashtable_slot_acquire(hashtable_t const *table, uint32_t hash)
 {
-    bucket_t *curr_bucket;
-    hash_item_t *curr_item, *tmp;
+#ifdef HAVE_PTHREAD
+    hashtable_resize_t *resize = table->resize;
+    if(resize)
+    {
+        size_t index = hash % table->table_size;
 
-    if(!table)
-        return -1;
+        pthread_mutex_lock(&resize->locks[index % RESIZE_STRIPES]);
+        if(index < atomic_load_explicit(&resize->migrated, memory_order_acquire))
+            return &resize->new_buckets[hash % resize->new_size];
+    }
+#endif
 
-    if(table->num_items)
-    {
-        /* given the table does contain some data somewhere... */
-        for(size_t i = 0; i < table->table_size; i++)
-        {
-            /* deallocate all the items in the bucket, then the bucket itself */
-            curr_bucket = table->buckets[i];
+    return &table->buckets[hash % table->table_size];
+}
 
-            if(curr_bucket != 0)      // contains some values
-            {
-                curr_item = curr_bucket->head;
-                while(curr_item != NULL)
-                {
-                    tmp = curr_item->next;
 
-                    if(deallocator != NULL)  // TODO: check valid
-                        deallocator(curr_item->value);
+static inline void _hashtable_slot_release(hashtable_t const *table, uint32_t hash)
+{
+#ifdef HAVE_PTHREAD
+    if(table->resize)
+        pthread_mutex_unlock(&table->resize->locks[(hash % table->table_size) % RESIZE_STRIPES]);
+#else
+    (void)table;
+    (void)hash;
+#endif
+}
 
-                    _hash_item_destroy(curr_item);
-                    curr_item = tmp;
-                };
 
-                free(curr_bucket); // we only free if bucket at this address was allocated (not 0)]
-            }
-        }
+/* a cursor over every item in the table, see _walk_next */
+typedef struct hashtable_walk
+{
+    size_t index;         // the old bucket being walked
+    size_t sub;           // the next of the buckets it maps to
+    size_t count;         // how many buckets it maps to, 0 before the walk starts and once it ends
+    int split;            // its items have been migrated to the new array
+    hash_item_t *item;
+}hashtable_walk_t;
 
-    }
 
-    free(table->buckets);  // free the list of buckets
-    free(table);
+static inline hashtable_walk_t _walk_begin(hashtable_t const *table)
+{
+    hashtable_walk_t walk = {0, 0, 0, 0, NULL};
+    (void)table;
 
-    return 0;
+    return walk;
 }
 
 
-static int _hashtable_insert(hashtable_t *table, char const *key, size_t keylen, void *value, uint32_t override,
-                             void (*deallocator)(void*))
+/* _walk_end
+ *
+ * Release a walk which is abandoned before _walk_next returns NULL.
+ * */
+static inline void _walk_end(hashtable_t const *table, hashtable_walk_t *walk)
 {
-    hash_item_t *new_pair;
-    uint32_t index = (uint32_t)(hashlittle(key, keylen, hashtable_seed) % table->table_size);
+#ifdef HAVE_PTHREAD
+    if(table->resize && walk->count != 0)
+        pthread_mutex_unlock(&table->resize->locks[walk->index % RESIZE_STRIPES]);
+#else
+    (void)table;
+#endif
+    walk->count = 0;
+}
 
 
-    /* if there exists a bucket with this key */
-    if(table->buckets[index] != 0)
+/* _walk_next
+ *
+ * Return the next item of the table in bucket order, or NULL once every item has been visited. During a
+ * background resize each old bucket is visited under its stripe lock, either itself or, once migrated, as the new
+ * buckets it was split into, so every item is seen exactly once.
+ * */
+static hash_item_t *_walk_next(hashtable_t const *table, hashtable_walk_t *walk)
+{
+    if(walk->item != NULL)
+        walk->item = walk->item->next;
+
+    while(walk->item == NULL)
     {
-        bucket_t *bucket = table->buckets[index];
-        if(_key_in_bucket(bucket, key, keylen, &new_pair))   // NOTE: reminder new_pair is set to value of current pair if _key_in_bucket returns 1
+        bucket_t *bucket;
+
+        if(walk->sub == walk->count)      // done with this old bucket, or not started yet
         {
-            if(!override) return -1;  /* if the key has been aready added and override is off, don't replace it.
-                                       * if override is on, replace the value pointed to by the item with that key. */
-            else
+            if(walk->count != 0)
             {
-                if(deallocator != NULL)
-                    deallocator(new_pair->value);
+                _walk_end(table, walk);
+                walk->index++;
+            }
 
-                new_pair->value = value;
+            if(walk->index >= table->table_size)
+                return NULL;
 
-                return 1;  // value overwritten
+            walk->sub = 0;
+            walk->split = 0;
+#ifdef HAVE_PTHREAD
+            if(table->resize)
+            {
+                pthread_mutex_lock(&table->resize->locks[walk->index % RESIZE_STRIPES]);
+                walk->split = walk->index < atomic_load_explicit(&table->resize->migrated, memory_order_acquire);
             }
+#endif
+            walk->count = walk->split ? HASHTABLE_GROWTH_FACTOR : 1;
         }
+
+#ifdef HAVE_PTHREAD
+        if(walk->split)      // old bucket i was split into new buckets i, i + table_size, ...
+            bucket = table->resize->new_buckets[walk->index + walk->sub * table->table_size];
         else
-        {
-                new_pair = _hash_item_create(key, keylen,  value);
-                if(!new_pair)
-                    return -1;
+#endif
+        bucket = table->buckets[walk->index];
 
-                return _bucket_insert(bucket, new_pair);
-        }
+        walk->sub++;
+        walk->item = bucket ? bucket->head : NULL;
     }
-    else
-    {    /* There is not bucket mapped to this index, so we create one for this pair */
 
-        bucket_t *new_bucket = malloc(sizeof(bucket_t));
-        if(!new_bucket)
-            return -1;
+    return walk->item;
+}
 
-        _bucket_init(new_bucket);
 
-        new_pair = _hash_item_create(key, keylen, value);
-        if(!new_pair)
-        {
-            free(new_bucket);
-            return -1;
-        }
+/* _lru_unlink / _lru_push_front
+ *
+ * Maintain the table's recency list. For LRU the head is the most recently used item and the tail is the next to
+ * be evicted, for CLOCK the list is in insertion order and the hand sweeps it from the tail towards the head.
+ * Only used for bounded tables.
+ * */
+static inline void _lru_unlink(hashtable_t *table, hash_item_t *item)
+{
+    hash_item_ext_t *ext = _item_ext(item);
 
-        _bucket_insert(new_bucket, new_pair);
-        table->buckets[index] = new_bucket;
-    }
+    if(table->clock_hand == item)
+        table->clock_hand = ext->lru_prev;
 
-    return 0;
+    if(ext->lru_prev) _item_ext(ext->lru_prev)->lru_next = ext->lru_next;
+    else table->lru_head = ext->lru_next;
+
+    if(ext->lru_next) _item_ext(ext->lru_next)->lru_prev = ext->lru_prev;
+    else table->lru_tail = ext->lru_prev;
+
+    ext->lru_prev = ext->lru_next = NULL;
 }
 
 
-int hashtable_set(hashtable_t **table, const char *key, size_t keylen, void *value, uint32_t replace,
-                  void (*deallocator)(void*))
+static inline void _lru_push_front(hashtable_t *table, hash_item_t *item)
 {
-    if(!table || !(*table))
-        return -1;
+    _item_ext(item)->lru_prev = NULL;
+    _item_ext(item)->lru_next = table->lru_head;
 
-    if(!(*table)->buckets)
-        return -1;
+    if(table->lru_head) _item_ext(table->lru_head)->lru_prev = item;
+    else table->lru_tail = item;
 
-    if(_hashtable_insert(*table, key, keylen, value, replace, deallocator) == 0)
-    {
-        (*table)->num_items++;
+    table->lru_head = item;
+}
 
-        if((*table)->num_items / (*table)->table_size >= (*table)->max_load_factor)
-        {
-            hashtable_t *temp = _hashtable_grow(*table);
-            if(!temp)
-                return -1;
 
-            *table = temp;
-            return 0;
+/* _clock_insert
+ *
+ * New items go just behind the hand, so that they are the last to be considered by the current sweep.
+ * */
+static inline void _clock_insert(hashtable_t *table, hash_item_t *item)
+{
+    hash_item_ext_t *hand = _item_ext(table->clock_hand), *ext = _item_ext(item);
+
+    if(hand == NULL || hand->lru_next == NULL)
+    {
+        if(hand == NULL)
+            _lru_push_front(table, item);
+        else
+        {
+            /* the hand is at the tail, so behind it means the new tail */
+            ext->lru_next = NULL;
+            ext->lru_prev = &hand->item;
+            hand->lru_next = item;
+            table->lru_tail = item;
         }
+        return;
     }
 
-    return -1;   // previous call to _hashtable_insert must have failed
+    ext->lru_prev = &hand->item;
+    ext->lru_next = hand->lru_next;
+    _item_ext(hand->lru_next)->lru_prev = item;
+    hand->lru_next = item;
 }
 
 
-static hashtable_t *_hashtable_grow(hashtable_t *table)
+static inline void _lru_touch(hashtable_t *table, hash_item_t *item)
 {
-    bucket_t *curr_bucket;
-    hash_item_t *curr_item, *temp_item;
-
-    hashtable_t *new_table = hashtable_create(table->table_size * HASHTABLE_GROWTH_FACTOR, table->max_load_factor);
-    if(!new_table)
-        return NULL;
-
-    for(size_t i = 0; i < table->table_size; i++)
+    if(table->policy == HASHTABLE_EVICT_CLOCK)
     {
-        curr_bucket = table->buckets[i];
-        if(curr_bucket != 0)              // if this bucket had some data in
-        {
-            curr_item = curr_bucket->head;
-            while(curr_item != NULL)     // iterate through bucket
-            {
-                /* Insert the item into the new table */
-                temp_item = curr_item->next;
-                _hashtable_insert(new_table, curr_item->key, curr_item->keylen, curr_item->value, 0, NULL);
-
-                _hash_item_destroy(curr_item);   // does not destroy the 'value' field
+        if(!(item->flags & HASH_ITEM_REFERENCED))    // only write to the item the first time
+            item->flags |= HASH_ITEM_REFERENCED;
+        return;
+    }
 
-                curr_item = temp_item;
-            };
+    if(table->lru_head == item)
+        return;        // already the hottest, avoid writing to it
 
-            free(curr_bucket);          // destroy old bucket
-        }
-    }
+    _lru_unlink(table, item);
+    _lru_push_front(table, item);
+}
 
-    free(table->buckets);  // free the list of pointers
-    free(table);
 
-    return new_table;
+static inline void _lru_insert(hashtable_t *table, hash_item_t *item)
+{
+    if(table->policy == HASHTABLE_EVICT_CLOCK)
+        _clock_insert(table, item);
+    else _lru_push_front(table, item);
 }
 
 
-/* _hashtable_find
+/* _clock_victim
  *
- * Check if an item with the key supplied exists in our hash table. If so, retrun this item,
- * if not then return NULL.
+ * Sweep the hand towards the head (wrapping around to the tail), clearing reference bits as it goes, and return
+ * the first unreferenced item other than 'keep'. Every bit is cleared within one lap, so this ends within two.
+ * */
+static hash_item_t *_clock_victim(hashtable_t *table, hash_item_t const *keep)
+{
+    hash_item_t *hand = table->clock_hand ? table->clock_hand : table->lru_tail;
+
+    for(size_t steps = 0; hand != NULL && steps <= 2 * table->num_items; steps++)
+    {
+        hash_item_t *next = _item_ext(hand)->lru_prev ? _item_ext(hand)->lru_prev : table->lru_tail;
+
+        if(hand != keep)
+        {
+            if(!(hand->flags & HASH_ITEM_REFERENCED))
+            {
+                table->clock_hand = next == hand ? NULL : next;
+                return hand;
+            }
+            hand->flags &= ~HASH_ITEM_REFERENCED;    // second chance
+        }
+
+        hand = next;
+    }
+
+    return NULL;
+}
+
+
+/* _hash_item_cost
+ *
+ * The number of bytes an item is charged against the byte budget of a bounded table.
+ * */
+static inline size_t _hash_item_cost(hashtable_t const *table, hash_item_t const *item)
+{
+    size_t cost = (item->flags & HASH_ITEM_EXTENDED ? sizeof(hash_item_ext_t) : sizeof(hash_item_t))
+                  + item->keylen + 1;
+
+    if(table->flags & HASHTABLE_MULTIMAP)
+    {
+        hash_value_run_t *run = _value_run(item);
+
+        cost += VALUE_RUN_OFFSET(item->keylen) - item->keylen - 1;
+        cost += sizeof(hash_value_run_t) + run->capacity * sizeof(void*);
+
+        for(size_t i = 0; table->value_size != NULL && i < run->count; i++)
+        {
+            if(run->values[i] != NULL)
+                cost += table->value_size(run->values[i]);
+        }
+    }
+    else if(item->flags & HASH_ITEM_INLINE)
+        cost += VALUE_RUN_OFFSET(item->keylen) - item->keylen - 1 + ((item->flags >> HASH_ITEM_INLINE_SHIFT) & 0xff);
+    else if(table->value_size != NULL && item->value != NULL)
+        cost += table->value_size(item->value);
+
+    return cost;
+}
+
+
+static uint64_t _hashtable_default_clock(void)
+{
+    return (uint64_t)time(NULL);
+}
+
+
+/* _wheel_insert
+ *
+ * Place an item in the slot covering its expiry time. Items due before the current tick go in the current slot,
+ * and items beyond the range of the wheel are parked in the top level until a cascade brings them closer.
+ * */
+static void _wheel_insert(hashtable_timer_wheel_t *wheel, hash_item_t *item)
+{
+    hash_item_ext_t *ext = _item_ext(item);
+    uint64_t when = ext->expires_at < wheel->current ? wheel->current : ext->expires_at;
+    uint64_t delta = when - wheel->current;
+    uint32_t level = 0, slot;
+
+    while(level < WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << (WHEEL_BITS * (level + 1))))
+        level++;
+
+    if(level == WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)))
+        when = wheel->current + ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+
+    slot = (uint32_t)(when >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+
+    ext->timer_prev = NULL;
+    ext->timer_next = wheel->slots[level][slot];
+    if(ext->timer_next)
+        _item_ext(ext->timer_next)->timer_prev = item;
+    wheel->slots[level][slot] = item;
+    wheel->occupied[level] |= (uint64_t)1 << slot;
+
+    item->flags &= ~((hashtable_flag)0xff << HASH_ITEM_SLOT_SHIFT);
+    item->flags |= HASH_ITEM_TIMED | ((level * WHEEL_SLOTS + slot) << HASH_ITEM_SLOT_SHIFT);
+}
+
+
+static void _wheel_unlink(hashtable_timer_wheel_t *wheel, hash_item_t *item)
+{
+    uint32_t index = (item->flags >> HASH_ITEM_SLOT_SHIFT) & 0xff;
+    uint32_t level = index / WHEEL_SLOTS, slot = index % WHEEL_SLOTS;
+    hash_item_ext_t *ext = _item_ext(item);
+
+    if(ext->timer_prev) _item_ext(ext->timer_prev)->timer_next = ext->timer_next;
+    else wheel->slots[level][slot] = ext->timer_next;
+
+    if(ext->timer_next) _item_ext(ext->timer_next)->timer_prev = ext->timer_prev;
+
+    if(wheel->slots[level][slot] == NULL)
+        wheel->occupied[level] &= ~((uint64_t)1 << slot);
+
+    ext->timer_prev = ext->timer_next = NULL;
+    item->flags &= ~HASH_ITEM_TIMED;
+}
+
+
+/* _wheel_cascade
+ *
+ * Called whenever the low levels wrap around: redistribute the items of the slot now reached at each level above
+ * into the finer levels below. The slot is detached first, since an item may land straight back in it.
+ * */
+static void _wheel_cascade(hashtable_timer_wheel_t *wheel)
+{
+    for(uint32_t level = 1; level < WHEEL_LEVELS; level++)
+    {
+        uint32_t shift = WHEEL_BITS * level;
+        if(wheel->current & (((uint64_t)1 << shift) - 1))
+            break;     // the level below has not wrapped
+
+        uint32_t slot = (uint32_t)(wheel->current >> shift) & (WHEEL_SLOTS - 1);
+        hash_item_t *item = wheel->slots[level][slot], *next;
+
+        wheel->slots[level][slot] = NULL;
+        wheel->occupied[level] &= ~((uint64_t)1 << slot);
+
+        for(; item != NULL; item = next)
+        {
+            next = _item_ext(item)->timer_next;
+            _wheel_insert(wheel, item);
+        }
+    }
+}
+
+
+/* _wheel_next_tick
+ *
+ * The first tick after the current one at which a non-empty slot is reached: a level 0 slot falling due, or a
+ * higher level slot being cascaded. Each level's occupancy bitmap is rotated to start just after its current slot,
+ * so this costs a few bit scans however far ahead that tick is. Returns 0 if no slot is occupied.
+ * */
+static uint64_t _wheel_next_tick(hashtable_timer_wheel_t const *wheel)
+{
+    uint64_t next = 0;
+
+    for(uint32_t level = 0; level < WHEEL_LEVELS; level++)
+    {
+        uint32_t shift = WHEEL_BITS * level;
+        uint64_t occupied = wheel->occupied[level], turn = wheel->current >> shift;
+        uint32_t start = (uint32_t)(turn + 1) & (WHEEL_SLOTS - 1);
+
+        if(occupied == 0)
+            continue;
+
+        /* bit i of the rotated map is the slot reached i + 1 turns of this level from now */
+        if(start != 0)
+            occupied = (occupied >> start) | (occupied << (WHEEL_SLOTS - start));
+        turn += _lowest_set_bit(occupied) + 1;
+
+        if(turn > (UINT64_MAX >> shift))
+            continue;       // beyond the range of the clock
+        if(next == 0 || (turn << shift) < next)
+            next = turn << shift;
+    }
+
+    return next;
+}
+
+
+/* _prefilter_mix
+ *
+ * Spread the 32 bit item hash into 64 bits (murmur3 finaliser) for picking the bits within a block.
+ * */
+static inline uint64_t _prefilter_mix(uint32_t hash)
+{
+    uint64_t x = hash * 0x9e3779b97f4a7c15ULL;
+
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+
+    return x;
+}
+
+
+static inline uint64_t *_prefilter_block(uint64_t *filter, size_t blocks, uint32_t hash)
+{
+    return filter + (size_t)(((uint64_t)hash * blocks) >> 32) * PREFILTER_BLOCK_WORDS;
+}
+
+
+static inline void _prefilter_add(uint64_t *filter, size_t blocks, uint32_t hash)
+{
+    uint64_t *block = _prefilter_block(filter, blocks, hash);
+    uint64_t bits = _prefilter_mix(hash);
+
+    for(int i = 0; i < PREFILTER_PROBES; i++, bits >>= 9)
+        block[(bits >> 6) & 7] |= (uint64_t)1 << (bits & 63);
+}
+
+
+/* _prefilter_maybe_contains
+ *
+ * Return 0 if no item with this hash can be in the table, and 1 if one might be.
+ * */
+static inline int _prefilter_maybe_contains(hashtable_t const *table, uint32_t hash)
+{
+    const uint64_t *block = _prefilter_block(table->prefilter, table->prefilter_blocks, hash);
+    uint64_t bits = _prefilter_mix(hash);
+
+    for(int i = 0; i < PREFILTER_PROBES; i++, bits >>= 9)
+    {
+        if(!(block[(bits >> 6) & 7] & ((uint64_t)1 << (bits & 63))))
+            return 0;
+    }
+
+    return 1;
+}
+
+
+/* _prefilter_build
+ *
+ * (Re)build the filter for the table's current capacity. If this fails the old filter is kept, which is still
+ * correct (it never misses an item), just less selective.
+ * */
+static int _prefilter_build(hashtable_t *table)
+{
+    size_t capacity = table->table_size * table->max_load_factor;
+    size_t bits, blocks;
+    uint64_t *filter;
+
+    if(capacity < table->num_items)
+        capacity = table->num_items;
+
+    bits = capacity * table->prefilter_bits_per_key;
+    blocks = (bits + PREFILTER_BLOCK_WORDS * 64 - 1) / (PREFILTER_BLOCK_WORDS * 64);
+    if(blocks == 0)
+        blocks = 1;
+
+#if defined(_WIN32)
+    filter = malloc(blocks * PREFILTER_BLOCK_WORDS * sizeof(uint64_t));
+#else
+    filter = aligned_alloc(64, blocks * PREFILTER_BLOCK_WORDS * sizeof(uint64_t));
+#endif
+    if(!filter)
+        return -1;
+
+    memset(filter, 0, blocks * PREFILTER_BLOCK_WORDS * sizeof(uint64_t));
+    for(hashtable_walk_t walk = _walk_begin(table); _walk_next(table, &walk) != NULL; )
+        _prefilter_add(filter, blocks, walk.item->hash);
+
+    free(table->prefilter);
+    table->prefilter = filter;
+    table->prefilter_blocks = blocks;
+    table->prefilter_stale = 0;
+
+    return 0;
+}
+
+
+/* _hashtable_forget
+ *
+ * Undo the bookkeeping for an item which has just been unlinked from its bucket.
+ * */
+static void _hashtable_forget(hashtable_t *table, hash_item_t *item)
+{
+    if(_hashtable_is_bounded(table))
+    {
+        _lru_unlink(table, item);
+        table->num_bytes -= _hash_item_cost(table, item);
+    }
+
+    if(item->flags & HASH_ITEM_TIMED)
+        _wheel_unlink(table->wheel, item);
+
+    table->num_items--;
+
+    /* once as many items have gone as the rebuild will visit, it pays for itself */
+    if(table->prefilter && ++table->prefilter_stale > (table->num_items + table->table_size) / 2)
+        _prefilter_build(table);
+}
+
+
+/* _hashtable_unlink_item
+ *
+ * Take an item we already hold a pointer to out of its bucket and the recency list, and account for it.
+ * The item itself is not destroyed.
+ * */
+static void _hashtable_unlink_item(hashtable_t *table, hash_item_t *item)
+{
+    bucket_t *bucket = *_hashtable_slot_acquire(table, item->hash);
+    hash_item_t *prev = NULL, *curr = bucket->head;
+
+    while(curr != item)      // chains are short, find the predecessor in the LL
+    {
+        prev = curr;
+        curr = curr->next;
+    }
+
+    _bucket_unlink(bucket, prev, item);
+    _hashtable_slot_release(table, item->hash);
+
+    _hashtable_forget(table, item);
+}
+
+
+/* _hashtable_extend_item
+ *
+ * Return an extended copy of an item which was created before the table had a timer wheel, replacing it in its
+ * bucket. Such an item is in no recency list or wheel slot, so the bucket is all that links to it. Returns the
+ * item unchanged if it is already extended, and NULL (leaving it in place) if the copy cannot be allocated.
+ * */
+static hash_item_t *_hashtable_extend_item(hashtable_t *table, hash_item_t *item)
+{
+    hash_item_ext_t *ext;
+    bucket_t *bucket;
+    hash_item_t *prev = NULL, *curr;
+
+    if(item->flags & HASH_ITEM_EXTENDED)
+        return item;
+
+    ext = malloc(sizeof(hash_item_ext_t));
+    if(!ext)
+        return NULL;
+
+    ext->item = *item;
+    ext->item.flags |= HASH_ITEM_EXTENDED;
+    _hash_item_ext_init(ext);
+
+    bucket = *_hashtable_slot_acquire(table, item->hash);
+    for(curr = bucket->head; curr != item; curr = curr->next)
+        prev = curr;
+
+    if(prev == NULL)
+        bucket->head = &ext->item;
+    else prev->next = &ext->item;
+
+    if(bucket->tail == item)
+        bucket->tail = &ext->item;
+    _hashtable_slot_release(table, item->hash);
+
+    free(item);
+    return &ext->item;
+}
+
+
+/* _hashtable_drop_item
+ *
+ * Unlink and destroy an item, handing its value to the table's deallocator. Used for eviction and expiry.
+ * */
+static void _hashtable_drop_item(hashtable_t *table, hash_item_t *item)
+{
+    _hashtable_unlink_item(table, item);
+    _hash_item_release(table, item, table->deallocator);
+    _hash_item_destroy(table, item);
+}
+
+
+static inline int _hash_item_expired(hashtable_t const *table, hash_item_t const *item)
+{
+    /* only an item in the wheel has an expiry time, and only extended items are ever put there */
+    return (item->flags & HASH_ITEM_TIMED) && ((hash_item_ext_t const *)item)->expires_at <= table->clock();
+}
+
+
+/* _hashtable_evict
+ *
+ * Evict the coldest items until a bounded table is back within its limits. 'keep' is never evicted, so that
+ * an item larger than the whole budget still survives the call which inserted it.
+ * */
+static void _hashtable_evict(hashtable_t *table, hash_item_t const *keep)
+{
+    while((table->max_items && table->num_items > table->max_items)
+          || (table->max_bytes && table->num_bytes > table->max_bytes))
+    {
+        hash_item_t *victim;
+
+        if(table->policy == HASHTABLE_EVICT_CLOCK)
+            victim = _clock_victim(table, keep);
+        else victim = table->lru_tail;
+
+        if(victim == NULL || victim == keep)
+            break;
+
+        _hashtable_drop_item(table, victim);
+    }
+}
+
+
+hashtable_t *hashtable_create(size_t initial_size, uint32_t max_loadfactor)
+{
+    return hashtable_create_backend(initial_size, max_loadfactor, HASHTABLE_BACKEND_CHAINED);
+}
+
+
+hashtable_t *hashtable_create_backend(size_t initial_size, uint32_t max_loadfactor, hashtable_flag backend)
+{
+    int ret;
+    hashtable_t *table = malloc(sizeof(hashtable_t));
+    if(!table)
+        return NULL;
+
+    if(initial_size == 0)
+        initial_size = 1;
+
+    table->table_size = initial_size;
+    table->num_items = 0;
+    table->max_load_factor = max_loadfactor;
+    table->deallocator = NULL;
+    table->flags = 0;
+
+    table->max_items = 0;
+    table->max_bytes = 0;
+    table->num_bytes = 0;
+    table->value_size = NULL;
+    table->policy = HASHTABLE_EVICT_LRU;
+    table->lru_head = NULL;
+    table->lru_tail = NULL;
+    table->clock_hand = NULL;
+
+    table->wheel = NULL;
+
+    table->prefilter = NULL;
+    table->prefilter_blocks = 0;
+    table->prefilter_bits_per_key = 0;
+    table->prefilter_stale = 0;
+    table->clock = _hashtable_default_clock;
+
+    table->nthreads = 1;
+    table->resize = NULL;
+
+    table->backend = backend;
+    table->buckets = NULL;
+    table->slots = NULL;
+    table->keypool = NULL;
+    table->prefixes = NULL;
+    table->last_prefix = NULL;
+    table->prefix_separator = 0;
+
+    switch(backend)
+    {
+    case HASHTABLE_BACKEND_CHAINED:
+        if(table->max_load_factor == 0)
+            table->max_load_factor = 1;
+
+        table->buckets = calloc(initial_size, sizeof(bucket_t*)); // important that we init to 0
+        ret = table->buckets ? 0 : -1;
+        break;
+    case HASHTABLE_BACKEND_ROBINHOOD:
+        ret = _robinhood_init(table, initial_size);
+        break;
+    case HASHTABLE_BACKEND_CUCKOO:
+        ret = _cuckoo_init(table, initial_size);
+        break;
+    case HASHTABLE_BACKEND_HOPSCOTCH:
+        ret = _hopscotch_init(table, initial_size);
+        break;
+    case HASHTABLE_BACKEND_CACHELINE:
+        ret = _cacheline_init(table, initial_size);
+        break;
+    default:
+        ret = -1;
+    }
+
+    if(ret != 0)
+    {
+        free(table);
+        return NULL;
+    }
+
+    return table;
+}
+
+
+hashtable_t *hashtable_create_multimap(size_t initial_size, uint32_t max_load_factor)
+{
+    hashtable_t *table = hashtable_create(initial_size, max_load_factor);
+    if(!table)
+        return NULL;
+
+    table->flags |= HASHTABLE_MULTIMAP;
+
+    return table;
+}
+
+
+hashtable_t *hashtable_create_bounded(size_t initial_size, uint32_t max_load_factor, size_t max_items,
+                                      size_t max_bytes, hashtable_flag policy, size_t (*value_size)(const void*),
+                                      void (*deallocator)(void*))
+{
+    if(policy != HASHTABLE_EVICT_LRU && policy != HASHTABLE_EVICT_CLOCK)
+        return NULL;
+
+    hashtable_t *table = hashtable_create(initial_size, max_load_factor);
+    if(!table)
+        return NULL;
+
+    table->policy = policy;
+    table->max_items = max_items;
+    table->max_bytes = max_bytes;
+    table->value_size = value_size;
+    table->deallocator = deallocator;
+
+    return table;
+}
+
+
+/* state shared by the workers of hashtable_build_parallel */
+typedef struct hashtable_build
+{
+    hashtable_t *table;
+    size_t nthreads;
+
+    const char *const *keys;
+    const size_t *lens;
+    void *const *values;
+    size_t n;
+
+    uint32_t *hashes;
+    size_t *order;             // input indices grouped by partition, in input order within each
+    size_t *counts;            // [worker * nthreads + partition], sizes and then scatter cursors
+    size_t *part_start;        // [nthreads + 1], where each partition begins in 'order'
+}hashtable_build_t;
+
+
+typedef struct hashtable_build_worker
+{
+    hashtable_build_t *build;
+    size_t id;
+    size_t num_items;
+    int failed;
+}hashtable_build_worker_t;
+
+
+/* partition p owns buckets [p * table_size / nthreads, (p + 1) * table_size / nthreads) */
+static inline size_t _build_partition(hashtable_build_t const *build, uint32_t hash)
+{
+    return (hash % build->table->table_size) * build->nthreads / build->table->table_size;
+}
+
+
+/* _build_hash
+ *
+ * Worker phase 1, hash this worker's slice of the input and count how much of it falls into each partition.
+ * */
+static void *_build_hash(void *arg)
+{
+    hashtable_build_worker_t *worker = arg;
+    hashtable_build_t *build = worker->build;
+    size_t first = worker->id * build->n / build->nthreads, last = (worker->id + 1) * build->n / build->nthreads;
+    size_t *counts = build->counts + worker->id * build->nthreads;
+
+    for(size_t i = first; i < last; i++)
+    {
+        if(build->keys[i] == NULL)
+        {
+            worker->failed = 1;
+            return NULL;
+        }
+
+        build->hashes[i] = hash_str_key(build->keys[i], build->lens[i]);
+        counts[_build_partition(build, build->hashes[i])]++;
+    }
+
+    return NULL;
+}
+
+
+/* _build_scatter
+ *
+ * Worker phase 2, copy the indices of this worker's slice to the cursors the prefix sum gave it in each partition.
+ * */
+static void *_build_scatter(void *arg)
+{
+    hashtable_build_worker_t *worker = arg;
+    hashtable_build_t *build = worker->build;
+    size_t first = worker->id * build->n / build->nthreads, last = (worker->id + 1) * build->n / build->nthreads;
+    size_t *cursors = build->counts + worker->id * build->nthreads;
+
+    for(size_t i = first; i < last; i++)
+        build->order[cursors[_build_partition(build, build->hashes[i])]++] = i;
+
+    return NULL;
+}
+
+
+/* _build_fill
+ *
+ * Worker phase 3, insert every key of this worker's partition. No other worker touches these buckets, so no
+ * locking is needed.
+ * */
+static void *_build_fill(void *arg)
+{
+    hashtable_build_worker_t *worker = arg;
+    hashtable_build_t *build = worker->build;
+    hashtable_t *table = build->table;
+    hash_item_t *item;
+
+    for(size_t k = build->part_start[worker->id]; k < build->part_start[worker->id + 1]; k++)
+    {
+        size_t i = build->order[k];
+        uint32_t hash = build->hashes[i];
+        bucket_t **bucket = &table->buckets[hash % table->table_size];
+
+        if(*bucket == NULL)
+        {
+            *bucket = malloc(sizeof(bucket_t));
+            if(*bucket == NULL)
+            {
+                worker->failed = 1;
+                return NULL;
+            }
+            _bucket_init(*bucket);
+        }
+        else if(_key_in_bucket(*bucket, hash, build->keys[i], build->lens[i], &item) == 1)
+            continue;     // the first occurrence of a key wins
+
+        item = _hash_item_create(table, build->keys[i], build->lens[i], hash,
+                                 build->values ? build->values[i] : NULL);
+        if(!item)
+        {
+            worker->failed = 1;
+            return NULL;
+        }
+
+        _bucket_insert(*bucket, item);
+        worker->num_items++;
+    }
+
+    return NULL;
+}
+
+
+static int _build_failed(hashtable_build_worker_t const *workers, size_t nthreads)
+{
+    for(size_t i = 0; i < nthreads; i++)
+        if(workers[i].failed)
+            return 1;
+
+    return 0;
+}
+
+
+hashtable_t *hashtable_build_parallel(const char *const *keys, const size_t *lens, void *const *values, size_t n,
+                                      size_t nthreads)
+{
+    hashtable_build_t build;
+    hashtable_build_worker_t workers[HASHTABLE_MAX_THREADS];
+    size_t offset = 0;
+
+    if(!keys || !lens)
+        return NULL;
+
+    nthreads = _hashtable_threads(nthreads);
+    if(nthreads > n / BUILD_MIN_PER_THREAD)
+        nthreads = n / BUILD_MIN_PER_THREAD ? n / BUILD_MIN_PER_THREAD : 1;
+
+    /* an average chain of 2, leaving room to double before BUILD_LOAD_FACTOR forces a growth */
+    build.table = hashtable_create(n / 2 + 1, BUILD_LOAD_FACTOR);
+    if(!build.table)
+        return NULL;
+
+    build.nthreads = nthreads;
+    build.keys = keys;
+    build.lens = lens;
+    build.values = values;
+    build.n = n;
+    build.hashes = malloc((n ? n : 1) * sizeof(uint32_t));
+    build.order = malloc((n ? n : 1) * sizeof(size_t));
+    build.counts = calloc(nthreads * nthreads, sizeof(size_t));
+    build.part_start = malloc((nthreads + 1) * sizeof(size_t));
+    if(!build.hashes || !build.order || !build.counts || !build.part_start)
+        goto fail;
+
+    for(size_t i = 0; i < nthreads; i++)
+    {
+        workers[i].build = &build;
+        workers[i].id = i;
+        workers[i].num_items = 0;
+        workers[i].failed = 0;
+    }
+
+    _hashtable_run_parallel(_build_hash, workers, sizeof(hashtable_build_worker_t), nthreads);
+    if(_build_failed(workers, nthreads))
+        goto fail;
+
+    /* prefix sum, partition major, so that each partition holds its keys in input order */
+    for(size_t p = 0; p < nthreads; p++)
+    {
+        build.part_start[p] = offset;
+        for(size_t w = 0; w < nthreads; w++)
+        {
+            size_t count = build.counts[w * nthreads + p];
+            build.counts[w * nthreads + p] = offset;
+            offset += count;
+        }
+    }
+    build.part_start[nthreads] = offset;
+
+    _hashtable_run_parallel(_build_scatter, workers, sizeof(hashtable_build_worker_t), nthreads);
+    _hashtable_run_parallel(_build_fill, workers, sizeof(hashtable_build_worker_t), nthreads);
+
+    for(size_t i = 0; i < nthreads; i++)
+        build.table->num_items += workers[i].num_items;
+
+    if(_build_failed(workers, nthreads))
+        goto fail;
+
+    free(build.hashes);
+    free(build.order);
+    free(build.counts);
+    free(build.part_start);
+
+    return build.table;
+
+fail:
+    free(build.hashes);
+    free(build.order);
+    free(build.counts);
+    free(build.part_start);
+    hashtable_destroy(build.table, NULL);    // the values are still our caller's
+
+    return NULL;
+}
+
+
+/* _buckets_destroy
+ *
+ * Destroy every bucket of 'buckets' and the items in them, but not the array itself.
+ * */
+static void _buckets_destroy(hashtable_t const *table, bucket_t **buckets, size_t size, void (*deallocator)(void*))
+{
+    bucket_t *curr_bucket;
+    hash_item_t *curr_item, *tmp;
+
+    /* buckets may outlive their items after removals, so we always walk the whole table */
+    for(size_t i = 0; i < size; i++)
+    {
+        /* deallocate all the items in the bucket, then the bucket itself */
+        curr_bucket = buckets[i];
+
+        if(curr_bucket != 0)      // contains some values
+        {
+            curr_item = curr_bucket->head;
+            while(curr_item != NULL)
+            {
+                tmp = curr_item->next;
+
+                _hash_item_release(table, curr_item, deallocator);
+
+                _hash_item_destroy(table, curr_item);
+                curr_item = tmp;
+            };
+
+            free(curr_bucket); // we only free if bucket at this address was allocated (not 0)]
+        }
+    }
+}
+
+
+int hashtable_destroy(hashtable_t *table, void (*deallocator)(void*))
+{
+    if(!table)
+        return -1;
+
+    if(deallocator == NULL)
+        deallocator = table->deallocator;
+
+    switch(table->backend)
+    {
+    case HASHTABLE_BACKEND_ROBINHOOD:
+        _robinhood_destroy(table, deallocator);
+        break;
+    case HASHTABLE_BACKEND_CUCKOO:
+        _cuckoo_destroy(table, deallocator);
+        break;
+    case HASHTABLE_BACKEND_HOPSCOTCH:
+        _hopscotch_destroy(table, deallocator);
+        break;
+    case HASHTABLE_BACKEND_CACHELINE:
+        _cacheline_destroy(table, deallocator);
+        break;
+    }
+
+#ifdef HAVE_PTHREAD
+    if(table->resize)
+    {
+        /* migrated buckets are NULL in the old array, so destroying both arrays visits every item once */
+        _resize_join(table->resize);
+        _buckets_destroy(table, table->resize->new_buckets, table->resize->new_size, deallocator);
+        free(table->resize->new_buckets);
+        _resize_free(table->resize);
+    }
+#endif
+
+    if(table->buckets)
+        _buckets_destroy(table, table->buckets, table->table_size, deallocator);
+
+    if(table->last_prefix)
+        _keypool_release_unlocked(table->prefixes, table->last_prefix);
+    if(table->prefixes)
+        hashtable_keypool_destroy(table->prefixes);    // empty now that every item is gone
+
+    free(table->wheel);
+    free(table->prefilter);
+    free(table->buckets);  // free the list of buckets
+    free(table);
+
+    return 0;
+}
+
+
+/* _hashtable_find_for_insert
+ *
+ * Return the live item for 'key', whose hash is 'hash', or NULL if there is none. An expired item is dropped on
+ * the way, so that the caller may insert in its place.
+ * */
+static hash_item_t *_hashtable_find_for_insert(hashtable_t *table, char const *key, size_t keylen, uint32_t hash)
+{
+    hash_item_t *pair = NULL;
+    bucket_t **slot;
+    int found = 0;
+
+    /* if there exists a bucket with this key */
+    slot = _hashtable_slot_acquire(table, hash);
+    if(*slot != 0)
+        found = _key_in_bucket(*slot, hash, key, keylen, &pair);   // NOTE: reminder pair is set to value of current pair if _key_in_bucket returns 1
+    _hashtable_slot_release(table, hash);
+
+    if(found && _hash_item_expired(table, pair))
+    {
+        _hashtable_drop_item(table, pair);    // an expired key is as good as absent
+        found = 0;
+    }
+
+    return found ? pair : NULL;
+}
+
+
+/* _hashtable_link_item
+ *
+ * Add a new item to its bucket and account for it. Returns -1 if the bucket could not be allocated, in which case
+ * the item is still the caller's.
+ * */
+static int _hashtable_link_item(hashtable_t *table, hash_item_t *new_pair)
+{
+    bucket_t **slot = _hashtable_slot_acquire(table, new_pair->hash);
+
+    if(*slot == 0)
+    {    /* There is not bucket mapped to this index, so we create one for this pair */
+        bucket_t *new_bucket = malloc(sizeof(bucket_t));
+        if(!new_bucket)
+        {
+            _hashtable_slot_release(table, new_pair->hash);
+            return -1;
+        }
+
+        _bucket_init(new_bucket);
+        *slot = new_bucket;
+    }
+
+    _bucket_insert(*slot, new_pair);
+    _hashtable_slot_release(table, new_pair->hash);
+
+    table->num_items++;
+
+    if(table->prefilter)
+        _prefilter_add(table->prefilter, table->prefilter_blocks, new_pair->hash);
+
+    if(_hashtable_is_bounded(table))
+    {
+        table->num_bytes += _hash_item_cost(table, new_pair);
+        _lru_insert(table, new_pair);
+        _hashtable_evict(table, new_pair);
+    }
+
+    return 0;
+}
+
+
+static int _hashtable_insert(hashtable_t *table, char const *key, size_t keylen, void *value, uint32_t override,
+                             void (*deallocator)(void*))
+{
+    uint32_t hash = hash_str_key(key, keylen);
+    hash_item_t *new_pair = _hashtable_find_for_insert(table, key, keylen, hash);
+
+    if(new_pair != NULL)
+    {
+        if(!override) return -1;  /* if the key has been aready added and override is off, don't replace it.
+                                   * if override is on, replace the value pointed to by the item with that key. */
+
+        if(_hashtable_is_bounded(table))
+            table->num_bytes -= _hash_item_cost(table, new_pair);
+
+        _hash_item_release(table, new_pair, deallocator);
+
+        new_pair->value = value;
+        new_pair->flags &= ~HASH_ITEM_INLINE_BITS;    // any inline bytes are left unused in the key's allocation
+        if(table->flags & HASHTABLE_MULTIMAP)
+        {
+            _value_run(new_pair)->count = 1;      // the run is replaced by this one value
+            _value_run(new_pair)->values[0] = value;
+        }
+
+        if(_hashtable_is_bounded(table))
+        {
+            table->num_bytes += _hash_item_cost(table, new_pair);
+            _lru_touch(table, new_pair);
+            _hashtable_evict(table, new_pair);
+        }
+
+        return 1;  // value overwritten
+    }
+
+    new_pair = _hash_item_create(table, key, keylen, hash, value);
+    if(!new_pair)
+        return -1;
+
+    if(_hashtable_link_item(table, new_pair) != 0)
+    {
+        _hash_item_destroy(table, new_pair);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* _hashtable_grow_if_loaded
+ *
+ * Called once an item has been linked in, grows the buckets (or hands the job to the background resize) when the
+ * load factor is reached. The insert has already succeeded, so growth failing is left for a later insert to retry.
+ * */
+static void _hashtable_grow_if_loaded(hashtable_t *table)
+{
+    if(table->num_items / table->table_size < table->max_load_factor)
+        return;
+
+#ifdef HAVE_PTHREAD
+    if(table->flags & HASHTABLE_BACKGROUND_RESIZE)
+        _resize_start(table);
+    else
+#endif
+    _hashtable_grow(table);
+}
+
+
+int hashtable_set(hashtable_t **table, const char *key, size_t keylen, void *value, uint32_t replace,
+                  void (*deallocator)(void*))
+{
+    int ret;
+
+    if(!table || !(*table) || !key)
+        return -1;
+
+    switch((*table)->backend)
+    {
+    case HASHTABLE_BACKEND_ROBINHOOD:
+        return _robinhood_set(*table, key, keylen, value, replace, deallocator);
+    case HASHTABLE_BACKEND_CUCKOO:
+        return _cuckoo_set(*table, key, keylen, value, replace, deallocator);
+    case HASHTABLE_BACKEND_HOPSCOTCH:
+        return _hopscotch_set(*table, key, keylen, value, replace, deallocator);
+    case HASHTABLE_BACKEND_CACHELINE:
+        return _cacheline_set(*table, key, keylen, value, replace, deallocator);
+    }
+
+    if(!(*table)->buckets)
+        return -1;
+
+    ret = _hashtable_insert(*table, key, keylen, value, replace, deallocator);
+    if(ret < 0)
+        return -1;
+
+    if(ret == 0)
+        _hashtable_grow_if_loaded(*table);
+
+    return 0;
+}
+
+
+void **hashtable_emplace(hashtable_t **table, const char *key, size_t keylen, int *inserted)
+{
+    hash_item_t *pair;
+    uint32_t hash;
+
+    if(!table || !(*table) || !key || !inserted || (*table)->backend != HASHTABLE_BACKEND_CHAINED
+       || ((*table)->flags & HASHTABLE_MULTIMAP) || _hashtable_is_bounded(*table))
+        return NULL;
+
+    hash = hash_str_key(key, keylen);
+    pair = _hashtable_find_for_insert(*table, key, keylen, hash);
+    if(pair != NULL)
+    {
+        *inserted = 0;
+        return &pair->value;
+    }
+
+    pair = _hash_item_create(*table, key, keylen, hash, NULL);
+    if(!pair)
+        return NULL;
+
+    if(_hashtable_link_item(*table, pair) != 0)
+    {
+        _hash_item_destroy(*table, pair);
+        return NULL;
+    }
+
+    /* growth moves buckets, never items, so the slot survives it */
+    _hashtable_grow_if_loaded(*table);
+
+    *inserted = 1;
+    return &pair->value;
+}
+
+
+/* one worker of _hashtable_grow, migrating old buckets [first, last) */
+typedef struct hashtable_grow_worker
+{
+    hashtable_t *table;
+    bucket_t **new_buckets;
+    size_t new_size;
+    size_t first;
+    size_t last;
+    int failed;
+}hashtable_grow_worker_t;
+
+
+/* _grow_alloc
+ *
+ * Allocate every new bucket that the items of old buckets [first, last) will need. With a growth factor of k, old
+ * bucket i only ever feeds new buckets i, i + table_size, ..., i + (k - 1) * table_size, so workers given
+ * disjoint old ranges also write disjoint new buckets.
+ * */
+static void *_grow_alloc(void *arg)
+{
+    hashtable_grow_worker_t *worker = arg;
+    hash_item_t *curr_item;
+
+    for(size_t i = worker->first; i < worker->last; i++)
+    {
+        if(worker->table->buckets[i] == 0)
+            continue;
+
+        for(curr_item = worker->table->buckets[i]->head; curr_item != NULL; curr_item = curr_item->next)
+        {
+            size_t index = curr_item->hash % worker->new_size;
+            if(worker->new_buckets[index] != 0)
+                continue;
+
+            worker->new_buckets[index] = malloc(sizeof(bucket_t));
+            if(!worker->new_buckets[index])
+            {
+                worker->failed = 1;
+                return NULL;
+            }
+            _bucket_init(worker->new_buckets[index]);
+        }
+    }
+
+    return NULL;
+}
+
+
+static void *_grow_move(void *arg)
+{
+    hashtable_grow_worker_t *worker = arg;
+    bucket_t *curr_bucket;
+    hash_item_t *curr_item, *temp_item;
+
+    for(size_t i = worker->first; i < worker->last; i++)
+    {
+        curr_bucket = worker->table->buckets[i];
+        if(curr_bucket != 0)              // if this bucket had some data in
+        {
+            curr_item = curr_bucket->head;
+            while(curr_item != NULL)     // iterate through bucket
+            {
+                /* Move the item into its new bucket */
+                temp_item = curr_item->next;
+                _bucket_insert(worker->new_buckets[curr_item->hash % worker->new_size], curr_item);
+
+                curr_item = temp_item;
+            };
+
+            free(curr_bucket);          // destroy old bucket
+        }
+    }
+
+    return NULL;
+}
+
+
+/* _hashtable_grow
+ *
+ * Grow the bucket array by HASHTABLE_GROWTH_FACTOR, moving the existing items across rather than copying them
+ * so that they keep their identity (and their place in the recency list). Every bucket the new array needs is
+ * allocated before anything moves, so on failure the table is left untouched. Large tables given threads by
+ * hashtable_set_threads split the old array into ranges which are migrated concurrently.
+ * */
+static int _hashtable_grow(hashtable_t *table)
+{
+    hashtable_grow_worker_t workers[HASHTABLE_MAX_THREADS];
+    bucket_t **new_buckets;
+    size_t new_size = table->table_size * HASHTABLE_GROWTH_FACTOR;
+    size_t nthreads = table->table_size >= HASHTABLE_PARALLEL_GROW_MIN ? table->nthreads : 1;
+
+    new_buckets = calloc(new_size, sizeof(bucket_t*));
+    if(!new_buckets)
+        return -1;
+
+    for(size_t i = 0; i < nthreads; i++)
+    {
+        workers[i].table = table;
+        workers[i].new_buckets = new_buckets;
+        workers[i].new_size = new_size;
+        workers[i].first = i * table->table_size / nthreads;
+        workers[i].last = (i + 1) * table->table_size / nthreads;
+        workers[i].failed = 0;
+    }
+
+    _hashtable_run_parallel(_grow_alloc, workers, sizeof(hashtable_grow_worker_t), nthreads);
+
+    for(size_t i = 0; i < nthreads; i++)
+    {
+        if(workers[i].failed)
+        {
+            for(size_t j = 0; j < new_size; j++)
+                free(new_buckets[j]);
+            free(new_buckets);
+            return -1;
+        }
+    }
+
+    _hashtable_run_parallel(_grow_move, workers, sizeof(hashtable_grow_worker_t), nthreads);
+
+    free(table->buckets);  // free the list of pointers
+    table->buckets = new_buckets;
+    table->table_size = new_size;
+
+    if(table->prefilter)
+        _prefilter_build(table);   // sized for the new capacity
+
+    return 0;
+}
+
+
+#ifdef HAVE_PTHREAD
+/* _resize_migrate
+ *
+ * Move the items of old bucket 'i' into the new array. Every new bucket they need is allocated first, so on
+ * failure the old bucket is left intact. The caller holds the bucket's stripe lock, or is the only thread left.
+ * */
+static int _resize_migrate(hashtable_resize_t *resize, size_t i)
+{
+    bucket_t *old_bucket = resize->table->buckets[i];
+    hash_item_t *curr_item, *temp_item;
+
+    if(old_bucket == 0)
+        return 0;
+
+    for(curr_item = old_bucket->head; curr_item != NULL; curr_item = curr_item->next)
+    {
+        bucket_t **dest = &resize->new_buckets[curr_item->hash % resize->new_size];
+        if(*dest != 0)
+            continue;
+
+        *dest = malloc(sizeof(bucket_t));
+        if(*dest == 0)
+            return -1;     // the buckets already allocated are just empty ones
+        _bucket_init(*dest);
+    }
+
+    for(curr_item = old_bucket->head; curr_item != NULL; curr_item = temp_item)
+    {
+        temp_item = curr_item->next;
+        _bucket_insert(resize->new_buckets[curr_item->hash % resize->new_size], curr_item);
+    }
+
+    free(old_bucket);
+    resize->table->buckets[i] = NULL;
+
+    return 0;
+}
+
+
+/* _resize_worker
+ *
+ * The migrator thread, moving one old bucket at a time under its stripe lock. The foreground only ever changes
+ * table->buckets and table->table_size once this has been joined, so reading them here is safe.
+ * */
+static void *_resize_worker(void *arg)
+{
+    hashtable_resize_t *resize = arg;
+    size_t old_size = resize->table->table_size;
+
+    for(size_t i = atomic_load_explicit(&resize->migrated, memory_order_relaxed); i < old_size; i++)
+    {
+        pthread_mutex_t *lock = &resize->locks[i % RESIZE_STRIPES];
+        int ret;
+
+        pthread_mutex_lock(lock);
+        ret = _resize_migrate(resize, i);
+        if(ret == 0)
+            atomic_store_explicit(&resize->migrated, i + 1, memory_order_release);
+        pthread_mutex_unlock(lock);
+
+        if(ret != 0)
+            break;      // hashtable_resize_finish will carry on from here
+    }
+
+    atomic_store_explicit(&resize->done, 1, memory_order_release);
+
+    return NULL;
+}
+
+
+static void _resize_join(hashtable_resize_t *resize)
+{
+    if(!resize->joined)
+    {
+        pthread_join(resize->thread, NULL);
+        resize->joined = 1;
+    }
+}
+
+
+/* the new bucket array is not freed here, it becomes the table's own once the resize is finished */
+static void _resize_free(hashtable_resize_t *resize)
+{
+    for(size_t i = 0; i < RESIZE_STRIPES; i++)
+        pthread_mutex_destroy(&resize->locks[i]);
+
+    free(resize);
+}
+
+
+/* _resize_start
+ *
+ * Called by hashtable_set once the load factor is crossed. Starts a migrator for a grown bucket array, after
+ * completing the previous resize if its migrator has already stopped. While a migrator is running the table is
+ * simply allowed to run over its load factor. If no thread can be started the table grows in place instead.
+ * */
+static void _resize_start(hashtable_t *table)
+{
+    hashtable_resize_t *resize = table->resize;
+
+    if(resize != NULL)
+    {
+        if(!atomic_load_explicit(&resize->done, memory_order_acquire))
+            return;
+
+        if(hashtable_resize_finish(table) != 0 || table->num_items / table->table_size < table->max_load_factor)
+            return;
+    }
+
+    resize = calloc(1, sizeof(hashtable_resize_t));
+    if(!resize)
+        return;
+
+    resize->table = table;
+    resize->new_size = table->table_size * HASHTABLE_GROWTH_FACTOR;
+    resize->new_buckets = calloc(resize->new_size, sizeof(bucket_t*));
+    atomic_init(&resize->migrated, 0);
+    atomic_init(&resize->done, 0);
+    for(size_t i = 0; i < RESIZE_STRIPES; i++)
+        pthread_mutex_init(&resize->locks[i], NULL);
+
+    if(!resize->new_buckets || pthread_create(&resize->thread, NULL, _resize_worker, resize) != 0)
+    {
+        free(resize->new_buckets);
+        _resize_free(resize);
+        _hashtable_grow(table);
+        return;
+    }
+
+    table->resize = resize;
+}
+#endif
+
+
+int hashtable_resize_finish(hashtable_t *table)
+{
+    if(!table)
+        return -1;
+
+#ifdef HAVE_PTHREAD
+    hashtable_resize_t *resize = table->resize;
+    if(!resize)
+        return 0;
+
+    _resize_join(resize);
+
+    /* only left to do if the migrator ran out of memory */
+    for(size_t i = atomic_load_explicit(&resize->migrated, memory_order_relaxed); i < table->table_size; i++)
+    {
+        if(_resize_migrate(resize, i) != 0)
+        {
+            atomic_store_explicit(&resize->migrated, i, memory_order_relaxed);
+            return -1;      // still consistent, both arrays remain in use
+        }
+    }
+
+    free(table->buckets);
+    table->buckets = resize->new_buckets;
+    table->table_size = resize->new_size;
+    table->resize = NULL;
+    _resize_free(resize);
+
+    if(table->prefilter)
+        _prefilter_build(table);   // sized for the new capacity
+#endif
+
+    return 0;
+}
+
+
+int hashtable_set_background_resize(hashtable_t *table, int enable)
+{
+    if(!table || table->backend != HASHTABLE_BACKEND_CHAINED)
+        return -1;
+
+#ifdef HAVE_PTHREAD
+    if(enable)
+    {
+        table->flags |= HASHTABLE_BACKGROUND_RESIZE;
+        return 0;
+    }
+
+    if(hashtable_resize_finish(table) != 0)
+        return -1;
+
+    table->flags &= ~(hashtable_flag)HASHTABLE_BACKGROUND_RESIZE;
+    return 0;
+#else
+    return enable ? -1 : 0;
+#endif
+}
+
+
+/* _hashtable_find
+ *
+ * Check if an item with the key supplied exists in our hash table. If so, retrun this item,
+ * if not then return NULL.
  * */
 static hash_item_t * _hashtable_find(hashtable_t const *table, const char *key, size_t keylen)
 {
     /* run hash function, find bucket, search through bucket for item */
     if(!table || !key) return NULL;
 
-    uint32_t index = (uint32_t)(hashlittle(key, keylen, hashtable_seed) % table->table_size);
-    bucket_t *bucket = table->buckets[index];
-    if(!bucket)
+    uint32_t hash = hash_str_key(key, keylen);
+    if(table->prefilter && !_prefilter_maybe_contains(table, hash))
         return NULL;
 
-    /* if the bucket has never had a collion and one item, we can assume the requested value is the head */
-    if(!bucket->had_collision && bucket->size == 1) return bucket->head;
-    else if(strncmp(bucket->head->key, key, keylen) == 0)  /* if the bucket has, we cannot assume this */
-        return bucket->head;
+    bucket_t *bucket = *_hashtable_slot_acquire(table, hash);
+    hash_item_t *curr_item = bucket ? bucket->head : NULL;
 
-    hash_item_t *curr_item = bucket->head;
-    while(curr_item != bucket->tail)
+    /* the cached hash rejects almost every other item in the bucket without touching its key */
+    for(; curr_item != NULL; curr_item = curr_item->next)
     {
-        curr_item = curr_item->next;
-        if(strncmp(key, curr_item->key, keylen) == 0){
-            return curr_item;   // found !
-        }
+        if(_key_matches(curr_item, hash, key, keylen))
+            break;   // found !
     }
 
-    return NULL;
+    _hashtable_slot_release(table, hash);
+
+    return curr_item;
+}
+
+
+/* _hashtable_find_live
+ *
+ * As _hashtable_find, but an expired item is removed on sight and reported as missing. The table itself was
+ * allocated by hashtable_create, so modifying it through a const pointer here is legal.
+ * */
+static hash_item_t *_hashtable_find_live(hashtable_t const *table, const char *key, size_t keylen)
+{
+    hash_item_t *pair = _hashtable_find(table, key, keylen);
+
+    if(pair && _hash_item_expired(table, pair))
+    {
+        _hashtable_drop_item((hashtable_t *)table, pair);
+        return NULL;
+    }
+
+    return pair;
 }
 
 
 const void * hashtable_get(hashtable_t const *table, const char *key, size_t keylen)
 {
+    if(!table || !key)
+        return NULL;
+
+    switch(table->backend)
+    {
+    case HASHTABLE_BACKEND_ROBINHOOD:
+        return _robinhood_get(table, key, keylen);
+    case HASHTABLE_BACKEND_CUCKOO:
+        return _cuckoo_get(table, key, keylen);
+    case HASHTABLE_BACKEND_HOPSCOTCH:
+        return _hopscotch_get(table, key, keylen);
+    case HASHTABLE_BACKEND_CACHELINE:
+        return _cacheline_get(table, key, keylen);
+    }
+
     /* run hash function, find bucket, search through bucket for item (return NULL if not found) */
-    hash_item_t *pair = _hashtable_find(table, key, keylen);
+    hash_item_t *pair = _hashtable_find_live(table, key, keylen);
+    if(!pair)
+        return NULL;
+
+    if(_hashtable_is_bounded(table))
+        _lru_touch((hashtable_t *)table, pair);
+
+    return pair->value;
+}
+
+
+
+int hashtable_foreach(hashtable_t const *table, int (*fn)(const char *key, size_t keylen, void *value, void *ctx),
+                      void *ctx)
+{
+    hash_item_t *curr_item;
+    char *key, *scratch = NULL;
+    size_t scratch_len = 0;
+    int ret;
+
+    if(!table || !fn)
+        return -1;
+
+    switch(table->backend)
+    {
+    case HASHTABLE_BACKEND_ROBINHOOD:
+        return _robinhood_foreach(table, fn, ctx);
+    case HASHTABLE_BACKEND_CUCKOO:
+        return _cuckoo_foreach(table, fn, ctx);
+    case HASHTABLE_BACKEND_HOPSCOTCH:
+        return _hopscotch_foreach(table, fn, ctx);
+    case HASHTABLE_BACKEND_CACHELINE:
+        return _cacheline_foreach(table, fn, ctx);
+    }
+
+    for(hashtable_walk_t walk = _walk_begin(table); (curr_item = _walk_next(table, &walk)) != NULL; )
+    {
+        if(_hash_item_expired(table, curr_item))
+            continue;
+
+        key = curr_item->key;
+        if(curr_item->flags & HASH_ITEM_FRONT_CODED)
+        {
+            /* front coded keys are put back together in a scratch buffer, valid for the call to 'fn' */
+            hash_front_coded_key_t *coded = (hash_front_coded_key_t *)curr_item->key;
+            size_t prefix_len = _keypool_keylen(coded->prefix);
+
+            if(scratch_len < curr_item->keylen + 1)
+            {
+                char *grown = realloc(scratch, curr_item->keylen + 1);
+                if(!grown)
+                {
+                    _walk_end(table, &walk);
+                    free(scratch);
+                    return -1;
+                }
+
+                scratch = grown;
+                scratch_len = curr_item->keylen + 1;
+            }
+
+            memcpy(scratch, coded->prefix, prefix_len);
+            memcpy(scratch + prefix_len, coded->suffix, curr_item->keylen - prefix_len + 1);
+            key = scratch;
+        }
+
+        ret = fn(key, curr_item->keylen, curr_item->value, ctx);
+        if(ret != 0)
+        {
+            _walk_end(table, &walk);
+            free(scratch);
+            return ret;    // stopped early by the caller
+        }
+    }
+
+    free(scratch);
+
+    return 0;
+}
+
+
+int hashtable_add(hashtable_t **table, const char *key, size_t keylen, void *value)
+{
+    hash_item_t *pair;
+    hash_value_run_t *run;
+
+    if(!table || !(*table) || !key || !((*table)->flags & HASHTABLE_MULTIMAP))
+        return -1;
+
+    pair = _hashtable_find_live(*table, key, keylen);
+    if(!pair)
+        return hashtable_set(table, key, keylen, value, 0, NULL);   // a new key, with a run of one
+
+    if(_hashtable_is_bounded(*table))
+        (*table)->num_bytes -= _hash_item_cost(*table, pair);
+
+    run = _value_run(pair);
+    if(run->count == run->capacity)
+    {
+        /* only the key's allocation moves, nothing links to it but the item */
+        size_t capacity = run->capacity * 2;
+        char *key_copy = realloc(pair->key, VALUE_RUN_OFFSET(keylen) + sizeof(hash_value_run_t)
+                                            + capacity * sizeof(void*));
+        if(!key_copy)
+        {
+            if(_hashtable_is_bounded(*table))
+                (*table)->num_bytes += _hash_item_cost(*table, pair);
+            return -1;
+        }
+
+        pair->key = key_copy;
+        run = _value_run(pair);
+        run->capacity = capacity;
+    }
+
+    run->values[run->count++] = value;
+
+    if(_hashtable_is_bounded(*table))
+    {
+        (*table)->num_bytes += _hash_item_cost(*table, pair);
+        _lru_touch(*table, pair);
+        _hashtable_evict(*table, pair);
+    }
+
+    return 0;
+}
+
+
+int hashtable_get_all(hashtable_t const *table, const char *key, size_t keylen, void *const **values,
+                      size_t *count)
+{
+    hash_item_t *pair;
+
+    if(!table || !(table->flags & HASHTABLE_MULTIMAP))
+        return -1;
+
+    pair = _hashtable_find_live(table, key, keylen);
+    if(!pair)
+        return -1;
+
+    if(_hashtable_is_bounded(table))
+        _lru_touch((hashtable_t *)table, pair);
+
+    if(values)
+        *values = _value_run(pair)->values;
+    if(count)
+        *count = _value_run(pair)->count;
+
+    return 0;
+}
+
+
+/* _hash_item_set_inline
+ *
+ * Move 'len' bytes into an existing item, after its (8 byte aligned) key in the same allocation, as its value.
+ * If the key cannot be reallocated the item is left as it was.
+ * */
+static int _hash_item_set_inline(hashtable_t *table, hash_item_t *item, const void *bytes, size_t len)
+{
+    size_t offset = VALUE_RUN_OFFSET(item->keylen);
+    char *key_copy = realloc(item->key, offset + (len ? len : 1));
+    if(!key_copy)
+        return -1;
+
+    if(_hashtable_is_bounded(table))
+        table->num_bytes -= _hash_item_cost(table, item);
+
+    item->key = key_copy;
+    item->value = key_copy + offset;
+    memcpy(item->value, bytes, len);
+    item->flags &= ~HASH_ITEM_INLINE_BITS;
+    item->flags |= HASH_ITEM_INLINE | ((hashtable_flag)len << HASH_ITEM_INLINE_SHIFT);
+
+    if(_hashtable_is_bounded(table))
+    {
+        table->num_bytes += _hash_item_cost(table, item);
+        _lru_touch(table, item);
+        _hashtable_evict(table, item);
+    }
+
+    return 0;
+}
+
+
+int hashtable_set_inline(hashtable_t **table, const char *key, size_t keylen, const void *bytes, size_t len)
+{
+    hash_item_t *pair;
+    uint32_t hash;
+
+    if(!table || !(*table) || !key || (!bytes && len) || len > HASHTABLE_INLINE_MAX
+       || (*table)->backend != HASHTABLE_BACKEND_CHAINED || ((*table)->flags & HASHTABLE_MULTIMAP)
+       || (*table)->keypool || (*table)->prefixes || !(*table)->buckets)
+        return -1;
+
+    hash = hash_str_key(key, keylen);
+    pair = _hashtable_find_for_insert(*table, key, keylen, hash);
+    if(pair != NULL)
+        return _hash_item_set_inline(*table, pair, bytes, len);
+
+    pair = _hash_item_create_inline(*table, key, keylen, hash, bytes, len);
     if(!pair)
+        return -1;
+
+    if(_hashtable_link_item(*table, pair) != 0)
+    {
+        _hash_item_destroy(*table, pair);
+        return -1;
+    }
+
+    _hashtable_grow_if_loaded(*table);
+
+    return 0;
+}
+
+
+const void *hashtable_get_inline(hashtable_t const *table, const char *key, size_t keylen, size_t *len)
+{
+    hash_item_t *pair;
+
+    if(!table || !key || table->backend != HASHTABLE_BACKEND_CHAINED)
         return NULL;
 
+    pair = _hashtable_find_live(table, key, keylen);
+    if(!pair || !(pair->flags & HASH_ITEM_INLINE))
+        return NULL;
+
+    if(_hashtable_is_bounded(table))
+        _lru_touch((hashtable_t *)table, pair);
+
+    if(len)
+        *len = (pair->flags >> HASH_ITEM_INLINE_SHIFT) & 0xff;
+
     return pair->value;
 }
 
 
+int hashtable_set_expiry(hashtable_t *table, const char *key, size_t keylen, uint64_t expires_at)
+{
+    if(!table || table->backend != HASHTABLE_BACKEND_CHAINED)
+        return -1;
+
+    hash_item_t *pair = _hashtable_find_live(table, key, keylen);
+    if(!pair)
+        return -1;
+
+    if(pair->flags & HASH_ITEM_TIMED)
+        _wheel_unlink(table->wheel, pair);
+
+    if(expires_at == 0)
+    {
+        if(pair->flags & HASH_ITEM_EXTENDED)
+            _item_ext(pair)->expires_at = 0;
+        return 0;
+    }
+
+    if(table->wheel == NULL)
+    {
+        table->wheel = calloc(1, sizeof(hashtable_timer_wheel_t));
+        if(!table->wheel)
+            return -1;
+        table->wheel->current = table->clock();
+    }
+
+    pair = _hashtable_extend_item(table, pair);
+    if(!pair)
+        return -1;
+
+    _item_ext(pair)->expires_at = expires_at;
+    _wheel_insert(table->wheel, pair);
+
+    return 0;
+}
+
+
+void hashtable_set_clock(hashtable_t *table, uint64_t (*clock)(void))
+{
+    if(!table)
+        return;
+
+    table->clock = clock ? clock : _hashtable_default_clock;
+}
+
+
+size_t hashtable_expire(hashtable_t *table, uint64_t now, size_t budget)
+{
+    hashtable_timer_wheel_t *wheel;
+    size_t removed = 0;
+
+    if(!table || !table->wheel)
+        return 0;
+
+    wheel = table->wheel;
+    if(wheel->current > now)
+        return 0;
+
+    for(;;)
+    {
+        uint32_t slot = (uint32_t)wheel->current & (WHEEL_SLOTS - 1);
+
+        /* expire everything due at this tick, the slot is emptied from its head so a stop leaves it consistent */
+        while(wheel->slots[0][slot] != NULL)
+        {
+            if(budget && removed == budget)
+                return removed;     // resume from this tick next time
+
+            _hashtable_drop_item(table, wheel->slots[0][slot]);
+            removed++;
+        }
+
+        /* jump straight to the next tick with anything to do, or to 'now' itself if that comes first. The wheel
+         * stops at 'now' rather than past it, since items made due by 'now' after this call are clamped into the
+         * current slot, and the next call has to find them there */
+        uint64_t next = _wheel_next_tick(wheel);
+        if(next == 0 || next > now)
+        {
+            if(wheel->current == now)
+                break;
+            next = now;
+        }
+
+        wheel->current = next;
+        if((wheel->current & (WHEEL_SLOTS - 1)) == 0)
+            _wheel_cascade(wheel);
+    }
+
+    return removed;
+}
+
+
+int hashtable_set_threads(hashtable_t *table, size_t nthreads)
+{
+    if(!table)
+        return -1;
+
+    table->nthreads = _hashtable_threads(nthreads);
+
+    return 0;
+}
+
+
+int hashtable_set_keypool(hashtable_t *table, struct hashtable_keypool *pool)
+{
+    if(!table || table->backend != HASHTABLE_BACKEND_CHAINED || (table->flags & HASHTABLE_MULTIMAP)
+       || table->num_items != 0 || table->prefixes)
+        return -1;
+
+    table->keypool = pool;
+
+    return 0;
+}
+
+
+int hashtable_set_key_prefixes(hashtable_t *table, char separator)
+{
+    if(!table || table->backend != HASHTABLE_BACKEND_CHAINED || (table->flags & HASHTABLE_MULTIMAP)
+       || table->num_items != 0 || table->keypool)
+        return -1;
+
+    if(!table->prefixes)
+    {
+        table->prefixes = hashtable_keypool_create(0);
+        if(!table->prefixes)
+            return -1;
+    }
+
+    table->prefix_separator = separator;
+
+    return 0;
+}
+
+
+int hashtable_enable_prefilter(hashtable_t *table, uint32_t bits_per_key)
+{
+    if(!table || table->backend != HASHTABLE_BACKEND_CHAINED)
+        return -1;
+
+    if(bits_per_key == 0)
+    {
+        free(table->prefilter);
+        table->prefilter = NULL;
+        table->prefilter_blocks = 0;
+        table->prefilter_bits_per_key = 0;
+        return 0;
+    }
+
+    table->prefilter_bits_per_key = bits_per_key;
+    if(_prefilter_build(table) != 0)
+    {
+        if(!table->prefilter)
+            table->prefilter_bits_per_key = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
 
 int hashtable_exists_pair(hashtable_t const *table, const char *key, size_t keylen) // boolean ish?
 {
-    if(_hashtable_find(table, key, keylen) != NULL)
+    if(!table || !key)
+        return 0;
+
+    switch(table->backend)
+    {
+    case HASHTABLE_BACKEND_ROBINHOOD:
+        return _robinhood_exists_pair(table, key, keylen);
+    case HASHTABLE_BACKEND_CUCKOO:
+        return _cuckoo_exists_pair(table, key, keylen);
+    case HASHTABLE_BACKEND_HOPSCOTCH:
+        return _hopscotch_exists_pair(table, key, keylen);
+    case HASHTABLE_BACKEND_CACHELINE:
+        return _cacheline_exists_pair(table, key, keylen);
+    }
+
+    if(_hashtable_find_live(table, key, keylen) != NULL)
         return 1;
     return 0;
 }
@@ -387,39 +2590,46 @@ int _hashtable_remove(hashtable_t *table, const char* key, size_t keylen, void (
     if(!table || !table->num_items || !key)
         return -1;
 
-    uint32_t index = (uint32_t)(hashlittle(key, keylen, hashtable_seed) % table->table_size);
-    bucket_t *bucket = table->buckets[index];
+    switch(table->backend)
+    {
+    case HASHTABLE_BACKEND_ROBINHOOD:
+        return _robinhood_remove(table, key, keylen, deallocator);
+    case HASHTABLE_BACKEND_CUCKOO:
+        return _cuckoo_remove(table, key, keylen, deallocator);
+    case HASHTABLE_BACKEND_HOPSCOTCH:
+        return _hopscotch_remove(table, key, keylen, deallocator);
+    case HASHTABLE_BACKEND_CACHELINE:
+        return _cacheline_remove(table, key, keylen, deallocator);
+    }
 
-    if(!bucket)
-        return -1;    // clearly does not exist in our table
+    uint32_t hash = hash_str_key(key, keylen);
+    bucket_t *bucket = *_hashtable_slot_acquire(table, hash);
 
     hash_item_t *prev_item = NULL;
-    hash_item_t *temp_item = bucket->head;
-
-    if(!temp_item)
-        return -1;   // existed at one point, but has since been removed
+    hash_item_t *temp_item = bucket ? bucket->head : NULL;   // no bucket or an empty one, clearly not in our table
 
     /* find the item in the bucket and remove it from the LL as needed */
     while(temp_item != NULL)
     {
-       if(strncmp(key, temp_item->key, keylen) == 0)        // we have found the item!
+       if(_key_matches(temp_item, hash, key, keylen))        // we have found the item!
        {
            /* remove the item from the bucket (LL removal) */
+           _bucket_unlink(bucket, prev_item, temp_item);
+           _hashtable_slot_release(table, hash);
+           _hashtable_forget(table, temp_item);
 
-           if(temp_item == bucket->head)
-               bucket->head = bucket->head->next;
-           else prev_item->next = temp_item->next;         // if it lies deeper into the bucket
+           _hash_item_release(table, temp_item, deallocator);
 
-           if(deallocator != NULL)
-               deallocator(temp_item->value);
-
-           _hash_item_destroy(temp_item);
-
-           table->num_items--;
+           _hash_item_destroy(table, temp_item);
 
            return 0;
        }
+
+       prev_item = temp_item;
+       temp_item = temp_item->next;
     }
 
+    _hashtable_slot_release(table, hash);
+
     return -1;    // the item was not found in the table
 }
@@ -10,17 +10,41 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define HASHTABLE_GROWTH_FACTOR 2
 #define MAX_KEY_LEN 32
+#define HASHTABLE_INLINE_MAX 64      // largest value hashtable_set_inline stores
+#define HASHTABLE_MAX_THREADS 64    // upper bound on the workers used by the parallel operations
+#define HASHTABLE_PARALLEL_GROW_MIN 65536   // buckets below which growth stays on the calling thread
 
 typedef uint32_t hashtable_flag;
 
+/* eviction policies for bounded tables */
+#define HASHTABLE_EVICT_LRU   0     // strict recency order, every hit relinks the item
+#define HASHTABLE_EVICT_CLOCK 1     // hits only set a reference bit, which a sweeping hand clears
+
+/* storage backends, see hashtable_create_backend */
+#define HASHTABLE_BACKEND_CHAINED   0   // buckets of linked hash_item_t, supports every mode
+#define HASHTABLE_BACKEND_ROBINHOOD 1   // open addressing with Robin Hood probing and backward shift deletion
+#define HASHTABLE_BACKEND_CUCKOO    2   // bucketised cuckoo hashing, at most two buckets per lookup
+#define HASHTABLE_BACKEND_HOPSCOTCH 3   // open addressing, every key within a fixed neighbourhood of its home
+#define HASHTABLE_BACKEND_CACHELINE 4   // chains of cache line nodes, 6 tagged entries each
+
+/* table modes, fixed when the table is created */
+#define HASHTABLE_MULTIMAP 0x1      // a key maps to a run of values, see hashtable_add
+#define HASHTABLE_BACKGROUND_RESIZE 0x2   // growth is done by a migrator thread, see hashtable_set_background_resize
+
 typedef struct hashtable_item
 {
     struct hashtable_item *next;
     char *key;
     void *value;
     size_t keylen;
+    uint32_t hash;                      // cached so that growth and eviction never rehash keys
+    hashtable_flag flags;
 }hash_item_t;
 
 
@@ -42,6 +66,38 @@ typedef struct hashtable_t
 
     bucket_t **buckets;
     void (*deallocator)(void*);   // none by defualt
+    hashtable_flag flags;         // HASHTABLE_MULTIMAP etc.
+
+    /* bounded (cache) mode, a limit of 0 means unlimited */
+    size_t max_items;
+    size_t max_bytes;
+    size_t num_bytes;
+    size_t (*value_size)(const void*);
+    hashtable_flag policy;
+    hash_item_t *lru_head;        // most recently used (LRU) or inserted (CLOCK)
+    hash_item_t *lru_tail;        // next to be evicted (LRU)
+    hash_item_t *clock_hand;      // next to be considered for eviction (CLOCK), NULL means start from the tail
+
+    /* expiry, the wheel is only allocated once some item is given an expiry time */
+    struct hashtable_timer_wheel *wheel;
+    uint64_t (*clock)(void);      // time(NULL) by default
+
+    /* optional blocked Bloom filter answering most negative lookups before the bucket array is touched */
+    uint64_t *prefilter;
+    size_t prefilter_blocks;      // 512 bit (one cache line) blocks
+    uint32_t prefilter_bits_per_key;
+    size_t prefilter_stale;       // items removed since the filter was built, whose bits are still set
+
+    size_t nthreads;              // workers used to grow large tables, see hashtable_set_threads
+    struct hashtable_resize *resize;   // the background resize in progress, if any
+
+    hashtable_flag backend;       // HASHTABLE_BACKEND_CHAINED etc.
+    void *slots;                  // the slot array of any other backend, 'buckets' is then NULL
+
+    struct hashtable_keypool *keypool;   // shared copies of the keys, see hashtable_set_keypool
+    struct hashtable_keypool *prefixes;  // the key prefixes of this table, see hashtable_set_key_prefixes
+    char *last_prefix;            // the prefix of the last front coded key, holding a reference of its own
+    char prefix_separator;
 }hashtable_t;
 
 
@@ -58,6 +114,84 @@ void set_hashtable_seed(size_t seed);
 * a pointer to a hashtable object allocated via malloc, or NULL if this process fails.
 * */
 hashtable_t *hashtable_create(size_t initial_size, uint32_t max_load_factor);
+
+/* hashtable_create_backend
+ *
+ * Create a hashtable stored by 'backend'. HASHTABLE_BACKEND_CHAINED is the table hashtable_create makes.
+ *
+ * HASHTABLE_BACKEND_ROBINHOOD stores each pair in a 32 byte slot of one open addressed array, so it runs well at
+ * loads of 0.9 and above. Every slot records its distance from the key's home slot, and insertion lets the key
+ * further from home take a slot, so probe lengths stay short and even. A miss stops at the first slot nearer
+ * home than itself, and removal shifts the rest of the run back, so no tombstones build up. 'max_load_factor' is
+ * a percentage of slots used before the table grows (90 if 0).
+ *
+ * HASHTABLE_BACKEND_CUCKOO gives worst case constant time lookups. Every key lives in one of two candidate buckets of 4
+ * slots, each bucket being one cache line of hashes and entry pointers, so a lookup reads at most two lines of the
+ * table before comparing a key. When both buckets are full, insertion searches breadth first for the shortest chain of
+ * entries to move into their other buckets. A key which still finds no place goes to a small stash (checked only while
+ * it is in use, and moved back into the buckets as removals make room) and otherwise the table grows. 'max_load_factor'
+ * is again a percentage (90 if 0).
+ *
+ * HASHTABLE_BACKEND_HOPSCOTCH keeps every key within 32 slots of its home slot, and each home slot holds a bitmap
+ * of which of those slots hold its keys, so a lookup compares only the keys that share its home. Insertion takes
+ * the nearest free slot and, while it is too far away, hops it back towards home by moving an earlier key that
+ * stays within its own neighbourhood. If no such key can be found the table grows. 'max_load_factor' is a
+ * percentage as above (90 if 0).
+ *
+ * HASHTABLE_BACKEND_CACHELINE chains like HASHTABLE_BACKEND_CHAINED, but each link of a chain is a cache line
+ * holding an 8 bit tag and a pointer for each of 6 entries, plus a pointer to the next line. A chain walk
+ * compares the 6 tags of a line together and only touches the entries whose tag matches, so colliding keys cost
+ * one line each 6 rather than one item each. 'max_load_factor' is the average of entries per bucket (4 if 0).
+ *
+ * Backends other than HASHTABLE_BACKEND_CHAINED support set, get, exists_pair, remove, foreach and destroy, but
+ * not the bounded, multimap, expiry, prefilter or background resize modes.
+ * */
+hashtable_t *hashtable_create_backend(size_t initial_size, uint32_t max_load_factor, hashtable_flag backend);
+
+/* hashtable_create_multimap
+ *
+ * Create a hashtable in which a key maps to a run of values rather than a single value. The values for a key
+ * are stored in one growable array in the same allocation as the key, so fetching them all with
+ * hashtable_get_all costs no more than an ordinary lookup. hashtable_get returns the first value of a key, a
+ * replacing hashtable_set replaces the whole run, and removal, eviction and destruction apply the deallocator
+ * to every value in the run.
+ * */
+hashtable_t *hashtable_create_multimap(size_t initial_size, uint32_t max_load_factor);
+
+/* hashtable_create_bounded
+ *
+ * Create a hashtable which behaves as a cache. Once the table holds more than 'max_items' items, or the bytes
+ * charged to it exceed 'max_bytes', items are evicted according to 'policy' and their values passed to
+ * 'deallocator' (which may be NULL). Each item is charged for its key and bookkeeping, plus whatever
+ * 'value_size' reports for its value if that is not NULL. A limit of 0 means no limit of that kind.
+ *
+ * HASHTABLE_EVICT_LRU evicts the least recently set or retrieved item. HASHTABLE_EVICT_CLOCK approximates this
+ * with a reference bit per item: a hit only sets the bit (if it is not already set), and eviction sweeps the
+ * items in insertion order giving each referenced item a second chance. This keeps hashtable_get nearly
+ * write-free and stops one-off scans from flushing the hot items.
+ * */
+hashtable_t *hashtable_create_bounded(size_t initial_size, uint32_t max_load_factor, size_t max_items,
+                                      size_t max_bytes, hashtable_flag policy, size_t (*value_size)(const void*),
+                                      void (*deallocator)(void*));
+
+/* hashtable_build_parallel
+ *
+ * Create a hashtable holding the 'n' pairs (keys[i], values[i]), where key i is 'lens[i]' bytes long, using
+ * 'nthreads' threads (0 for one per CPU). The keys are hashed in parallel and partitioned by bucket range, so that
+ * each worker then fills its own slice of the bucket array without locking. 'values' may be NULL, in which case
+ * every value is NULL. If a key appears more than once the first occurrence wins and later values are ignored.
+ * The table has a maximum load factor of 4. Threads are only used when built with HAVE_PTHREAD, and CPUs are only
+ * counted where sysconf is available (HAVE_UNISTD_H, or any Unix), otherwise 0 means one thread.
+ * Returns NULL if this process fails.
+ * */
+hashtable_t *hashtable_build_parallel(const char *const *keys, const size_t *lens, void *const *values, size_t n,
+                                      size_t nthreads);
+
+/* hashtable_destroy
+ *
+ * Destroy the table and every item in it. Values are passed to 'deallocator', or to the table's own deallocator
+ * if that is NULL and the table has one.
+ * */
 int hashtable_destroy(hashtable_t *table, void (*deallocator)(void*));
 
 /* hashtable_set
@@ -65,6 +199,7 @@ int hashtable_destroy(hashtable_t *table, void (*deallocator)(void*));
  * Set the entry 'key' to the value of 'value'. 'replace' specifies whether we should replace an existing value
  * who's key is identical to key if such a value exists, and the deallocator argument requests a function to
  * clean the memory of such an item, (NULL is to be passed of this is not a desired behaviour.)
+ * Returns 0 if the value was set, and -1 if not (including when 'key' exists and 'replace' is 0).
  *  */
 int hashtable_set(hashtable_t **table, const char *key, size_t keylen, void *value, uint32_t replace,
                   void (*deallocator)(void*));
@@ -77,7 +212,49 @@ int hashtable_set(hashtable_t **table, const char *key, size_t keylen, void *val
     hashtable_set((table), (key), (keylen), (value), 1, NULL)
 
 #define hashtable_set_replace_and_destroy(table, key, keylen, value, deallocator)    \
-    hashtbale_set((table), (key), (keylen), (value), 1, deallocator)
+    hashtable_set((table), (key), (keylen), (value), 1, deallocator)
+
+/* hashtable_emplace
+ *
+ * Find 'key', adding it with a NULL value if it is not there, and return the address of its value so that the
+ * caller can build the value only when it is needed, in a single lookup. 'inserted' is set to 1 if the key was
+ * added and 0 if it was already there. The address is valid until the table is next modified. Returns NULL if
+ * this process fails, or if the table is a multimap, bounded, or not HASHTABLE_BACKEND_CHAINED.
+ * */
+void **hashtable_emplace(hashtable_t **table, const char *key, size_t keylen, int *inserted);
+
+/* hashtable_add
+ *
+ * Append 'value' to the run of values mapped by 'key' in a multimap, creating the key if needed. Returns 0 on
+ * success and -1 if not (including when the table is not a multimap).
+ * */
+int hashtable_add(hashtable_t **table, const char *key, size_t keylen, void *value);
+
+/* hashtable_get_all
+ *
+ * Set 'values' to the contiguous run of values mapped by 'key' in a multimap, and 'count' to its length. The run
+ * remains valid until the table is next modified. Returns 0 if 'key' exists and -1 if not.
+ * */
+int hashtable_get_all(hashtable_t const *table, const char *key, size_t keylen, void *const **values,
+                      size_t *count);
+
+/* hashtable_set_inline
+ *
+ * Set 'key' to a copy of the 'len' bytes at 'bytes' (at most HASHTABLE_INLINE_MAX), stored in the item itself
+ * just after its key, which saves allocating small values and a pointer hop to reach them. An existing value is
+ * replaced as by hashtable_set_replace. The table never passes inline bytes to a deallocator, and hashtable_get
+ * returns a pointer to them, valid until the table is next modified. Only for the chained backend, and not a
+ * multimap or a table with a key pool or key prefixes. Returns 0 if the bytes were set, and -1 if not, in which
+ * case any value 'key' already had is left untouched.
+ * */
+int hashtable_set_inline(hashtable_t **table, const char *key, size_t keylen, const void *bytes, size_t len);
+
+/* hashtable_get_inline
+ *
+ * Retrieve the bytes set for 'key' by hashtable_set_inline, storing their length in 'len' (if not NULL). Returns
+ * NULL if 'key' does not exist or its value was not set inline.
+ * */
+const void *hashtable_get_inline(hashtable_t const *table, const char *key, size_t keylen, size_t *len);
 
 /* hashtable_exists_pair
 *
@@ -103,7 +280,104 @@ int _hashtable_remove(hashtable_t *table, const char*key, size_t keylen, void (*
 /* hashtable_get
  *
  * Retrieve the item in our hashtable mapped by 'key' if such a value exists. Return NULL if not.
+ * In a bounded table this also marks the item as the most recently used.
  *  */
 const void *hashtable_get(hashtable_t const *table, const char *key, size_t keylen);
 
+/* hashtable_set_expiry
+ *
+ * Make the item mapped by 'key' expire at time 'expires_at', as measured by the table's clock, or never expire if
+ * 'expires_at' is 0. Expired items are never returned by hashtable_get or hashtable_exists_pair, and are removed
+ * (with the table's deallocator) either when they are next looked up or by hashtable_expire. Replacing an
+ * item's value keeps its expiry time.
+ * Will return 0 on success and -1 if there is no such item.
+ * */
+int hashtable_set_expiry(hashtable_t *table, const char *key, size_t keylen, uint64_t expires_at);
+
+/* hashtable_set_clock
+ *
+ * Replace the clock used for lazy expiry, which by default counts seconds via time(NULL). Any monotonic unit may
+ * be used, as long as expiry times and the 'now' given to hashtable_expire use the same one.
+ * */
+void hashtable_set_clock(hashtable_t *table, uint64_t (*clock)(void));
+
+/* hashtable_expire
+ *
+ * Remove the items which have expired by 'now', removing at most 'budget' of them (0 for no limit). Due items
+ * are found with a hierarchical timer wheel, so the cost is proportional to the number of expired items rather
+ * than the size of the table. Returns the number of items removed.
+ * */
+size_t hashtable_expire(hashtable_t *table, uint64_t now, size_t budget);
+
+/* hashtable_enable_prefilter
+ *
+ * Put a blocked Bloom filter with roughly 'bits_per_key' bits per item in front of the table, so that a lookup
+ * for a missing key is usually answered from a single cache line without hashing into the bucket array. The
+ * filter is sized for the table's capacity before its next growth and rebuilt as it grows, or once enough items
+ * have been removed. A 'bits_per_key' of 0 removes the filter. Will return 0 on success and -1 if not.
+ * */
+int hashtable_enable_prefilter(hashtable_t *table, uint32_t bits_per_key);
+
+/* hashtable_set_threads
+ *
+ * Let growth of this table use up to 'nthreads' threads (0 for one per CPU, 1 to stay on the calling thread, which
+ * is the default). Once the table has HASHTABLE_PARALLEL_GROW_MIN buckets, each growth splits the old bucket array
+ * into ranges which are migrated concurrently. Threads are only used when built with HAVE_PTHREAD.
+ * Will return 0 on success and -1 if not.
+ * */
+int hashtable_set_threads(hashtable_t *table, size_t nthreads);
+
+/* hashtable_set_keypool
+ *
+ * Take the keys of this table from 'pool' (see hashtable_keypool.h) rather than copying each one, or stop doing so
+ * if 'pool' is NULL. Only for an empty table of the chained backend, and not a multimap (whose items keep their
+ * values alongside their key). The pool must outlive the table. Will return 0 on success and -1 if not.
+ * */
+int hashtable_set_keypool(hashtable_t *table, struct hashtable_keypool *pool);
+
+/* hashtable_set_key_prefixes
+ *
+ * Front code the keys of this table, for long hierarchical keys (paths, URLs) sharing long prefixes. Each key is
+ * split after its last 'separator', and the part up to there is stored once per table in a dictionary of
+ * reference counted prefixes, so that an item only keeps a pointer to its prefix and a copy of the rest. Keys
+ * whose prefix would be no longer than a pointer are stored whole. Lookups still match the key exactly.
+ * With this enabled the key handed to the callback of hashtable_foreach is rebuilt for that call, and is only
+ * valid until it returns. Only for an empty table of the chained backend, not a multimap and without a key pool.
+ * Will return 0 on success and -1 if not.
+ * */
+int hashtable_set_key_prefixes(hashtable_t *table, char separator);
+
+/* hashtable_set_background_resize
+ *
+ * With 'enable' non-zero, crossing the load factor in hashtable_set starts a migrator thread which moves the items
+ * into a grown bucket array, instead of growing the table in the calling thread. Until the migrator is done every
+ * operation consults whichever of the old and new arrays currently holds its key, under a striped lock shared with
+ * the migrator, so the calling thread never migrates anything itself. The table is still not safe for concurrent
+ * use by several callers. Disabling waits for any resize in progress to finish.
+ * Only available when built with HAVE_PTHREAD. Will return 0 on success and -1 if not.
+ * */
+int hashtable_set_background_resize(hashtable_t *table, int enable);
+
+/* hashtable_resize_finish
+ *
+ * Wait for a background resize in progress to finish and switch the table over to the grown bucket array. Not
+ * needed for correctness, as operations work throughout a resize. Will return 0 on success (or if there was no
+ * resize) and -1 if not, in which case the resize remains in progress.
+ * */
+int hashtable_resize_finish(hashtable_t *table);
+
+/* hashtable_foreach
+ *
+ * Call 'fn' once for every (key, value) pair in our hashtable, in bucket order (once per key with its first value for a
+ * multimap). Iteration stops early if 'fn' returns non-zero, in which case that value is returned, otherwise 0 is
+ * returned once every item has been visited (or -1 if table is NULL). The table must not be modified from within 'fn'.
+ * Keys stay valid until the table is modified, except in a table with key prefixes (see hashtable_set_key_prefixes).
+ * */
+int hashtable_foreach(hashtable_t const *table, int (*fn)(const char *key, size_t keylen, void *value, void *ctx),
+                      void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // JSC_HASH_TABLE_H_
@@ -0,0 +1,236 @@
+/* C++17 interface to hashtable_t.
+ *
+ * jsc::hash_map<Value> owns a hashtable_t and the values stored in it. Keys are passed as std::string_view straight
+ * through to the C API, so lookups never copy the key, and values are constructed in place in nodes obtained from a
+ * std::pmr::memory_resource, by uses-allocator construction so that allocator-aware values (std::pmr::string, say)
+ * allocate from the same resource. Each node remembers its resource, which lets the table's plain C deallocator destroy
+ * values on replacement, removal, expiry and destruction alike.
+ * */
+
+#ifndef JSC_HASH_TABLE_HPP_
+#define JSC_HASH_TABLE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "hashtable.h"
+
+namespace jsc
+{
+
+template <typename Value>
+class hash_map
+{
+    struct node
+    {
+        std::pmr::memory_resource *resource;
+        union { Value value; };     // built by the resource's allocator rather than a member initialiser
+
+        template <typename... Args>
+        explicit node(std::pmr::memory_resource *r, Args &&...args) : resource(r)
+        {
+            std::pmr::polymorphic_allocator<Value>(r).construct(std::addressof(value), std::forward<Args>(args)...);
+        }
+
+        ~node() { value.~Value(); }
+    };
+
+    /* the deallocator handed to the C table, so it must not throw */
+    static void destroy_node(void *p) noexcept
+    {
+        node *n = static_cast<node *>(p);
+        std::pmr::memory_resource *resource = n->resource;
+
+        n->~node();
+        resource->deallocate(n, sizeof(node), alignof(node));
+    }
+
+    template <typename... Args>
+    node *make_node(Args &&...args)
+    {
+        void *memory = resource_->allocate(sizeof(node), alignof(node));
+        try
+        {
+            return ::new (memory) node(resource_, std::forward<Args>(args)...);
+        }
+        catch(...)
+        {
+            resource_->deallocate(memory, sizeof(node), alignof(node));
+            throw;
+        }
+    }
+
+    static Value *value_of(const void *p) noexcept
+    {
+        return p ? &static_cast<node *>(const_cast<void *>(p))->value : nullptr;
+    }
+
+    /* an empty std::string_view may have a null data(), which the C API takes as a missing key */
+    static const char *key_data(std::string_view key) noexcept
+    {
+        return key.data() ? key.data() : "";
+    }
+
+    hashtable_t *table_ = nullptr;
+    std::pmr::memory_resource *resource_;
+
+public:
+    using key_type = std::string_view;
+    using mapped_type = Value;
+    using size_type = std::size_t;
+    using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+    explicit hash_map(size_type initial_size = 64, std::uint32_t max_load_factor = 4,
+                      const allocator_type &alloc = {})
+        : table_(hashtable_create(initial_size, max_load_factor)), resource_(alloc.resource())
+    {
+        if(!table_)
+            throw std::bad_alloc();
+
+        table_->deallocator = destroy_node;
+    }
+
+    explicit hash_map(const allocator_type &alloc) : hash_map(64, 4, alloc) {}
+
+    hash_map(const hash_map &) = delete;
+    hash_map &operator=(const hash_map &) = delete;
+
+    hash_map(hash_map &&other) noexcept
+        : table_(std::exchange(other.table_, nullptr)), resource_(other.resource_) {}
+
+    hash_map &operator=(hash_map &&other) noexcept
+    {
+        if(this != &other)
+        {
+            if(table_)
+                hashtable_destroy(table_, destroy_node);
+
+            table_ = std::exchange(other.table_, nullptr);
+            resource_ = other.resource_;
+        }
+        return *this;
+    }
+
+    ~hash_map()
+    {
+        if(table_)
+            hashtable_destroy(table_, destroy_node);
+    }
+
+    allocator_type get_allocator() const noexcept { return allocator_type(resource_); }
+
+    size_type size() const noexcept { return table_ ? table_->num_items : 0; }
+    bool empty() const noexcept { return size() == 0; }
+
+    /* access to the underlying table, e.g. for hashtable_set_expiry. Its deallocator must be left alone */
+    hashtable_t *native_handle() noexcept { return table_; }
+    const hashtable_t *native_handle() const noexcept { return table_; }
+
+    Value *find(std::string_view key) noexcept
+    {
+        return value_of(hashtable_get(table_, key_data(key), key.size()));
+    }
+
+    const Value *find(std::string_view key) const noexcept
+    {
+        return value_of(hashtable_get(table_, key_data(key), key.size()));
+    }
+
+    bool contains(std::string_view key) const noexcept
+    {
+        return hashtable_exists_pair(table_, key_data(key), key.size()) == 1;
+    }
+
+    /* construct a value for 'key' from 'args' unless the key is already present, in which case nothing is
+     * constructed. Returns the value for 'key' and whether it was inserted */
+    template <typename... Args>
+    std::pair<Value *, bool> try_emplace(std::string_view key, Args &&...args)
+    {
+        int inserted;
+        void **slot = hashtable_emplace(&table_, key_data(key), key.size(), &inserted);
+
+        if(!slot)
+            throw std::bad_alloc();
+        if(!inserted)
+            return {value_of(*slot), false};
+
+        try
+        {
+            *slot = make_node(std::forward<Args>(args)...);
+        }
+        catch(...)
+        {
+            _hashtable_remove(table_, key_data(key), key.size(), nullptr);    // the slot is still NULL
+            throw;
+        }
+
+        return {value_of(*slot), true};
+    }
+
+    /* set the value for 'key', destroying any value it replaces. Returns the value and whether it was inserted */
+    template <typename V>
+    std::pair<Value *, bool> insert_or_assign(std::string_view key, V &&value)
+    {
+        node *n = make_node(std::forward<V>(value));
+        int inserted;
+        void **slot = hashtable_emplace(&table_, key_data(key), key.size(), &inserted);
+
+        if(!slot)
+        {
+            destroy_node(n);
+            throw std::bad_alloc();
+        }
+        if(!inserted)
+            destroy_node(*slot);
+        *slot = n;
+
+        return {&n->value, inserted != 0};
+    }
+
+    /* returns whether a value was removed */
+    bool erase(std::string_view key) noexcept
+    {
+        return _hashtable_remove(table_, key_data(key), key.size(), destroy_node) == 0;
+    }
+
+    /* call fn(std::string_view key, Value &value) for every item. An exception thrown by 'fn' stops the walk and
+     * is rethrown once hashtable_foreach has returned, as it must not unwind through the C frames */
+    template <typename Fn>
+    void for_each(Fn &&fn)
+    {
+        struct context
+        {
+            std::remove_reference_t<Fn> *fn;
+            std::exception_ptr error;
+        } ctx{std::addressof(fn), nullptr};
+
+        auto trampoline = [](const char *key, size_t keylen, void *value, void *p) noexcept -> int {
+            context *c = static_cast<context *>(p);
+            try
+            {
+                (*c->fn)(std::string_view(key, keylen), *value_of(value));
+            }
+            catch(...)
+            {
+                c->error = std::current_exception();
+                return 1;
+            }
+            return 0;
+        };
+
+        hashtable_foreach(table_, trampoline, &ctx);
+        if(ctx.error)
+            std::rethrow_exception(ctx.error);
+    }
+};
+
+} // namespace jsc
+
+#endif // JSC_HASH_TABLE_HPP_
@@ -0,0 +1,355 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "hashtable_internal.h"
+#include "lookup3.h"
+
+extern uint32_t hashtable_seed;
+
+#define hash_str_key(str, len) hashlittle((str), (len), (hashtable_seed))
+
+#define LINE_WAYS       6                       // entries per node, what fits in a cache line beside tags and link
+#define LINE_LANES      0x0101010101010101ULL
+#define LINE_HIGHS      0x8080808080808080ULL
+
+
+typedef struct cacheline_entry
+{
+    void *value;
+    size_t keylen;
+    uint32_t hash;      // kept so that growing never rehashes a key
+    char key[];         // null terminated, so that foreach can hand it out directly
+}cacheline_entry_t;
+
+
+/* one cache line: a chain walk reads the tags of 6 entries and touches an entry only when its tag matches. Only
+ * the last node of a chain may be partly full, and it is never empty unless it is the bucket itself */
+typedef struct cacheline_node
+{
+    _Alignas(64) uint8_t tag[LINE_WAYS];
+    uint8_t count;
+    cacheline_entry_t *entry[LINE_WAYS];
+    struct cacheline_node *overflow;
+}cacheline_node_t;
+
+
+static inline uint8_t _cacheline_tag(uint32_t hash)
+{
+    return (uint8_t)(hash >> 24);     // the bucket comes from the low bits
+}
+
+
+/* _cacheline_match
+ *
+ * Compare all the tags of a node at once (SWAR): XOR with the tag repeated in every byte zeroes the lanes that
+ * match, and the usual zero byte test sets their high bits. A lane above a true match may be flagged too, which
+ * only costs a hash compare. Returns the flags of the used lanes, lane i in bit 8 * i + 7.
+ * */
+static inline uint64_t _cacheline_match(cacheline_node_t const *node, uint8_t tag)
+{
+    uint64_t tags = 0, x;
+
+    for(int i = 0; i < LINE_WAYS; i++)
+        tags |= (uint64_t)node->tag[i] << (8 * i);
+
+    x = tags ^ (LINE_LANES * tag);
+    x = (x - LINE_LANES) & ~x & LINE_HIGHS;
+
+    return x & (((uint64_t)1 << (8 * node->count)) - 1);
+}
+
+
+static cacheline_node_t *_cacheline_alloc_nodes(size_t count)
+{
+    cacheline_node_t *nodes;
+
+#if defined(_WIN32)
+    nodes = malloc(count * sizeof(cacheline_node_t));
+#else
+    nodes = aligned_alloc(64, count * sizeof(cacheline_node_t));
+#endif
+    if(nodes)
+        memset(nodes, 0, count * sizeof(cacheline_node_t));
+
+    return nodes;
+}
+
+
+/* append to the last node of the bucket's chain, adding an overflow node if it is full */
+static int _cacheline_append(cacheline_node_t *node, cacheline_entry_t *entry)
+{
+    while(node->overflow)
+        node = node->overflow;
+
+    if(node->count == LINE_WAYS)
+    {
+        node->overflow = _cacheline_alloc_nodes(1);
+        if(!node->overflow)
+            return -1;
+
+        node = node->overflow;
+    }
+
+    node->tag[node->count] = _cacheline_tag(entry->hash);
+    node->entry[node->count] = entry;
+    node->count++;
+
+    return 0;
+}
+
+
+static void _cacheline_free_overflow(cacheline_node_t *buckets, size_t count)
+{
+    for(size_t i = 0; i < count; i++)
+    {
+        cacheline_node_t *node = buckets[i].overflow, *next;
+
+        for(; node != NULL; node = next)
+        {
+            next = node->overflow;
+            free(node);
+        }
+    }
+}
+
+
+int _cacheline_init(hashtable_t *table, size_t initial_size)
+{
+    size_t count = 2;
+
+    if(table->max_load_factor == 0)
+        table->max_load_factor = 4;
+
+    while(count < initial_size)
+        count <<= 1;
+
+    table->slots = _cacheline_alloc_nodes(count);
+    if(!table->slots)
+        return -1;
+
+    table->table_size = count;
+
+    return 0;
+}
+
+
+int _cacheline_destroy(hashtable_t *table, void (*deallocator)(void*))
+{
+    cacheline_node_t *buckets = table->slots;
+
+    for(size_t i = 0; i < table->table_size; i++)
+    {
+        for(cacheline_node_t *node = &buckets[i]; node != NULL; node = node->overflow)
+        {
+            for(int s = 0; s < node->count; s++)
+            {
+                if(deallocator)
+                    deallocator(node->entry[s]->value);
+                free(node->entry[s]);
+            }
+        }
+    }
+
+    _cacheline_free_overflow(buckets, table->table_size);
+    free(buckets);
+    table->slots = NULL;
+
+    return 0;
+}
+
+
+/* _cacheline_grow
+ *
+ * Rehash into twice the buckets from the stored hashes. On failure nothing has changed.
+ * */
+static int _cacheline_grow(hashtable_t *table)
+{
+    cacheline_node_t *old_buckets = table->slots, *buckets;
+    size_t old_size = table->table_size, size = old_size * HASHTABLE_GROWTH_FACTOR;
+
+    buckets = _cacheline_alloc_nodes(size);
+    if(!buckets)
+        return -1;
+
+    for(size_t i = 0; i < old_size; i++)
+    {
+        for(cacheline_node_t *node = &old_buckets[i]; node != NULL; node = node->overflow)
+        {
+            for(int s = 0; s < node->count; s++)
+            {
+                if(_cacheline_append(&buckets[node->entry[s]->hash & (size - 1)], node->entry[s]) != 0)
+                {
+                    _cacheline_free_overflow(buckets, size);
+                    free(buckets);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    _cacheline_free_overflow(old_buckets, old_size);
+    free(old_buckets);
+
+    table->slots = buckets;
+    table->table_size = size;
+
+    return 0;
+}
+
+
+/* _cacheline_find
+ *
+ * Return the node and lane holding 'key', whose hash is 'hash', in 'found_node' and 'found_lane', and 1, or 0 if
+ * the key is not there.
+ * */
+static int _cacheline_find(hashtable_t const *table, const char *key, size_t keylen, uint32_t hash,
+                           cacheline_node_t **found_node, int *found_lane)
+{
+    cacheline_node_t *buckets = table->slots;
+    uint8_t tag = _cacheline_tag(hash);
+
+    for(cacheline_node_t *node = &buckets[hash & (table->table_size - 1)]; node != NULL; node = node->overflow)
+    {
+        for(uint64_t match = _cacheline_match(node, tag); match != 0; match &= match - 1)
+        {
+            int lane = (int)(_lowest_set_bit(match) / 8);
+            cacheline_entry_t *entry = node->entry[lane];
+
+            if(entry->hash == hash && entry->keylen == keylen && memcmp(entry->key, key, keylen) == 0)
+            {
+                *found_node = node;
+                *found_lane = lane;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+int _cacheline_set(hashtable_t *table, const char *key, size_t keylen, void *value, uint32_t replace,
+                   void (*deallocator)(void*))
+{
+    uint32_t hash = hash_str_key(key, keylen);
+    cacheline_node_t *node;
+    cacheline_entry_t *entry;
+    int lane;
+
+    if(_cacheline_find(table, key, keylen, hash, &node, &lane))
+    {
+        if(!replace)
+            return -1;
+
+        if(deallocator)
+            deallocator(node->entry[lane]->value);
+        node->entry[lane]->value = value;
+
+        return 0;
+    }
+
+    /* chains simply get longer if growing fails */
+    if((table->num_items + 1) / table->table_size >= table->max_load_factor)
+        _cacheline_grow(table);
+
+    entry = malloc(sizeof(cacheline_entry_t) + keylen + 1);
+    if(!entry)
+        return -1;
+
+    memcpy(entry->key, key, keylen);
+    entry->key[keylen] = '\0';
+    entry->value = value;
+    entry->keylen = keylen;
+    entry->hash = hash;
+
+    if(_cacheline_append(&((cacheline_node_t *)table->slots)[entry->hash & (table->table_size - 1)], entry) != 0)
+    {
+        free(entry);
+        return -1;
+    }
+
+    table->num_items++;
+
+    return 0;
+}
+
+
+const void *_cacheline_get(hashtable_t const *table, const char *key, size_t keylen)
+{
+    cacheline_node_t *node;
+    int lane;
+
+    if(!_cacheline_find(table, key, keylen, hash_str_key(key, keylen), &node, &lane))
+        return NULL;
+
+    return node->entry[lane]->value;
+}
+
+
+int _cacheline_exists_pair(hashtable_t const *table, const char *key, size_t keylen)
+{
+    cacheline_node_t *node;
+    int lane;
+
+    return _cacheline_find(table, key, keylen, hash_str_key(key, keylen), &node, &lane);
+}
+
+
+/* _cacheline_remove
+ *
+ * The last entry of the chain fills the hole, so only the last node is ever partly full, and an overflow node
+ * left empty is freed.
+ * */
+int _cacheline_remove(hashtable_t *table, const char *key, size_t keylen, void (*deallocator)(void*))
+{
+    cacheline_node_t *node, *last, *before_last = NULL;
+    int lane;
+
+    if(!_cacheline_find(table, key, keylen, hash_str_key(key, keylen), &node, &lane))
+        return -1;
+
+    last = &((cacheline_node_t *)table->slots)[node->entry[lane]->hash & (table->table_size - 1)];
+    for(; last->overflow != NULL; last = last->overflow)
+        before_last = last;
+
+    if(deallocator)
+        deallocator(node->entry[lane]->value);
+    free(node->entry[lane]);
+
+    last->count--;
+    node->tag[lane] = last->tag[last->count];
+    node->entry[lane] = last->entry[last->count];
+
+    if(last->count == 0 && before_last != NULL)
+    {
+        before_last->overflow = NULL;
+        free(last);
+    }
+
+    table->num_items--;
+
+    return 0;
+}
+
+
+int _cacheline_foreach(hashtable_t const *table, int (*fn)(const char *key, size_t keylen, void *value, void *ctx),
+                       void *ctx)
+{
+    cacheline_node_t *buckets = table->slots;
+    int ret;
+
+    for(size_t i = 0; i < table->table_size; i++)
+    {
+        for(cacheline_node_t *node = &buckets[i]; node != NULL; node = node->overflow)
+        {
+            for(int s = 0; s < node->count; s++)
+            {
+                ret = fn(node->entry[s]->key, node->entry[s]->keylen, node->entry[s]->value, ctx);
+                if(ret != 0)
+                    return ret;
+            }
+        }
+    }
+
+    return 0;
+}
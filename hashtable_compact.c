@@ -0,0 +1,417 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "hashtable.h"
+#include "hashtable_compact.h"
+#include "lookup3.h"
+
+extern uint32_t hashtable_seed;
+
+#define hash_str_key(str, len) hashlittle((str), (len), (hashtable_seed))
+
+#define COMPACT_NIL         UINT32_MAX
+#define COMPACT_GRANULE     sizeof(uint64_t)
+#define COMPACT_MAX_GRANULES ((size_t)UINT32_MAX)     // a key must start at an offset which fits 32 bits
+
+typedef hashtable_compact_entry_t entry_t;
+
+
+static inline size_t _compact_granules(size_t keylen)
+{
+    return (keylen + 1 + COMPACT_GRANULE - 1) / COMPACT_GRANULE;
+}
+
+
+static inline const char *_compact_key(hashtable_compact_t const *table, entry_t const *entry)
+{
+    return (const char *)(table->keys + entry->key);
+}
+
+
+static inline void *_compact_value(hashtable_compact_t const *table, uint32_t index)
+{
+    if(table->flags & HASHTABLE_COMPACT_HANDLES)
+        return hashtable_compact_handle(table->handles[index]);
+
+    return table->values[index];
+}
+
+
+static inline void _compact_set_value(hashtable_compact_t *table, uint32_t index, void *value)
+{
+    if(table->flags & HASHTABLE_COMPACT_HANDLES)
+        table->handles[index] = hashtable_compact_handle_of(value);
+    else
+        table->values[index] = value;
+}
+
+
+static int _compact_init_buckets(hashtable_compact_t *table, size_t size)
+{
+    size_t count = 2;
+
+    while(count < size)
+        count <<= 1;
+
+    /* every byte 0xff makes every bucket COMPACT_NIL */
+    table->buckets = malloc(count * sizeof(uint32_t));
+    if(!table->buckets)
+        return -1;
+
+    memset(table->buckets, 0xff, count * sizeof(uint32_t));
+    table->table_size = count;
+
+    return 0;
+}
+
+
+hashtable_compact_t *hashtable_compact_create(size_t initial_size, uint32_t max_load_factor, hashtable_flag flags)
+{
+    hashtable_compact_t *table = calloc(1, sizeof(hashtable_compact_t));
+    if(!table)
+        return NULL;
+
+    table->max_load_factor = max_load_factor ? max_load_factor : 1;
+    table->flags = flags;
+    table->free_entry = COMPACT_NIL;
+
+    if(_compact_init_buckets(table, initial_size) != 0)
+    {
+        free(table);
+        return NULL;
+    }
+
+    return table;
+}
+
+
+int hashtable_compact_destroy(hashtable_compact_t *table, void (*deallocator)(void*))
+{
+    if(!table)
+        return -1;
+
+    for(size_t i = 0; deallocator && !(table->flags & HASHTABLE_COMPACT_HANDLES) && i < table->table_size; i++)
+    {
+        for(uint32_t index = table->buckets[i]; index != COMPACT_NIL; index = table->entries[index].next)
+            deallocator(table->values[index]);
+    }
+
+    free(table->buckets);
+    free(table->entries);
+    free(table->values);
+    free(table->handles);
+    free(table->keys);
+    free(table);
+
+    return 0;
+}
+
+
+/* _compact_grow
+ *
+ * Double the bucket array, relinking the entries from their stored hashes. On failure the table is left as it was.
+ * */
+static int _compact_grow(hashtable_compact_t *table)
+{
+    uint32_t *old_buckets = table->buckets;
+    size_t old_size = table->table_size;
+
+    if(_compact_init_buckets(table, old_size * HASHTABLE_GROWTH_FACTOR) != 0)
+    {
+        table->buckets = old_buckets;
+        return -1;
+    }
+
+    for(size_t i = 0; i < old_size; i++)
+    {
+        uint32_t index, next;
+
+        for(index = old_buckets[i]; index != COMPACT_NIL; index = next)
+        {
+            size_t bucket = table->entries[index].hash & (table->table_size - 1);
+
+            next = table->entries[index].next;
+            table->entries[index].next = table->buckets[bucket];
+            table->buckets[bucket] = index;
+        }
+    }
+
+    free(old_buckets);
+
+    return 0;
+}
+
+
+/* _compact_new_entry
+ *
+ * Index of an unused entry, from the free list if possible, otherwise by growing the slab (and the value array
+ * beside it). Returns COMPACT_NIL if out of memory or out of indices.
+ * */
+static uint32_t _compact_new_entry(hashtable_compact_t *table)
+{
+    uint32_t index = table->free_entry;
+
+    if(index != COMPACT_NIL)
+    {
+        table->free_entry = table->entries[index].next;
+        return index;
+    }
+
+    if(table->entries_used == table->entries_capacity)
+    {
+        uint64_t capacity = table->entries_capacity ? (uint64_t)table->entries_capacity * 2 : 16;
+        entry_t *entries;
+
+        if(capacity > COMPACT_NIL)
+            capacity = COMPACT_NIL;     // COMPACT_NIL itself is never an index
+        if(capacity == table->entries_capacity)
+            return COMPACT_NIL;
+
+        entries = realloc(table->entries, capacity * sizeof(entry_t));
+        if(!entries)
+            return COMPACT_NIL;
+        table->entries = entries;
+
+        if(table->flags & HASHTABLE_COMPACT_HANDLES)
+        {
+            uint32_t *handles = realloc(table->handles, capacity * sizeof(uint32_t));
+            if(!handles)
+                return COMPACT_NIL;
+            table->handles = handles;
+        }
+        else
+        {
+            void **values = realloc(table->values, capacity * sizeof(void*));
+            if(!values)
+                return COMPACT_NIL;
+            table->values = values;
+        }
+
+        table->entries_capacity = (uint32_t)capacity;
+    }
+
+    return table->entries_used++;
+}
+
+
+/* _compact_heap
+ *
+ * Copy the live keys into a fresh heap of 'capacity' granules, dropping the garbage left by removals.
+ * */
+static int _compact_heap(hashtable_compact_t *table, size_t capacity)
+{
+    uint64_t *keys = malloc(capacity * COMPACT_GRANULE);
+    size_t used = 0;
+
+    if(!keys)
+        return -1;
+
+    for(size_t i = 0; i < table->table_size; i++)
+    {
+        for(uint32_t index = table->buckets[i]; index != COMPACT_NIL; index = table->entries[index].next)
+        {
+            entry_t *entry = &table->entries[index];
+            size_t granules = _compact_granules(entry->keylen);
+
+            memcpy(keys + used, table->keys + entry->key, granules * COMPACT_GRANULE);
+            entry->key = (uint32_t)used;
+            used += granules;
+        }
+    }
+
+    free(table->keys);
+    table->keys = keys;
+    table->keys_used = used;
+    table->keys_capacity = capacity;
+    table->keys_garbage = 0;
+
+    return 0;
+}
+
+
+/* _compact_reserve_keys
+ *
+ * Make room for 'granules' more in the key heap. When it is full it is rebuilt without its garbage, at twice the
+ * size of the live keys, so that rebuilding costs amortised constant time per key. Returns the offset of the
+ * room, or -1 if there is none.
+ * */
+static int64_t _compact_reserve_keys(hashtable_compact_t *table, size_t granules)
+{
+    size_t offset;
+
+    if(table->keys_used + granules > table->keys_capacity)
+    {
+        size_t live = table->keys_used - table->keys_garbage;
+        size_t capacity = table->keys_capacity ? table->keys_capacity : 64;
+
+        while(capacity < (live + granules) * 2 && capacity < COMPACT_MAX_GRANULES)
+            capacity *= 2;
+
+        if(capacity > COMPACT_MAX_GRANULES)
+            capacity = COMPACT_MAX_GRANULES;
+
+        if(live + granules > capacity || _compact_heap(table, capacity) != 0)
+            return -1;
+    }
+
+    offset = table->keys_used;
+    table->keys_used += granules;
+
+    return (int64_t)offset;
+}
+
+
+static uint32_t _compact_find(hashtable_compact_t const *table, const char *key, size_t keylen, uint32_t hash)
+{
+    for(uint32_t index = table->buckets[hash & (table->table_size - 1)]; index != COMPACT_NIL;
+        index = table->entries[index].next)
+    {
+        entry_t const *entry = &table->entries[index];
+
+        if(entry->hash == hash && entry->keylen == keylen && memcmp(_compact_key(table, entry), key, keylen) == 0)
+            return index;
+    }
+
+    return COMPACT_NIL;
+}
+
+
+int hashtable_compact_set(hashtable_compact_t *table, const char *key, size_t keylen, void *value,
+                          uint32_t replace, void (*deallocator)(void*))
+{
+    uint32_t hash, index;
+    size_t bucket;
+    int64_t offset;
+
+    if(!table || keylen >= UINT32_MAX)
+        return -1;
+
+    hash = hash_str_key(key, keylen);
+    index = _compact_find(table, key, keylen, hash);
+    if(index != COMPACT_NIL)
+    {
+        if(!replace)
+            return -1;
+
+        if(deallocator != NULL && !(table->flags & HASHTABLE_COMPACT_HANDLES))
+            deallocator(table->values[index]);
+
+        _compact_set_value(table, index, value);
+        return 0;
+    }
+
+    index = _compact_new_entry(table);
+    if(index == COMPACT_NIL)
+        return -1;
+
+    offset = _compact_reserve_keys(table, _compact_granules(keylen));
+    if(offset < 0)
+    {
+        table->entries[index].next = table->free_entry;
+        table->free_entry = index;
+        return -1;
+    }
+
+    memcpy(table->keys + offset, key, keylen);
+    ((char *)(table->keys + offset))[keylen] = '\0';
+
+    bucket = hash & (table->table_size - 1);
+    table->entries[index].hash = hash;
+    table->entries[index].keylen = (uint32_t)keylen;
+    table->entries[index].key = (uint32_t)offset;
+    table->entries[index].next = table->buckets[bucket];
+    table->buckets[bucket] = index;
+    _compact_set_value(table, index, value);
+    table->num_items++;
+
+    /* the entry is in already, and _compact_grow keeps the old bucket array if it cannot allocate a new one */
+    if(table->num_items / table->table_size >= table->max_load_factor)
+        _compact_grow(table);
+
+    return 0;
+}
+
+
+const void *hashtable_compact_get(hashtable_compact_t const *table, const char *key, size_t keylen)
+{
+    uint32_t index;
+
+    if(!table)
+        return NULL;
+
+    index = _compact_find(table, key, keylen, hash_str_key(key, keylen));
+    if(index == COMPACT_NIL)
+        return NULL;
+
+    return _compact_value(table, index);
+}
+
+
+int hashtable_compact_exists_pair(hashtable_compact_t const *table, const char *key, size_t keylen)
+{
+    if(!table)
+        return 0;
+
+    return _compact_find(table, key, keylen, hash_str_key(key, keylen)) != COMPACT_NIL;
+}
+
+
+int _hashtable_compact_remove(hashtable_compact_t *table, const char *key, size_t keylen,
+                              void (*deallocator)(void*))
+{
+    uint32_t hash, *link;
+
+    if(!table || !table->num_items)
+        return -1;
+
+    hash = hash_str_key(key, keylen);
+
+    /* walk the links themselves, so that removing the head needs no special case */
+    for(link = &table->buckets[hash & (table->table_size - 1)]; *link != COMPACT_NIL;
+        link = &table->entries[*link].next)
+    {
+        uint32_t index = *link;
+        entry_t *entry = &table->entries[index];
+
+        if(entry->hash != hash || entry->keylen != keylen || memcmp(_compact_key(table, entry), key, keylen) != 0)
+            continue;
+
+        *link = entry->next;
+
+        if(deallocator != NULL && !(table->flags & HASHTABLE_COMPACT_HANDLES))
+            deallocator(table->values[index]);
+
+        table->keys_garbage += _compact_granules(entry->keylen);
+        entry->next = table->free_entry;
+        table->free_entry = index;
+        table->num_items--;
+
+        return 0;
+    }
+
+    return -1;
+}
+
+
+int hashtable_compact_foreach(hashtable_compact_t const *table,
+                              int (*fn)(const char *key, size_t keylen, void *value, void *ctx), void *ctx)
+{
+    int ret;
+
+    if(!table)
+        return -1;
+
+    for(size_t i = 0; i < table->table_size; i++)
+    {
+        for(uint32_t index = table->buckets[i]; index != COMPACT_NIL; index = table->entries[index].next)
+        {
+            entry_t const *entry = &table->entries[index];
+
+            ret = fn(_compact_key(table, entry), entry->keylen, _compact_value(table, index), ctx);
+            if(ret != 0)
+                return ret;
+        }
+    }
+
+    return 0;
+}
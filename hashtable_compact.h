@@ -0,0 +1,135 @@
+/* Compact hashtables.
+ *
+ * A variant of hashtable_t for very large tables, where the per item overhead matters more than anything else.
+ * A hash_item_t costs 40 bytes on a 64-bit host before its key (80 in a bounded or expiring table), plus the
+ * allocator's own header for both the item and its key copy. Here every entry lives in one slab array and is 16 bytes:
+ * a 32-bit index linking it to the next entry of its chain, its hash, its key length and the offset of its key. Keys
+ * are packed into a single key heap in 8 byte granules, so a 32-bit offset reaches 32GiB of keys. Buckets are 32-bit
+ * entry indices too.
+ *
+ * Values are pointers, held in an array beside the slab, unless the table is created with
+ * HASHTABLE_COMPACT_HANDLES. Then every value is a 32-bit handle (an index into the caller's own storage, say),
+ * passed in and out through hashtable_compact_handle and hashtable_compact_handle_of, and stored in 4 bytes.
+ *
+ * Removed entries are reused by later insertions, and the keys they leave behind are dropped whenever the key
+ * heap next has to grow, as it is then rebuilt from the live keys alone. A table holds at most 2^32 - 1 entries.
+ * */
+
+#ifndef JSC_HASH_TABLE_COMPACT_H_
+#define JSC_HASH_TABLE_COMPACT_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "hashtable.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HASHTABLE_COMPACT_HANDLES 0x1     // values are 32-bit handles rather than pointers
+
+#define hashtable_compact_handle(handle) ((void *)(uintptr_t)(uint32_t)(handle))
+#define hashtable_compact_handle_of(value) ((uint32_t)(uintptr_t)(value))
+
+typedef struct hashtable_compact_entry
+{
+    uint32_t next;        // index of the next entry in the chain (or the free list), UINT32_MAX ends it
+    uint32_t hash;
+    uint32_t keylen;
+    uint32_t key;         // offset of the key in the key heap, in granules
+}hashtable_compact_entry_t;
+
+
+typedef struct hashtable_compact
+{
+    size_t table_size;            // always a power of two
+    size_t num_items;
+
+    uint32_t max_load_factor;
+    hashtable_flag flags;
+
+    uint32_t *buckets;            // index of the first entry of each chain, UINT32_MAX if empty
+
+    hashtable_compact_entry_t *entries;
+    uint32_t entries_used;        // entries handed out so far, live or on the free list
+    uint32_t entries_capacity;
+    uint32_t free_entry;          // head of the list of removed entries
+
+    void **values;                // value of each entry, or NULL with HASHTABLE_COMPACT_HANDLES
+    uint32_t *handles;            // handle of each entry, or NULL without it
+
+    uint64_t *keys;               // null terminated keys, each starting on a granule
+    size_t keys_used;             // in granules
+    size_t keys_capacity;
+    size_t keys_garbage;          // granules of removed keys, reclaimed by compacting the heap
+}hashtable_compact_t;
+
+
+/* hashtable_compact_create
+ *
+ * Create a table with at least 'initial_size' buckets (rounded up to a power of two), a maximum load factor of
+ * 'max_load_factor' (1 if 0), and 'flags' of 0 or HASHTABLE_COMPACT_HANDLES. Returns NULL if this process fails.
+ * */
+hashtable_compact_t *hashtable_compact_create(size_t initial_size, uint32_t max_load_factor, hashtable_flag flags);
+
+/* hashtable_compact_destroy
+ *
+ * Destroy the table, passing every value to 'deallocator' if it is not NULL (it is never called for handles).
+ * */
+int hashtable_compact_destroy(hashtable_compact_t *table, void (*deallocator)(void*));
+
+/* hashtable_compact_set
+ *
+ * Set 'key' to 'value', with the same 'replace' and 'deallocator' semantics as hashtable_set. With
+ * HASHTABLE_COMPACT_HANDLES, 'value' is hashtable_compact_handle(handle). Returns 0 if the value was set, and -1
+ * if not (including when 'key' exists and 'replace' is 0, or the key is 2^32 bytes or longer).
+ * */
+int hashtable_compact_set(hashtable_compact_t *table, const char *key, size_t keylen, void *value,
+                          uint32_t replace, void (*deallocator)(void*));
+
+#define hashtable_compact_set_no_replace(table, key, keylen, value)  \
+    hashtable_compact_set((table), (key), (keylen), (value), 0, NULL)
+
+#define hashtable_compact_set_replace(table, key, keylen, value)    \
+    hashtable_compact_set((table), (key), (keylen), (value), 1, NULL)
+
+/* hashtable_compact_get
+ *
+ * Retrieve the value mapped by 'key' if such a value exists. Return NULL if not. With HASHTABLE_COMPACT_HANDLES
+ * use hashtable_compact_handle_of on the result, and hashtable_compact_exists_pair if handle 0 is in use.
+ * */
+const void *hashtable_compact_get(hashtable_compact_t const *table, const char *key, size_t keylen);
+
+/* hashtable_compact_exists_pair
+ *
+ * Check if 'key' is mapped to a value in our table. If so return 1, if not return 0.
+ * */
+int hashtable_compact_exists_pair(hashtable_compact_t const *table, const char *key, size_t keylen);
+
+/* _hashtable_compact_remove
+ *
+ * Remove the entry mapped by 'key', passing its value to 'deallocator' if that is not NULL.
+ * Will return 0 on successful removal and -1 if not.
+ * */
+int _hashtable_compact_remove(hashtable_compact_t *table, const char *key, size_t keylen,
+                              void (*deallocator)(void*));
+
+#define hashtable_compact_remove(table, key, keylen)    \
+    _hashtable_compact_remove((table), (key), (keylen), NULL)
+
+#define hashtable_compact_remove_and_destroy(table, key, keylen, deallocator)    \
+    _hashtable_compact_remove((table), (key), (keylen), (deallocator))
+
+/* hashtable_compact_foreach
+ *
+ * Call 'fn' on every pair as hashtable_foreach does. The key pointers handed out are only valid until the table is
+ * next modified.
+ * */
+int hashtable_compact_foreach(hashtable_compact_t const *table,
+                              int (*fn)(const char *key, size_t keylen, void *value, void *ctx), void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSC_HASH_TABLE_COMPACT_H_
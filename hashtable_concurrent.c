@@ -0,0 +1,492 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "hashtable_concurrent.h"
+#include "lookup3.h"
+
+extern uint32_t hashtable_seed;
+
+#define hash_str_key(str, len) hashlittle((str), (len), (hashtable_seed))
+
+#define WAYS            4
+#define KEY_WORDS       (MAX_KEY_LEN / 8)
+#define BFS_NODES       256     // buckets a displacement search may visit
+#define BFS_DEPTH       4       // and the longest chain of moves it may produce
+#define MAX_ATTEMPTS    16      // insertions racing with other writers retry this many times before giving up
+
+#define load_relaxed(obj) atomic_load_explicit((obj), memory_order_relaxed)
+#define store_relaxed(obj, val) atomic_store_explicit((obj), (val), memory_order_relaxed)
+
+
+/* every field is atomic so that optimistic readers are well defined, relaxed accesses cost nothing extra */
+typedef struct hashtable_concurrent_bucket
+{
+    _Atomic uint32_t version;                 // odd while a writer holds the bucket
+    _Atomic uint32_t hash[WAYS];
+    _Atomic uint32_t keylen[WAYS];            // 0 for an empty slot, otherwise length + 1
+    _Atomic(void *) value[WAYS];
+    _Atomic uint64_t key[WAYS][KEY_WORDS];    // zero padded
+}hashtable_concurrent_bucket_t;
+
+
+struct hashtable_concurrent
+{
+    size_t num_buckets;                   // always a power of two
+    _Atomic size_t num_items;
+
+    hashtable_concurrent_bucket_t *buckets;
+};
+
+
+/* a key zero padded to whole words, so that comparisons are word by word */
+typedef struct concurrent_key
+{
+    uint64_t words[KEY_WORDS];
+    uint32_t keylen;
+    uint32_t hash;
+}concurrent_key_t;
+
+
+typedef struct concurrent_bfs_node
+{
+    size_t bucket;
+    int parent;
+    int slot;
+    int depth;
+}concurrent_bfs_node_t;
+
+
+static inline void _concurrent_key_init(concurrent_key_t *k, const char *key, size_t keylen)
+{
+    memset(k->words, 0, sizeof(k->words));
+    memcpy(k->words, key, keylen);
+    k->keylen = (uint32_t)keylen;
+    k->hash = hash_str_key(key, keylen);
+}
+
+
+/* as _cuckoo_alt, the other bucket follows from the stored hash so entries move without rehashing */
+static inline size_t _concurrent_alt(hashtable_concurrent_t const *table, size_t index, uint32_t hash)
+{
+    uint64_t offset = (((uint64_t)hash * 0x9e3779b97f4a7c15ULL) >> 32) | 1;
+
+    return (index ^ (size_t)offset) & (table->num_buckets - 1);
+}
+
+
+/* _bucket_lock / _bucket_unlock
+ *
+ * Writers make the version odd for as long as they hold a bucket. The release fence orders the odd version
+ * before any of the writes that follow, so a reader which sees one of those writes also sees the version change.
+ * */
+static void _bucket_lock(hashtable_concurrent_bucket_t *bucket)
+{
+    uint32_t version;
+
+    for(;;)
+    {
+        version = load_relaxed(&bucket->version);
+        if(!(version & 1) && atomic_compare_exchange_weak_explicit(&bucket->version, &version, version + 1,
+                                                                   memory_order_acquire, memory_order_relaxed))
+            break;
+    }
+
+    atomic_thread_fence(memory_order_release);
+}
+
+
+static inline void _bucket_unlock(hashtable_concurrent_bucket_t *bucket)
+{
+    atomic_fetch_add_explicit(&bucket->version, 1, memory_order_release);
+}
+
+
+/* lock two buckets in address order, so that writers can never deadlock */
+static void _bucket_lock_pair(hashtable_concurrent_bucket_t *a, hashtable_concurrent_bucket_t *b)
+{
+    if(a > b)
+    {
+        hashtable_concurrent_bucket_t *temp = a;
+        a = b;
+        b = temp;
+    }
+
+    _bucket_lock(a);
+    if(b != a)
+        _bucket_lock(b);
+}
+
+
+static void _bucket_unlock_pair(hashtable_concurrent_bucket_t *a, hashtable_concurrent_bucket_t *b)
+{
+    _bucket_unlock(a);
+    if(b != a)
+        _bucket_unlock(b);
+}
+
+
+static inline int _slot_matches(hashtable_concurrent_bucket_t *bucket, int slot, concurrent_key_t const *k)
+{
+    if(load_relaxed(&bucket->hash[slot]) != k->hash || load_relaxed(&bucket->keylen[slot]) != k->keylen + 1)
+        return 0;
+
+    for(uint32_t w = 0; w * 8 < k->keylen; w++)
+        if(load_relaxed(&bucket->key[slot][w]) != k->words[w])
+            return 0;
+
+    return 1;
+}
+
+
+static int _bucket_find(hashtable_concurrent_bucket_t *bucket, concurrent_key_t const *k)
+{
+    for(int s = 0; s < WAYS; s++)
+        if(_slot_matches(bucket, s, k))
+            return s;
+
+    return -1;
+}
+
+
+static int _bucket_free_slot(hashtable_concurrent_bucket_t *bucket)
+{
+    for(int s = 0; s < WAYS; s++)
+        if(load_relaxed(&bucket->keylen[s]) == 0)
+            return s;
+
+    return -1;
+}
+
+
+static void _slot_write(hashtable_concurrent_bucket_t *bucket, int slot, concurrent_key_t const *k, void *value)
+{
+    for(int w = 0; w < KEY_WORDS; w++)
+        store_relaxed(&bucket->key[slot][w], k->words[w]);
+    store_relaxed(&bucket->hash[slot], k->hash);
+    store_relaxed(&bucket->value[slot], value);
+    store_relaxed(&bucket->keylen[slot], k->keylen + 1);
+}
+
+
+/* move a slot's contents between buckets, both of which the caller holds */
+static void _slot_move(hashtable_concurrent_bucket_t *to, int to_slot, hashtable_concurrent_bucket_t *from,
+                       int from_slot)
+{
+    for(int w = 0; w < KEY_WORDS; w++)
+        store_relaxed(&to->key[to_slot][w], load_relaxed(&from->key[from_slot][w]));
+    store_relaxed(&to->hash[to_slot], load_relaxed(&from->hash[from_slot]));
+    store_relaxed(&to->value[to_slot], load_relaxed(&from->value[from_slot]));
+    store_relaxed(&to->keylen[to_slot], load_relaxed(&from->keylen[from_slot]));
+
+    store_relaxed(&from->keylen[from_slot], 0);
+}
+
+
+hashtable_concurrent_t *hashtable_concurrent_create(size_t max_items)
+{
+    hashtable_concurrent_t *table = malloc(sizeof(hashtable_concurrent_t));
+    size_t slots = max_items * 100 / HASHTABLE_CONCURRENT_MAX_LOAD + 1;
+
+    if(!table)
+        return NULL;
+
+    table->num_buckets = 2;
+    while(table->num_buckets * WAYS < slots)
+        table->num_buckets <<= 1;
+
+    atomic_init(&table->num_items, 0);
+
+    /* all zero is an unlocked bucket of empty slots */
+    table->buckets = calloc(table->num_buckets, sizeof(hashtable_concurrent_bucket_t));
+    if(!table->buckets)
+    {
+        free(table);
+        return NULL;
+    }
+
+    return table;
+}
+
+
+int hashtable_concurrent_destroy(hashtable_concurrent_t *table, void (*deallocator)(void*))
+{
+    if(!table)
+        return -1;
+
+    for(size_t i = 0; deallocator && i < table->num_buckets; i++)
+    {
+        for(int s = 0; s < WAYS; s++)
+            if(load_relaxed(&table->buckets[i].keylen[s]) != 0)
+                deallocator(load_relaxed(&table->buckets[i].value[s]));
+    }
+
+    free(table->buckets);
+    free(table);
+
+    return 0;
+}
+
+
+/* _concurrent_lookup
+ *
+ * Optimistic read of both of the key's buckets: note their versions, search, and retry if a writer held or
+ * changed either one meanwhile. A displacement moves an entry between these same two buckets under both of their
+ * locks, so a key can never be missed while in flight. Returns 1 if found, setting 'value', and 0 if not.
+ * */
+static int _concurrent_lookup(hashtable_concurrent_t *table, concurrent_key_t const *k, void **value)
+{
+    size_t first = k->hash & (table->num_buckets - 1);
+    hashtable_concurrent_bucket_t *a = &table->buckets[first];
+    hashtable_concurrent_bucket_t *b = &table->buckets[_concurrent_alt(table, first, k->hash)];
+
+    for(;;)
+    {
+        uint32_t version_a = atomic_load_explicit(&a->version, memory_order_acquire);
+        uint32_t version_b = atomic_load_explicit(&b->version, memory_order_acquire);
+        void *found = NULL;
+        int slot, ret = 0;
+
+        if((version_a | version_b) & 1)
+            continue;      // a writer is in one of them
+
+        if((slot = _bucket_find(a, k)) >= 0)
+        {
+            found = load_relaxed(&a->value[slot]);
+            ret = 1;
+        }
+        else if((slot = _bucket_find(b, k)) >= 0)
+        {
+            found = load_relaxed(&b->value[slot]);
+            ret = 1;
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if(load_relaxed(&a->version) == version_a && load_relaxed(&b->version) == version_b)
+        {
+            if(value)
+                *value = found;
+            return ret;
+        }
+    }
+}
+
+
+/* _concurrent_make_room
+ *
+ * Free a slot in one of the two buckets 'first' and 'second' by moving entries along a chain of their alternate
+ * buckets. The chain is found breadth first without locks, then carried out from its free end backwards, one
+ * move at a time under the locks of the two buckets involved. Each move first checks that what the search saw
+ * still holds, so a concurrent writer can only make us retry.
+ * Returns 0 if a slot was freed (which another writer may still take), 1 if the chain went stale, and -1 if the
+ * table has no chain short enough, i.e. is full.
+ * */
+static int _concurrent_make_room(hashtable_concurrent_t *table, size_t first, size_t second)
+{
+    concurrent_bfs_node_t nodes[BFS_NODES];
+    int head = 0, tail = 0;
+
+    nodes[tail++] = (concurrent_bfs_node_t){first, -1, 0, 0};
+    nodes[tail++] = (concurrent_bfs_node_t){second, -1, 0, 0};
+
+    while(head < tail)
+    {
+        int node = head++;
+        hashtable_concurrent_bucket_t *bucket = &table->buckets[nodes[node].bucket];
+        int free_slot = _bucket_free_slot(bucket);
+
+        if(free_slot >= 0)
+        {
+            while(nodes[node].parent >= 0)
+            {
+                concurrent_bfs_node_t *parent = &nodes[nodes[node].parent];
+                hashtable_concurrent_bucket_t *from = &table->buckets[parent->bucket];
+                int slot = nodes[node].slot;
+                int valid;
+
+                _bucket_lock_pair(from, bucket);
+
+                valid = load_relaxed(&bucket->keylen[free_slot]) == 0 && load_relaxed(&from->keylen[slot]) != 0
+                        && _concurrent_alt(table, parent->bucket, load_relaxed(&from->hash[slot]))
+                           == nodes[node].bucket;
+                if(valid)
+                    _slot_move(bucket, free_slot, from, slot);
+
+                _bucket_unlock_pair(from, bucket);
+
+                if(!valid)
+                    return 1;
+
+                free_slot = slot;
+                bucket = from;
+                node = nodes[node].parent;
+            }
+
+            return 0;
+        }
+
+        if(nodes[node].depth == BFS_DEPTH)
+            continue;
+
+        for(int s = 0; s < WAYS && tail < BFS_NODES; s++)
+        {
+            size_t next = _concurrent_alt(table, nodes[node].bucket, load_relaxed(&bucket->hash[s]));
+            int on_path = 0;
+
+            for(int n = node; n >= 0 && !on_path; n = nodes[n].parent)
+                on_path = nodes[n].bucket == next;
+
+            if(!on_path)
+                nodes[tail++] = (concurrent_bfs_node_t){next, node, s, nodes[node].depth + 1};
+        }
+    }
+
+    return -1;
+}
+
+
+int hashtable_concurrent_set(hashtable_concurrent_t *table, const char *key, size_t keylen, void *value,
+                             uint32_t replace, void **old_value)
+{
+    concurrent_key_t k;
+    size_t first, second;
+    hashtable_concurrent_bucket_t *a, *b;
+
+    if(!table || !key || keylen > MAX_KEY_LEN)
+        return -1;
+
+    _concurrent_key_init(&k, key, keylen);
+    first = k.hash & (table->num_buckets - 1);
+    second = _concurrent_alt(table, first, k.hash);
+    a = &table->buckets[first];
+    b = &table->buckets[second];
+
+    for(int attempt = 0; attempt < MAX_ATTEMPTS; attempt++)
+    {
+        hashtable_concurrent_bucket_t *target = NULL;
+        int slot;
+
+        _bucket_lock_pair(a, b);
+
+        /* holding both buckets of the key, nobody else can insert, move or remove it */
+        if((slot = _bucket_find(a, &k)) >= 0)
+            target = a;
+        else if((slot = _bucket_find(b, &k)) >= 0)
+            target = b;
+
+        if(target)
+        {
+            int ret = -1;
+
+            if(replace)
+            {
+                if(old_value)
+                    *old_value = load_relaxed(&target->value[slot]);
+                store_relaxed(&target->value[slot], value);
+                ret = 0;
+            }
+
+            _bucket_unlock_pair(a, b);
+            return ret;
+        }
+
+        if((slot = _bucket_free_slot(a)) >= 0)
+            target = a;
+        else if((slot = _bucket_free_slot(b)) >= 0)
+            target = b;
+
+        if(target)
+        {
+            _slot_write(target, slot, &k, value);
+            _bucket_unlock_pair(a, b);
+
+            atomic_fetch_add_explicit(&table->num_items, 1, memory_order_relaxed);
+            return 0;
+        }
+
+        _bucket_unlock_pair(a, b);
+
+        if(_concurrent_make_room(table, first, second) < 0)
+            return -1;     // full
+    }
+
+    return -1;
+}
+
+
+void *hashtable_concurrent_get(hashtable_concurrent_t *table, const char *key, size_t keylen)
+{
+    concurrent_key_t k;
+    void *value;
+
+    if(!table || !key || keylen > MAX_KEY_LEN)
+        return NULL;
+
+    _concurrent_key_init(&k, key, keylen);
+    if(!_concurrent_lookup(table, &k, &value))
+        return NULL;
+
+    return value;
+}
+
+
+int hashtable_concurrent_exists_pair(hashtable_concurrent_t *table, const char *key, size_t keylen)
+{
+    concurrent_key_t k;
+
+    if(!table || !key || keylen > MAX_KEY_LEN)
+        return 0;
+
+    _concurrent_key_init(&k, key, keylen);
+
+    return _concurrent_lookup(table, &k, NULL);
+}
+
+
+size_t hashtable_concurrent_size(hashtable_concurrent_t *table)
+{
+    if(!table)
+        return 0;
+
+    return load_relaxed(&table->num_items);
+}
+
+
+int hashtable_concurrent_remove(hashtable_concurrent_t *table, const char *key, size_t keylen, void **value)
+{
+    concurrent_key_t k;
+    size_t first;
+    hashtable_concurrent_bucket_t *a, *b, *bucket = NULL;
+    int slot;
+
+    if(!table || !key || keylen > MAX_KEY_LEN)
+        return -1;
+
+    _concurrent_key_init(&k, key, keylen);
+    first = k.hash & (table->num_buckets - 1);
+    a = &table->buckets[first];
+    b = &table->buckets[_concurrent_alt(table, first, k.hash)];
+
+    _bucket_lock_pair(a, b);
+
+    if((slot = _bucket_find(a, &k)) >= 0)
+        bucket = a;
+    else if((slot = _bucket_find(b, &k)) >= 0)
+        bucket = b;
+
+    if(bucket)
+    {
+        if(value)
+            *value = load_relaxed(&bucket->value[slot]);
+        store_relaxed(&bucket->keylen[slot], 0);
+    }
+
+    _bucket_unlock_pair(a, b);
+
+    if(!bucket)
+        return -1;
+
+    atomic_fetch_sub_explicit(&table->num_items, 1, memory_order_relaxed);
+
+    return 0;
+}
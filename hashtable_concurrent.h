@@ -0,0 +1,83 @@
+/* Concurrent cuckoo hashtables.
+ *
+ * A fixed capacity table for shared lookup tables which many threads read at once (in the style of MemC3 and
+ * libcuckoo). Every key lives in one of two buckets of 4 slots, and each bucket carries a version counter which
+ * is odd while a writer holds it.
+ *
+ * Readers take no locks at all: they note the versions of the key's two buckets, search them, and retry if either
+ * version changed meanwhile. Writers lock only the two buckets of their key, and a displacement path is found
+ * without locks and then carried out one move at a time, each move locking just the two buckets it touches.
+ *
+ * Keys are stored inline and may be at most MAX_KEY_LEN bytes long. Values are not owned by the table: a value
+ * which is replaced or removed may still be in the hands of a concurrent reader, so the old value is handed back
+ * to the writer to reclaim once no reader can be using it.
+ * */
+
+#ifndef JSC_HASH_TABLE_CONCURRENT_H_
+#define JSC_HASH_TABLE_CONCURRENT_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "hashtable.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HASHTABLE_CONCURRENT_MAX_LOAD 90      // percentage of the slots the capacity is sized for
+
+typedef struct hashtable_concurrent hashtable_concurrent_t;
+
+
+/* hashtable_concurrent_create
+ *
+ * Create a table with room for at least 'max_items' keys. Returns NULL if this process fails.
+ * */
+hashtable_concurrent_t *hashtable_concurrent_create(size_t max_items);
+
+/* hashtable_concurrent_destroy
+ *
+ * Destroy the table, passing every value to 'deallocator' if it is not NULL. No other thread may be using it.
+ * */
+int hashtable_concurrent_destroy(hashtable_concurrent_t *table, void (*deallocator)(void*));
+
+/* hashtable_concurrent_set
+ *
+ * Set 'key' to 'value', replacing an existing value only if 'replace' is non-zero, in which case the value
+ * replaced is stored in 'old_value' (if not NULL) for the caller to reclaim. Safe to call from any number of
+ * threads. Returns 0 if the value was set, and -1 if not (the key exists and 'replace' is 0, the key is longer
+ * than MAX_KEY_LEN or the table is full).
+ * */
+int hashtable_concurrent_set(hashtable_concurrent_t *table, const char *key, size_t keylen, void *value,
+                             uint32_t replace, void **old_value);
+
+/* hashtable_concurrent_get
+ *
+ * Retrieve the value mapped by 'key', or NULL if there is no such key. Never blocks.
+ * */
+void *hashtable_concurrent_get(hashtable_concurrent_t *table, const char *key, size_t keylen);
+
+/* hashtable_concurrent_exists_pair
+ *
+ * Check if 'key' is in the table. If so return 1, if not return 0. Never blocks.
+ * */
+int hashtable_concurrent_exists_pair(hashtable_concurrent_t *table, const char *key, size_t keylen);
+
+/* hashtable_concurrent_size
+ *
+ * The number of keys in the table. Never blocks.
+ * */
+size_t hashtable_concurrent_size(hashtable_concurrent_t *table);
+
+/* hashtable_concurrent_remove
+ *
+ * Remove 'key' from the table, storing its value in 'value' (if not NULL) for the caller to reclaim.
+ * Returns 0 on success and -1 if there is no such key.
+ * */
+int hashtable_concurrent_remove(hashtable_concurrent_t *table, const char *key, size_t keylen, void **value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSC_HASH_TABLE_CONCURRENT_H_
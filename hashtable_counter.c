@@ -0,0 +1,375 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "hashtable_counter.h"
+#include "lookup3.h"
+
+extern uint32_t hashtable_seed;
+
+#define hash_str_key(str, len) hashlittle((str), (len), (hashtable_seed))
+
+
+typedef struct hashtable_counter_key
+{
+    uint32_t hash;
+    uint32_t keylen;
+    char key[];                           // not null terminated
+}hash_counter_key_t;
+
+
+typedef struct hashtable_counter_slot
+{
+    _Atomic(hash_counter_key_t *) key;    // NULL until claimed, then never changes
+    _Atomic int64_t count;
+}hash_counter_slot_t;
+
+
+struct hashtable_counter
+{
+    size_t capacity;                      // always a power of two
+    size_t max_items;
+    _Atomic size_t num_items;
+
+    hash_counter_slot_t *slots;
+};
+
+
+typedef struct hashtable_counter_local_slot
+{
+    uint32_t hash;
+    uint8_t keylen;
+    uint8_t used;
+    char key[MAX_KEY_LEN];
+    int64_t delta;
+}hash_counter_local_slot_t;
+
+
+struct hashtable_counter_local
+{
+    hashtable_counter_t *table;
+    size_t capacity;                      // always a power of two
+    size_t num_items;
+
+    hash_counter_local_slot_t *slots;
+};
+
+
+static inline size_t _counter_round_up(size_t n)
+{
+    size_t capacity = 2;
+
+    while(capacity < n)
+        capacity <<= 1;
+
+    return capacity;
+}
+
+
+static inline int _counter_key_matches(hash_counter_key_t const *k, uint32_t hash, const char *key, size_t keylen)
+{
+    return k->hash == hash && k->keylen == keylen && memcmp(k->key, key, keylen) == 0;
+}
+
+
+hashtable_counter_t *hashtable_counter_create(size_t max_items)
+{
+    hashtable_counter_t *table = malloc(sizeof(hashtable_counter_t));
+    if(!table)
+        return NULL;
+
+    table->capacity = _counter_round_up(max_items * 100 / HASHTABLE_COUNTER_MAX_LOAD + 1);
+    table->max_items = table->capacity * HASHTABLE_COUNTER_MAX_LOAD / 100;
+    atomic_init(&table->num_items, 0);
+
+    table->slots = malloc(table->capacity * sizeof(hash_counter_slot_t));
+    if(!table->slots)
+    {
+        free(table);
+        return NULL;
+    }
+
+    for(size_t i = 0; i < table->capacity; i++)
+    {
+        atomic_init(&table->slots[i].key, NULL);
+        atomic_init(&table->slots[i].count, 0);
+    }
+
+    return table;
+}
+
+
+int hashtable_counter_destroy(hashtable_counter_t *table)
+{
+    if(!table)
+        return -1;
+
+    for(size_t i = 0; i < table->capacity; i++)
+        free(atomic_load_explicit(&table->slots[i].key, memory_order_relaxed));
+
+    free(table->slots);
+    free(table);
+
+    return 0;
+}
+
+
+/* _counter_add_hashed
+ *
+ * Linear probing from the key's home slot. An empty slot is claimed by a CAS which publishes our key copy (the
+ * release half makes its bytes visible to whoever reads the pointer). If another thread wins the race for that
+ * slot we simply carry on probing from it, since it may well have claimed it for the same key.
+ * */
+static int _counter_add_hashed(hashtable_counter_t *table, uint32_t hash, const char *key, size_t keylen,
+                               int64_t delta)
+{
+    size_t mask = table->capacity - 1;
+    size_t index = hash & mask;
+    hash_counter_key_t *ours = NULL;
+
+    for(size_t probes = 0; probes < table->capacity; probes++, index = (index + 1) & mask)
+    {
+        hash_counter_slot_t *slot = &table->slots[index];
+        hash_counter_key_t *current = atomic_load_explicit(&slot->key, memory_order_acquire);
+
+        if(current == NULL)
+        {
+            if(ours == NULL)
+            {
+                /* reserve room for a new key before claiming a slot, so the table never overfills */
+                if(atomic_fetch_add_explicit(&table->num_items, 1, memory_order_relaxed) >= table->max_items)
+                {
+                    atomic_fetch_sub_explicit(&table->num_items, 1, memory_order_relaxed);
+                    return -1;
+                }
+
+                ours = malloc(sizeof(hash_counter_key_t) + keylen);
+                if(!ours)
+                {
+                    atomic_fetch_sub_explicit(&table->num_items, 1, memory_order_relaxed);
+                    return -1;
+                }
+
+                ours->hash = hash;
+                ours->keylen = (uint32_t)keylen;
+                memcpy(ours->key, key, keylen);
+            }
+
+            if(atomic_compare_exchange_strong_explicit(&slot->key, &current, ours, memory_order_acq_rel,
+                                                       memory_order_acquire))
+            {
+                atomic_fetch_add_explicit(&slot->count, delta, memory_order_relaxed);
+                return 0;
+            }
+            /* lost the race, 'current' now holds the winner's key */
+        }
+
+        if(_counter_key_matches(current, hash, key, keylen))
+        {
+            atomic_fetch_add_explicit(&slot->count, delta, memory_order_relaxed);
+
+            if(ours != NULL)      // someone else inserted the same key first
+            {
+                free(ours);
+                atomic_fetch_sub_explicit(&table->num_items, 1, memory_order_relaxed);
+            }
+            return 0;
+        }
+    }
+
+    if(ours != NULL)
+    {
+        free(ours);
+        atomic_fetch_sub_explicit(&table->num_items, 1, memory_order_relaxed);
+    }
+
+    return -1;
+}
+
+
+int hashtable_counter_add(hashtable_counter_t *table, const char *key, size_t keylen, int64_t delta)
+{
+    if(!table || !key || keylen > UINT32_MAX)
+        return -1;
+
+    return _counter_add_hashed(table, hash_str_key(key, keylen), key, keylen, delta);
+}
+
+
+int64_t hashtable_counter_get(hashtable_counter_t const *table, const char *key, size_t keylen)
+{
+    if(!table || !key)
+        return 0;
+
+    uint32_t hash = hash_str_key(key, keylen);
+    size_t mask = table->capacity - 1;
+    size_t index = hash & mask;
+
+    for(size_t probes = 0; probes < table->capacity; probes++, index = (index + 1) & mask)
+    {
+        hash_counter_slot_t *slot = &table->slots[index];
+        hash_counter_key_t *current = atomic_load_explicit(&slot->key, memory_order_acquire);
+
+        if(current == NULL)
+            return 0;     // keys are never removed, so the run ends here
+
+        if(_counter_key_matches(current, hash, key, keylen))
+            return atomic_load_explicit(&slot->count, memory_order_relaxed);
+    }
+
+    return 0;
+}
+
+
+size_t hashtable_counter_size(hashtable_counter_t const *table)
+{
+    if(!table)
+        return 0;
+
+    return atomic_load_explicit(&table->num_items, memory_order_relaxed);
+}
+
+
+int hashtable_counter_foreach(hashtable_counter_t const *table,
+                              int (*fn)(const char *key, size_t keylen, int64_t count, void *ctx), void *ctx)
+{
+    int ret;
+
+    if(!table || !fn)
+        return -1;
+
+    for(size_t i = 0; i < table->capacity; i++)
+    {
+        hashtable_counter_t *mutable_table = (hashtable_counter_t *)table;    // atomics need a non-const object
+        hash_counter_key_t *current = atomic_load_explicit(&mutable_table->slots[i].key, memory_order_acquire);
+        if(current == NULL)
+            continue;
+
+        ret = fn(current->key, current->keylen,
+                 atomic_load_explicit(&mutable_table->slots[i].count, memory_order_relaxed), ctx);
+        if(ret != 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+
+hashtable_counter_local_t *hashtable_counter_local_create(hashtable_counter_t *table, size_t slots)
+{
+    hashtable_counter_local_t *local;
+
+    if(!table)
+        return NULL;
+
+    local = malloc(sizeof(hashtable_counter_local_t));
+    if(!local)
+        return NULL;
+
+    local->table = table;
+    local->capacity = _counter_round_up(slots);
+    local->num_items = 0;
+
+    local->slots = calloc(local->capacity, sizeof(hash_counter_local_slot_t));
+    if(!local->slots)
+    {
+        free(local);
+        return NULL;
+    }
+
+    return local;
+}
+
+
+int hashtable_counter_local_flush(hashtable_counter_local_t *local)
+{
+    int ret = 0;
+
+    if(!local)
+        return -1;
+
+    for(size_t i = 0; i < local->capacity; i++)
+    {
+        hash_counter_local_slot_t *slot = &local->slots[i];
+        if(!slot->used || slot->delta == 0)
+            continue;
+
+        if(_counter_add_hashed(local->table, slot->hash, slot->key, slot->keylen, slot->delta) != 0)
+        {
+            ret = -1;      // keep this delta for the next flush
+            continue;
+        }
+        slot->delta = 0;
+    }
+
+    if(ret == 0)
+    {
+        memset(local->slots, 0, local->capacity * sizeof(hash_counter_local_slot_t));
+        local->num_items = 0;
+    }
+
+    return ret;
+}
+
+
+int hashtable_counter_local_add(hashtable_counter_local_t *local, const char *key, size_t keylen, int64_t delta)
+{
+    if(!local || !key)
+        return -1;
+
+    if(keylen > MAX_KEY_LEN)
+        return hashtable_counter_add(local->table, key, keylen, delta);
+
+    uint32_t hash = hash_str_key(key, keylen);
+    size_t mask = local->capacity - 1;
+    size_t index = hash & mask;
+
+    for(;; index = (index + 1) & mask)
+    {
+        hash_counter_local_slot_t *slot = &local->slots[index];
+
+        if(!slot->used)
+            break;
+
+        if(slot->hash == hash && slot->keylen == keylen && memcmp(slot->key, key, keylen) == 0)
+        {
+            slot->delta += delta;
+            return 0;
+        }
+    }
+
+    /* a new key, make room by merging everything into the shared table if we are getting full */
+    if((local->num_items + 1) * 4 > local->capacity * 3)
+    {
+        if(hashtable_counter_local_flush(local) != 0)
+            return -1;
+
+        return hashtable_counter_local_add(local, key, keylen, delta);
+    }
+
+    hash_counter_local_slot_t *slot = &local->slots[index];
+    slot->used = 1;
+    slot->hash = hash;
+    slot->keylen = (uint8_t)keylen;
+    memcpy(slot->key, key, keylen);
+    slot->delta = delta;
+    local->num_items++;
+
+    return 0;
+}
+
+
+int hashtable_counter_local_destroy(hashtable_counter_local_t *local)
+{
+    int ret;
+
+    if(!local)
+        return -1;
+
+    ret = hashtable_counter_local_flush(local);
+
+    free(local->slots);
+    free(local);
+
+    return ret;
+}
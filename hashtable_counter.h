@@ -0,0 +1,101 @@
+/* Concurrent counter tables.
+ *
+ * A table specialised for frequency counting from many threads at once. Values are inline 64-bit counters and
+ * hashtable_counter_add inserts-or-increments without locks: a new key is published into its slot with a single
+ * compare-and-swap, and from then on every increment is one atomic fetch-add.
+ *
+ * For very hot keys, each thread can also batch its increments in a hashtable_counter_local_t, an unshared buffer
+ * of pending deltas which is merged into the shared table when it fills up or is flushed.
+ *
+ * The table has a fixed capacity chosen at creation and keys are never removed, which is what lets readers and
+ * writers proceed without any reclamation scheme.
+ * */
+
+#ifndef JSC_HASH_TABLE_COUNTER_H_
+#define JSC_HASH_TABLE_COUNTER_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "hashtable.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HASHTABLE_COUNTER_MAX_LOAD 75     // percentage of the slots usable before adds of new keys fail
+
+typedef struct hashtable_counter hashtable_counter_t;
+typedef struct hashtable_counter_local hashtable_counter_local_t;
+
+
+/* hashtable_counter_create
+ *
+ * Create a counter table able to hold at least 'max_items' distinct keys. Returns NULL if this process fails.
+ * */
+hashtable_counter_t *hashtable_counter_create(size_t max_items);
+
+/* hashtable_counter_destroy
+ *
+ * Destroy the table. No other thread may be using it.
+ * */
+int hashtable_counter_destroy(hashtable_counter_t *table);
+
+/* hashtable_counter_add
+ *
+ * Add 'delta' to the counter for 'key', inserting it with a count of 'delta' if it is new. Safe to call from any
+ * number of threads at once. Returns 0 on success and -1 if the key is new and the table is full (or out of
+ * memory).
+ * */
+int hashtable_counter_add(hashtable_counter_t *table, const char *key, size_t keylen, int64_t delta);
+
+/* hashtable_counter_get
+ *
+ * Read the counter for 'key', or 0 if it has never been added. Safe to call concurrently with adds.
+ * */
+int64_t hashtable_counter_get(hashtable_counter_t const *table, const char *key, size_t keylen);
+
+/* hashtable_counter_size
+ *
+ * The number of distinct keys in the table. Safe to call concurrently with adds.
+ * */
+size_t hashtable_counter_size(hashtable_counter_t const *table);
+
+/* hashtable_counter_foreach
+ *
+ * Call 'fn' with every key and its current count. Iteration stops early if 'fn' returns non-zero, in which case
+ * that value is returned. Counts read while adds are still running are each individually up to date.
+ * */
+int hashtable_counter_foreach(hashtable_counter_t const *table,
+                              int (*fn)(const char *key, size_t keylen, int64_t count, void *ctx), void *ctx);
+
+/* hashtable_counter_local_create
+ *
+ * Create a per-thread buffer of pending deltas for 'table' with room for 'slots' keys. It must only be used by
+ * one thread at a time. Keys longer than MAX_KEY_LEN bypass the buffer and go straight to the table.
+ * */
+hashtable_counter_local_t *hashtable_counter_local_create(hashtable_counter_t *table, size_t slots);
+
+/* hashtable_counter_local_add
+ *
+ * Buffer 'delta' for 'key', merging the whole buffer into the table first if it is full. Returns 0 on success and
+ * -1 if a merge failed (the deltas that could not be merged stay buffered).
+ * */
+int hashtable_counter_local_add(hashtable_counter_local_t *local, const char *key, size_t keylen, int64_t delta);
+
+/* hashtable_counter_local_flush
+ *
+ * Merge every buffered delta into the table. Returns 0 on success and -1 if some could not be merged.
+ * */
+int hashtable_counter_local_flush(hashtable_counter_local_t *local);
+
+/* hashtable_counter_local_destroy
+ *
+ * Flush and then destroy the buffer. Returns -1 if the flush failed, in which case those deltas are lost.
+ * */
+int hashtable_counter_local_destroy(hashtable_counter_local_t *local);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSC_HASH_TABLE_COUNTER_H_
@@ -0,0 +1,477 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "hashtable_internal.h"
+#include "lookup3.h"
+
+extern uint32_t hashtable_seed;
+
+#define hash_str_key(str, len) hashlittle((str), (len), (hashtable_seed))
+
+#define CUCKOO_WAYS       4       // slots per bucket
+#define CUCKOO_STASH      4       // keys which found no place, checked after both buckets
+#define CUCKOO_BFS_NODES  512     // buckets the displacement search may visit
+#define CUCKOO_BFS_DEPTH  5       // and the longest chain of moves it may produce
+#define CUCKOO_GROW_TRIES 4       // doublings a single growth may take before the keys are deemed to collide outright
+
+
+/* a key and its value share one allocation, so a hit costs a single dereference */
+typedef struct cuckoo_entry
+{
+    void *value;
+    size_t keylen;
+    char key[];         // null terminated, so that foreach can hand it out directly
+}cuckoo_entry_t;
+
+
+/* exactly one cache line, the hashes let most candidates be rejected without touching their entry */
+typedef struct cuckoo_bucket
+{
+    _Alignas(64) uint32_t hash[CUCKOO_WAYS];
+    cuckoo_entry_t *entry[CUCKOO_WAYS];     // NULL for an empty slot
+}cuckoo_bucket_t;
+
+
+typedef struct cuckoo_state
+{
+    cuckoo_bucket_t *buckets;       // table->table_size of them, always a power of two
+    size_t stash_count;
+    uint32_t stash_hash[CUCKOO_STASH];
+    cuckoo_entry_t *stash[CUCKOO_STASH];
+}cuckoo_state_t;
+
+
+typedef struct cuckoo_bfs_node
+{
+    size_t bucket;
+    int parent;         // index of the node whose entry moves into this bucket, -1 for the two roots
+    int slot;           // the slot of the parent's bucket holding that entry
+    int depth;
+}cuckoo_bfs_node_t;
+
+
+/* _cuckoo_alt
+ *
+ * The other bucket of a key, derived from its stored hash alone so that any entry can be moved without looking at
+ * its key. XOR with the same odd offset maps each of the pair onto the other.
+ * */
+static inline size_t _cuckoo_alt(size_t mask, size_t index, uint32_t hash)
+{
+    uint64_t offset = (((uint64_t)hash * 0x9e3779b97f4a7c15ULL) >> 32) | 1;
+
+    return (index ^ (size_t)offset) & mask;
+}
+
+
+static cuckoo_bucket_t *_cuckoo_alloc_buckets(size_t count)
+{
+    cuckoo_bucket_t *buckets;
+
+#if defined(_WIN32)
+    buckets = malloc(count * sizeof(cuckoo_bucket_t));
+#else
+    buckets = aligned_alloc(64, count * sizeof(cuckoo_bucket_t));
+#endif
+    if(buckets)
+        memset(buckets, 0, count * sizeof(cuckoo_bucket_t));
+
+    return buckets;
+}
+
+
+int _cuckoo_init(hashtable_t *table, size_t initial_size)
+{
+    cuckoo_state_t *state;
+    size_t count = 2;
+
+    if(table->max_load_factor == 0 || table->max_load_factor > 99)
+        table->max_load_factor = 90;
+
+    while(count * CUCKOO_WAYS < initial_size)
+        count <<= 1;
+
+    state = calloc(1, sizeof(cuckoo_state_t));
+    if(!state)
+        return -1;
+
+    state->buckets = _cuckoo_alloc_buckets(count);
+    if(!state->buckets)
+    {
+        free(state);
+        return -1;
+    }
+
+    table->slots = state;
+    table->table_size = count;
+
+    return 0;
+}
+
+
+int _cuckoo_destroy(hashtable_t *table, void (*deallocator)(void*))
+{
+    cuckoo_state_t *state = table->slots;
+
+    for(size_t i = 0; i < table->table_size; i++)
+    {
+        for(int s = 0; s < CUCKOO_WAYS; s++)
+        {
+            if(state->buckets[i].entry[s] == NULL)
+                continue;
+
+            if(deallocator)
+                deallocator(state->buckets[i].entry[s]->value);
+            free(state->buckets[i].entry[s]);
+        }
+    }
+
+    for(size_t i = 0; i < state->stash_count; i++)
+    {
+        if(deallocator)
+            deallocator(state->stash[i]->value);
+        free(state->stash[i]);
+    }
+
+    free(state->buckets);
+    free(state);
+    table->slots = NULL;
+
+    return 0;
+}
+
+
+static inline int _cuckoo_matches(cuckoo_entry_t const *entry, const char *key, size_t keylen)
+{
+    return entry->keylen == keylen && memcmp(entry->key, key, keylen) == 0;
+}
+
+
+/* _cuckoo_find
+ *
+ * Return a pointer to the slot holding 'key', whose hash is 'hash', or NULL. Only the key's two buckets are looked at,
+ * plus the stash when it is in use.
+ * */
+static cuckoo_entry_t **_cuckoo_find(hashtable_t const *table, const char *key, size_t keylen, uint32_t hash)
+{
+    cuckoo_state_t *state = table->slots;
+    size_t mask = table->table_size - 1;
+    size_t first = hash & mask;
+    cuckoo_bucket_t *buckets[2] = {&state->buckets[first], &state->buckets[_cuckoo_alt(mask, first, hash)]};
+
+    for(int b = 0; b < 2; b++)
+    {
+        for(int s = 0; s < CUCKOO_WAYS; s++)
+        {
+            if(buckets[b]->hash[s] == hash && buckets[b]->entry[s] != NULL
+               && _cuckoo_matches(buckets[b]->entry[s], key, keylen))
+                return &buckets[b]->entry[s];
+        }
+    }
+
+    for(size_t i = 0; i < state->stash_count; i++)
+    {
+        if(state->stash_hash[i] == hash && _cuckoo_matches(state->stash[i], key, keylen))
+            return &state->stash[i];
+    }
+
+    return NULL;
+}
+
+
+static inline int _cuckoo_free_slot(cuckoo_bucket_t const *bucket)
+{
+    for(int s = 0; s < CUCKOO_WAYS; s++)
+        if(bucket->entry[s] == NULL)
+            return s;
+
+    return -1;
+}
+
+
+static inline int _cuckoo_on_path(cuckoo_bfs_node_t const *nodes, int node, size_t bucket)
+{
+    for(; node >= 0; node = nodes[node].parent)
+        if(nodes[node].bucket == bucket)
+            return 1;
+
+    return 0;
+}
+
+
+/* _cuckoo_place
+ *
+ * Place an entry which is not yet in the table into one of its buckets. If both are full, search breadth first
+ * for the shortest chain of moves (each entry to its own alternate bucket) which ends at a free slot, then make
+ * those moves from the far end backwards. Buckets are never repeated along a chain, so every move is valid.
+ * Return 0 on success and -1 if no chain was found.
+ * */
+static int _cuckoo_place(hashtable_t *table, cuckoo_entry_t *entry, uint32_t hash)
+{
+    cuckoo_state_t *state = table->slots;
+    size_t mask = table->table_size - 1;
+    cuckoo_bfs_node_t nodes[CUCKOO_BFS_NODES];
+    int head = 0, tail = 0;
+
+    nodes[tail++] = (cuckoo_bfs_node_t){hash & mask, -1, 0, 0};
+    nodes[tail++] = (cuckoo_bfs_node_t){_cuckoo_alt(mask, hash & mask, hash), -1, 0, 0};
+
+    while(head < tail)
+    {
+        int node = head++;
+        cuckoo_bucket_t *bucket = &state->buckets[nodes[node].bucket];
+        int free_slot = _cuckoo_free_slot(bucket);
+
+        if(free_slot >= 0)
+        {
+            /* walk back to the root, each entry on the chain moving into the slot its successor vacated */
+            while(nodes[node].parent >= 0)
+            {
+                cuckoo_bfs_node_t *parent = &nodes[nodes[node].parent];
+                cuckoo_bucket_t *from = &state->buckets[parent->bucket];
+
+                bucket->hash[free_slot] = from->hash[nodes[node].slot];
+                bucket->entry[free_slot] = from->entry[nodes[node].slot];
+                from->entry[nodes[node].slot] = NULL;
+
+                free_slot = nodes[node].slot;
+                bucket = from;
+                node = nodes[node].parent;
+            }
+
+            bucket->hash[free_slot] = hash;
+            bucket->entry[free_slot] = entry;
+            return 0;
+        }
+
+        if(nodes[node].depth == CUCKOO_BFS_DEPTH)
+            continue;
+
+        for(int s = 0; s < CUCKOO_WAYS && tail < CUCKOO_BFS_NODES; s++)
+        {
+            size_t next = _cuckoo_alt(mask, nodes[node].bucket, bucket->hash[s]);
+            if(_cuckoo_on_path(nodes, node, next))
+                continue;
+
+            nodes[tail++] = (cuckoo_bfs_node_t){next, node, s, nodes[node].depth + 1};
+        }
+    }
+
+    return -1;
+}
+
+
+/* _cuckoo_add
+ *
+ * Place an entry, falling back to the stash. Return -1 if even the stash is full.
+ * */
+static int _cuckoo_add(hashtable_t *table, cuckoo_entry_t *entry, uint32_t hash)
+{
+    cuckoo_state_t *state = table->slots;
+
+    if(_cuckoo_place(table, entry, hash) == 0)
+        return 0;
+
+    if(state->stash_count == CUCKOO_STASH)
+        return -1;
+
+    state->stash_hash[state->stash_count] = hash;
+    state->stash[state->stash_count++] = entry;
+
+    return 0;
+}
+
+
+/* _cuckoo_drain_stash
+ *
+ * Called once a removal has freed a slot: move whatever stash entries can now be placed back into their buckets,
+ * keeping the stash dense, so that lookups stop paying for it as soon as the table has room again.
+ * */
+static void _cuckoo_drain_stash(hashtable_t *table)
+{
+    cuckoo_state_t *state = table->slots;
+
+    for(size_t i = state->stash_count; i-- > 0; )
+    {
+        if(_cuckoo_place(table, state->stash[i], state->stash_hash[i]) != 0)
+            continue;
+
+        state->stash_count--;
+        state->stash[i] = state->stash[state->stash_count];
+        state->stash_hash[i] = state->stash_hash[state->stash_count];
+    }
+}
+
+
+/* _cuckoo_grow
+ *
+ * Rehash every entry into a bucket array at least twice the size. Entries move without being reallocated, and
+ * if some still cannot be placed we try again with a bigger array, up to CUCKOO_GROW_TRIES times: keys whose
+ * 32-bit hashes give them the same pair of buckets collide at any size. On failure nothing has changed.
+ * */
+static int _cuckoo_grow(hashtable_t *table)
+{
+    cuckoo_state_t *state = table->slots;
+    cuckoo_state_t old = *state;
+    size_t old_size = table->table_size;
+
+    size_t new_size = old_size * HASHTABLE_GROWTH_FACTOR;
+
+    for(int tries = 0; tries < CUCKOO_GROW_TRIES && new_size > old_size; tries++, new_size *= 2)
+    {
+        int ok = 1;
+
+        state->buckets = _cuckoo_alloc_buckets(new_size);
+        if(!state->buckets)
+            break;
+
+        state->stash_count = 0;
+        table->table_size = new_size;
+
+        for(size_t i = 0; i < old_size && ok; i++)
+        {
+            for(int s = 0; s < CUCKOO_WAYS && ok; s++)
+                if(old.buckets[i].entry[s] != NULL)
+                    ok = _cuckoo_add(table, old.buckets[i].entry[s], old.buckets[i].hash[s]) == 0;
+        }
+
+        for(size_t i = 0; i < old.stash_count && ok; i++)
+            ok = _cuckoo_add(table, old.stash[i], old.stash_hash[i]) == 0;
+
+        if(ok)
+        {
+            free(old.buckets);
+            return 0;
+        }
+
+        free(state->buckets);
+    }
+
+    *state = old;
+    table->table_size = old_size;
+
+    return -1;
+}
+
+
+int _cuckoo_set(hashtable_t *table, const char *key, size_t keylen, void *value, uint32_t replace,
+                void (*deallocator)(void*))
+{
+    uint32_t hash = hash_str_key(key, keylen);
+    cuckoo_entry_t **slot = _cuckoo_find(table, key, keylen, hash);
+    cuckoo_entry_t *entry;
+
+    if(slot != NULL)
+    {
+        if(!replace)
+            return -1;
+
+        if(deallocator)
+            deallocator((*slot)->value);
+        (*slot)->value = value;
+
+        return 0;
+    }
+
+    if((table->num_items + 1) * 100 > table->table_size * CUCKOO_WAYS * table->max_load_factor)
+        _cuckoo_grow(table);     // still fine if this fails, until a key finds no place at all
+
+    entry = malloc(sizeof(cuckoo_entry_t) + keylen + 1);
+    if(!entry)
+        return -1;
+
+    entry->value = value;
+    entry->keylen = keylen;
+    memcpy(entry->key, key, keylen);
+    entry->key[keylen] = '\0';
+
+    /* one growth, however many doublings it takes, is all an insert may cost */
+    if(_cuckoo_add(table, entry, hash) != 0
+       && (_cuckoo_grow(table) != 0 || _cuckoo_add(table, entry, hash) != 0))
+    {
+        free(entry);
+        return -1;
+    }
+
+    table->num_items++;
+
+    return 0;
+}
+
+
+const void *_cuckoo_get(hashtable_t const *table, const char *key, size_t keylen)
+{
+    cuckoo_entry_t **slot = _cuckoo_find(table, key, keylen, hash_str_key(key, keylen));
+
+    return slot ? (*slot)->value : NULL;
+}
+
+
+int _cuckoo_exists_pair(hashtable_t const *table, const char *key, size_t keylen)
+{
+    return _cuckoo_find(table, key, keylen, hash_str_key(key, keylen)) != NULL;
+}
+
+
+int _cuckoo_remove(hashtable_t *table, const char *key, size_t keylen, void (*deallocator)(void*))
+{
+    cuckoo_state_t *state = table->slots;
+    cuckoo_entry_t **slot = _cuckoo_find(table, key, keylen, hash_str_key(key, keylen));
+
+    if(slot == NULL)
+        return -1;
+
+    if(deallocator)
+        deallocator((*slot)->value);
+    free(*slot);
+
+    if(slot >= state->stash && slot < state->stash + CUCKOO_STASH)
+    {
+        size_t i = (size_t)(slot - state->stash);     // keep the stash dense
+
+        state->stash_count--;
+        state->stash[i] = state->stash[state->stash_count];
+        state->stash_hash[i] = state->stash_hash[state->stash_count];
+    }
+    else
+    {
+        *slot = NULL;
+        if(state->stash_count != 0)
+            _cuckoo_drain_stash(table);
+    }
+
+    table->num_items--;
+
+    return 0;
+}
+
+
+int _cuckoo_foreach(hashtable_t const *table, int (*fn)(const char *key, size_t keylen, void *value, void *ctx),
+                    void *ctx)
+{
+    cuckoo_state_t *state = table->slots;
+    cuckoo_entry_t *entry;
+    int ret;
+
+    for(size_t i = 0; i < table->table_size; i++)
+    {
+        for(int s = 0; s < CUCKOO_WAYS; s++)
+        {
+            entry = state->buckets[i].entry[s];
+            if(entry == NULL)
+                continue;
+
+            ret = fn(entry->key, entry->keylen, entry->value, ctx);
+            if(ret != 0)
+                return ret;
+        }
+    }
+
+    for(size_t i = 0; i < state->stash_count; i++)
+    {
+        ret = fn(state->stash[i]->key, state->stash[i]->keylen, state->stash[i]->value, ctx);
+        if(ret != 0)
+            return ret;
+    }
+
+    return 0;
+}
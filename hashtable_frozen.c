@@ -0,0 +1,582 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "hashtable_frozen.h"
+#include "lookup3.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+extern uint32_t hashtable_seed;
+
+#define FROZEN_ALIGN(n) (((n) + 7) & ~(uint64_t)7)     // keep every section and value 8-byte aligned
+
+#define XOR_FILTER_ATTEMPTS 16      // seeds to try before writing the image without a filter
+
+
+typedef struct frozen_pending
+{
+    uint32_t hash;
+    const char *key;
+    size_t keylen;
+    void *value;
+}frozen_pending_t;
+
+
+typedef struct frozen_collect
+{
+    frozen_pending_t *items;
+    size_t count;
+    size_t capacity;
+    int copy_keys;        // the table rebuilds its keys for each callback (key prefixes), so we keep copies
+}frozen_collect_t;
+
+
+/* _frozen_collect_item
+ *
+ * hashtable_foreach callback gathering every pair of the source table (and its hash) before we lay them out.
+ * */
+static int _frozen_collect_item(const char *key, size_t keylen, void *value, void *ctx)
+{
+    frozen_collect_t *collect = ctx;
+
+    if(keylen > UINT32_MAX)
+        return -1;
+
+    if(collect->count == collect->capacity)
+    {
+        size_t new_capacity = collect->capacity ? collect->capacity * 2 : 64;
+        frozen_pending_t *temp = realloc(collect->items, new_capacity * sizeof(frozen_pending_t));
+        if(!temp)
+            return -1;
+
+        collect->items = temp;
+        collect->capacity = new_capacity;
+    }
+
+    if(collect->copy_keys)
+    {
+        char *copy = malloc(keylen + 1);
+        if(!copy)
+            return -1;
+
+        memcpy(copy, key, keylen + 1);
+        key = copy;
+    }
+
+    collect->items[collect->count].hash   = hashlittle(key, keylen, hashtable_seed);
+    collect->items[collect->count].key    = key;
+    collect->items[collect->count].keylen = keylen;
+    collect->items[collect->count].value  = value;
+    collect->count++;
+
+    return 0;
+}
+
+
+/* _xor_hash
+ *
+ * The filter works from the 32 bit hash already computed for each key, spread into 64 bits (murmur3 finaliser)
+ * under the filter's own seed.
+ * */
+static inline uint64_t _xor_hash(uint32_t hash, uint64_t seed)
+{
+    uint64_t x = (hash + seed) * 0x9e3779b97f4a7c15ULL;
+
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+
+    return x;
+}
+
+
+static inline uint8_t _xor_fingerprint(uint64_t h)
+{
+    return (uint8_t)(h ^ (h >> 32));
+}
+
+
+/* _xor_slot
+ *
+ * The i'th of the three slots for hash 'h', one in each third of the fingerprint array.
+ * */
+static inline uint32_t _xor_slot(uint64_t h, int i, uint32_t block_length)
+{
+    uint64_t r = i == 0 ? h : (h << (21 * i)) | (h >> (64 - 21 * i));
+
+    return (uint32_t)(((uint64_t)(uint32_t)r * block_length) >> 32) + (uint32_t)i * block_length;
+}
+
+
+static int _compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+
+/* _xor_filter_build
+ *
+ * Build an xor filter over the (sorted, unique) 32 bit key hashes by peeling: repeatedly take a slot only one
+ * remaining key maps to, then assign fingerprints in the reverse order. Returns NULL (leaving the image without
+ * a filter) if no seed peels completely.
+ * */
+static uint8_t *_xor_filter_build(const uint32_t *hashes, size_t n, uint32_t *block_length, uint64_t *seed)
+{
+    uint32_t length = (uint32_t)((32 + n + n * 23 / 100) / 3);
+    size_t capacity = (size_t)length * 3;
+    uint64_t *xormask = malloc(capacity * sizeof(uint64_t));
+    uint32_t *count = malloc(capacity * sizeof(uint32_t));
+    uint32_t *queue = malloc(capacity * sizeof(uint32_t));
+    uint64_t *stack_hash = malloc((n ? n : 1) * sizeof(uint64_t));
+    uint32_t *stack_slot = malloc((n ? n : 1) * sizeof(uint32_t));
+    uint8_t *fingerprints = NULL;
+    size_t stacked = 0;
+
+    if(!xormask || !count || !queue || !stack_hash || !stack_slot)
+        goto cleanup;
+
+    for(uint64_t attempt = 0; attempt < XOR_FILTER_ATTEMPTS && stacked != n; attempt++)
+    {
+        size_t head = 0, tail = 0;
+
+        *seed = (attempt + 1) * 0x632be59bd9b4e019ULL;
+        stacked = 0;
+        memset(xormask, 0, capacity * sizeof(uint64_t));
+        memset(count, 0, capacity * sizeof(uint32_t));
+
+        for(size_t k = 0; k < n; k++)
+        {
+            uint64_t h = _xor_hash(hashes[k], *seed);
+            for(int i = 0; i < 3; i++)
+            {
+                uint32_t slot = _xor_slot(h, i, length);
+                xormask[slot] ^= h;
+                count[slot]++;
+            }
+        }
+
+        for(uint32_t slot = 0; slot < capacity; slot++)
+        {
+            if(count[slot] == 1)
+                queue[tail++] = slot;
+        }
+
+        while(head < tail)
+        {
+            uint32_t slot = queue[head++];
+            if(count[slot] != 1)
+                continue;       // already peeled via another slot
+
+            uint64_t h = xormask[slot];
+            stack_hash[stacked] = h;
+            stack_slot[stacked++] = slot;
+
+            for(int i = 0; i < 3; i++)
+            {
+                uint32_t other = _xor_slot(h, i, length);
+                xormask[other] ^= h;
+                if(--count[other] == 1)
+                    queue[tail++] = other;
+            }
+        }
+    }
+
+    if(stacked != n)
+        goto cleanup;
+
+    fingerprints = calloc(capacity, 1);
+    if(!fingerprints)
+        goto cleanup;
+
+    while(stacked > 0)
+    {
+        uint64_t h = stack_hash[--stacked];
+        uint8_t fingerprint = _xor_fingerprint(h);
+
+        for(int i = 0; i < 3; i++)
+            fingerprint ^= fingerprints[_xor_slot(h, i, length)];   // our own slot is still 0
+
+        fingerprints[stack_slot[stacked]] = fingerprint;
+    }
+    *block_length = length;
+
+cleanup:
+    free(xormask);
+    free(count);
+    free(queue);
+    free(stack_hash);
+    free(stack_slot);
+
+    return fingerprints;
+}
+
+
+/* _frozen_write_padded
+ *
+ * Write 'len' bytes followed by enough zeroes to reach the next 8 byte boundary.
+ * */
+static int _frozen_write_padded(FILE *out, const void *data, size_t len)
+{
+    static const char zeroes[8] = {0};
+    size_t pad = FROZEN_ALIGN(len) - len;
+
+    if(len && fwrite(data, 1, len, out) != len)
+        return -1;
+    if(pad && fwrite(zeroes, 1, pad, out) != pad)
+        return -1;
+
+    return 0;
+}
+
+
+int hashtable_freeze(hashtable_t const *table, const char *path, size_t (*value_size)(const void *value))
+{
+    frozen_collect_t collect = {NULL, 0, 0, 0};
+    frozen_pending_t *sorted = NULL;
+    hashtable_frozen_entry_t *entries = NULL;
+    uint64_t *buckets = NULL;
+    uint32_t *filter_hashes = NULL;
+    uint8_t *filter = NULL;
+    uint32_t filter_block_length = 0;
+    uint64_t filter_seed = 0;
+    size_t num_filter_hashes = 0;
+    hashtable_frozen_header_t header;
+    uint64_t num_buckets, heap_len = 0;
+    FILE *out = NULL;
+    int ret = -1;
+
+    if(!table || !path)
+        return -1;
+
+    collect.copy_keys = table->prefixes != NULL;
+    if(hashtable_foreach(table, _frozen_collect_item, &collect) != 0)
+        goto cleanup;
+
+    /* aim for one entry per bucket, the chains in the image are short and contiguous anyway */
+    num_buckets = collect.count ? collect.count : 1;
+
+    buckets = calloc(num_buckets + 1, sizeof(uint64_t));
+    sorted  = malloc((collect.count ? collect.count : 1) * sizeof(frozen_pending_t));
+    entries = malloc((collect.count ? collect.count : 1) * sizeof(hashtable_frozen_entry_t));
+    if(!buckets || !sorted || !entries)
+        goto cleanup;
+
+    /* counting sort of the items by bucket, buckets[i] ends up as the first entry of bucket i */
+    for(size_t i = 0; i < collect.count; i++)
+        buckets[collect.items[i].hash % num_buckets + 1]++;
+    for(uint64_t i = 0; i < num_buckets; i++)
+        buckets[i + 1] += buckets[i];
+    for(size_t i = 0; i < collect.count; i++)
+    {
+        uint64_t index = collect.items[i].hash % num_buckets;
+        sorted[buckets[index]++] = collect.items[i];
+    }
+    for(uint64_t i = num_buckets; i > 0; i--)    // undo the increments made while scattering
+        buckets[i] = buckets[i - 1];
+    buckets[0] = 0;
+
+    /* lay out the heap, each key followed by its value */
+    for(size_t i = 0; i < collect.count; i++)
+    {
+        entries[i].hash    = sorted[i].hash;
+        entries[i].keylen  = (uint32_t)sorted[i].keylen;
+        entries[i].key_off = heap_len;
+        heap_len = FROZEN_ALIGN(heap_len + sorted[i].keylen);
+
+        entries[i].value_off = heap_len;
+        entries[i].value_len = (value_size && sorted[i].value) ? value_size(sorted[i].value) : 0;
+        heap_len = FROZEN_ALIGN(heap_len + entries[i].value_len);
+    }
+
+    /* the filter only needs each distinct hash once, keys which share a hash share a fingerprint */
+    filter_hashes = malloc((collect.count ? collect.count : 1) * sizeof(uint32_t));
+    if(!filter_hashes)
+        goto cleanup;
+
+    for(size_t i = 0; i < collect.count; i++)
+        filter_hashes[i] = entries[i].hash;
+    qsort(filter_hashes, collect.count, sizeof(uint32_t), _compare_u32);
+    for(size_t i = 0; i < collect.count; i++)
+    {
+        if(i == 0 || filter_hashes[i] != filter_hashes[num_filter_hashes - 1])
+            filter_hashes[num_filter_hashes++] = filter_hashes[i];
+    }
+
+    if(num_filter_hashes <= UINT32_MAX / 2)
+        filter = _xor_filter_build(filter_hashes, num_filter_hashes, &filter_block_length, &filter_seed);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HASHTABLE_FROZEN_MAGIC, sizeof(header.magic));
+    header.version     = HASHTABLE_FROZEN_VERSION;
+    header.seed        = hashtable_seed;
+    header.num_buckets = num_buckets;
+    header.num_items   = collect.count;
+    header.buckets_off = FROZEN_ALIGN(sizeof(header));
+    header.entries_off = header.buckets_off + FROZEN_ALIGN((num_buckets + 1) * sizeof(uint64_t));
+    header.heap_off    = header.entries_off + collect.count * sizeof(hashtable_frozen_entry_t);
+    header.filter_off  = header.heap_off + heap_len;
+    header.filter_block_length = filter ? filter_block_length : 0;
+    header.filter_seed = filter_seed;
+    header.file_size   = header.filter_off + (filter ? 3 * (uint64_t)filter_block_length : 0);
+
+    out = fopen(path, "wb");
+    if(!out)
+        goto cleanup;
+
+    if(_frozen_write_padded(out, &header, sizeof(header)) != 0
+       || _frozen_write_padded(out, buckets, (num_buckets + 1) * sizeof(uint64_t)) != 0
+       || _frozen_write_padded(out, entries, collect.count * sizeof(hashtable_frozen_entry_t)) != 0)
+        goto cleanup;
+
+    for(size_t i = 0; i < collect.count; i++)
+    {
+        if(_frozen_write_padded(out, sorted[i].key, sorted[i].keylen) != 0
+           || _frozen_write_padded(out, sorted[i].value, entries[i].value_len) != 0)
+            goto cleanup;
+    }
+
+    if(filter && fwrite(filter, 1, 3 * (size_t)filter_block_length, out) != 3 * (size_t)filter_block_length)
+        goto cleanup;
+
+    ret = 0;
+
+cleanup:
+    if(out && fclose(out) != 0)
+        ret = -1;
+
+    for(size_t i = 0; collect.copy_keys && i < collect.count; i++)
+        free((char *)collect.items[i].key);
+
+    free(collect.items);
+    free(sorted);
+    free(entries);
+    free(buckets);
+    free(filter_hashes);
+    free(filter);
+
+    return ret;
+}
+
+
+/* _frozen_validate
+ *
+ * Make sure that the header of a mapped image is sane before we trust any of its offsets.
+ * */
+static int _frozen_validate(const hashtable_frozen_header_t *header, size_t size)
+{
+    if(size < sizeof(hashtable_frozen_header_t))
+        return -1;
+
+    if(memcmp(header->magic, HASHTABLE_FROZEN_MAGIC, sizeof(header->magic)) != 0
+       || header->version != HASHTABLE_FROZEN_VERSION)
+        return -1;
+
+    if(header->file_size != size || header->num_buckets == 0)
+        return -1;
+
+    if(header->buckets_off > size || header->entries_off > size || header->heap_off > size)
+        return -1;
+
+    if(header->num_buckets >= (size - header->buckets_off) / sizeof(uint64_t))
+        return -1;
+
+    if(header->num_items > (size - header->entries_off) / sizeof(hashtable_frozen_entry_t))
+        return -1;
+
+    if((header->buckets_off | header->entries_off | header->heap_off) & 7)
+        return -1;
+
+    if(header->filter_off > size || header->filter_block_length > (size - header->filter_off) / 3
+       || header->filter_block_length > UINT32_MAX)
+        return -1;
+
+    return 0;
+}
+
+
+static void _frozen_unmap(const void *base, size_t size)
+{
+#if defined(_WIN32)
+    (void)size;
+    UnmapViewOfFile(base);
+#else
+    munmap((void *)base, size);
+#endif
+}
+
+
+hashtable_mapped_t *hashtable_open_mapped(const char *path)
+{
+    void *base;
+    size_t size;
+    hashtable_mapped_t *mapped;
+
+    if(!path)
+        return NULL;
+
+#if defined(_WIN32)
+    HANDLE file, mapping;
+    LARGE_INTEGER file_size;
+
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    if(!GetFileSizeEx(file, &file_size) || file_size.QuadPart < (LONGLONG)sizeof(hashtable_frozen_header_t)
+       || (uint64_t)file_size.QuadPart > SIZE_MAX)
+    {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if(mapping == NULL)
+        return NULL;
+
+    base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);    // the view holds its own reference to the mapping
+    if(base == NULL)
+        return NULL;
+
+    size = (size_t)file_size.QuadPart;
+#else
+    struct stat st;
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return NULL;
+
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(hashtable_frozen_header_t))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);    // the mapping holds its own reference to the file
+    if(base == MAP_FAILED)
+        return NULL;
+
+    size = (size_t)st.st_size;
+#endif
+
+    mapped = malloc(sizeof(hashtable_mapped_t));
+    if(!mapped || _frozen_validate(base, size) != 0)
+    {
+        free(mapped);
+        _frozen_unmap(base, size);
+        return NULL;
+    }
+
+    mapped->base    = base;
+    mapped->size    = size;
+    mapped->header  = base;
+    mapped->buckets = (const uint64_t *)(mapped->base + mapped->header->buckets_off);
+    mapped->entries = (const hashtable_frozen_entry_t *)(mapped->base + mapped->header->entries_off);
+    mapped->heap    = mapped->base + mapped->header->heap_off;
+    mapped->filter  = mapped->base + mapped->header->filter_off;
+
+    return mapped;
+}
+
+
+int hashtable_close_mapped(hashtable_mapped_t *mapped)
+{
+    if(!mapped)
+        return -1;
+
+    _frozen_unmap(mapped->base, mapped->size);
+    free(mapped);
+
+    return 0;
+}
+
+
+/* _mapped_find
+ *
+ * Find the entry for 'key' in a frozen image, or NULL if there is no such entry.
+ * */
+static const hashtable_frozen_entry_t *_mapped_find(hashtable_mapped_t const *mapped, const char *key, size_t keylen)
+{
+    if(!mapped || !key)
+        return NULL;
+
+    const hashtable_frozen_header_t *header = mapped->header;
+    uint32_t hash = hashlittle(key, keylen, header->seed);
+
+    /* most missing keys stop here, after three bytes of the filter */
+    if(header->filter_block_length)
+    {
+        uint32_t length = (uint32_t)header->filter_block_length;
+        uint64_t h = _xor_hash(hash, header->filter_seed);
+        uint8_t fingerprint = _xor_fingerprint(h);
+
+        for(int i = 0; i < 3; i++)
+            fingerprint ^= mapped->filter[_xor_slot(h, i, length)];
+
+        if(fingerprint != 0)
+            return NULL;
+    }
+
+    uint64_t index = hash % header->num_buckets;
+    uint64_t heap_len = mapped->size - header->heap_off;
+    uint64_t end = mapped->buckets[index + 1];
+
+    if(end > header->num_items)
+        return NULL;    // corrupt image
+
+    for(uint64_t i = mapped->buckets[index]; i < end; i++)
+    {
+        const hashtable_frozen_entry_t *entry = &mapped->entries[i];
+
+        /* compare the stored hash first so that we rarely touch the heap on a miss */
+        if(entry->hash != hash || entry->keylen != keylen)
+            continue;
+
+        if(entry->key_off > heap_len || keylen > heap_len - entry->key_off)
+            return NULL;
+
+        if(memcmp(mapped->heap + entry->key_off, key, keylen) == 0)
+            return entry;
+    }
+
+    return NULL;
+}
+
+
+const void *hashtable_mapped_get(hashtable_mapped_t const *mapped, const char *key, size_t keylen,
+                                 size_t *value_len)
+{
+    const hashtable_frozen_entry_t *entry = _mapped_find(mapped, key, keylen);
+    if(!entry)
+        return NULL;
+
+    if(entry->value_off > mapped->size - mapped->header->heap_off
+       || entry->value_len > mapped->size - mapped->header->heap_off - entry->value_off)
+        return NULL;
+
+    if(value_len)
+        *value_len = entry->value_len;
+
+    return mapped->heap + entry->value_off;
+}
+
+
+int hashtable_mapped_exists_pair(hashtable_mapped_t const *mapped, const char *key, size_t keylen)
+{
+    if(_mapped_find(mapped, key, keylen) != NULL)
+        return 1;
+    return 0;
+}
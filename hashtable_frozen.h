@@ -0,0 +1,105 @@
+/* Frozen (read-only) hashtables.
+ *
+ * A frozen table is a flat, pointer-free image of a hashtable_t that can be written once and then mapped
+ * into any number of processes. Buckets are stored as offsets into a contiguous entry array, and keys and
+ * values live in a single heap, so the image is position-independent and lookups are served straight from
+ * the page cache with no deserialisation step.
+ *
+ * Images also carry an xor filter (8 bit fingerprints, ~9.8 bits per key) which is checked before the bucket
+ * array, so that most lookups for missing keys are answered from three bytes of the mapping.
+ * */
+
+#ifndef JSC_HASH_TABLE_FROZEN_H_
+#define JSC_HASH_TABLE_FROZEN_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "hashtable.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HASHTABLE_FROZEN_MAGIC   "JSCHTFRZ"
+#define HASHTABLE_FROZEN_VERSION 2
+
+typedef struct hashtable_frozen_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t seed;            // the hash seed the image was built with, not that of the reading process
+
+    uint64_t num_buckets;
+    uint64_t num_items;
+
+    uint64_t buckets_off;     // uint64_t[num_buckets + 1], index of the first entry of each bucket
+    uint64_t entries_off;     // hashtable_frozen_entry_t[num_items], grouped by bucket
+    uint64_t heap_off;        // key and value bytes
+    uint64_t file_size;
+
+    uint64_t filter_off;      // uint8_t[3 * filter_block_length] xor filter fingerprints
+    uint64_t filter_block_length;   // 0 if the image has no filter
+    uint64_t filter_seed;
+}hashtable_frozen_header_t;
+
+
+typedef struct hashtable_frozen_entry
+{
+    uint32_t hash;
+    uint32_t keylen;
+    uint64_t key_off;         // offsets are relative to heap_off
+    uint64_t value_off;
+    uint64_t value_len;
+}hashtable_frozen_entry_t;
+
+
+typedef struct hashtable_mapped
+{
+    const unsigned char *base;
+    size_t size;
+
+    const hashtable_frozen_header_t *header;
+    const uint64_t *buckets;
+    const hashtable_frozen_entry_t *entries;
+    const unsigned char *heap;
+    const uint8_t *filter;
+}hashtable_mapped_t;
+
+
+/* hashtable_freeze
+ *
+ * Write the contents of 'table' to the file at 'path' in the frozen format. 'value_size' is called for each value
+ * and should return the number of bytes pointed to by that value which are to be copied into the image. If
+ * 'value_size' is NULL then no value bytes are stored, which is useful for pure key sets.
+ * Returns 0 on success and -1 if not.
+ * */
+int hashtable_freeze(hashtable_t const *table, const char *path, size_t (*value_size)(const void *value));
+
+/* hashtable_open_mapped
+ *
+ * Map the frozen image at 'path' read-only into our address space. Returns NULL if the file could not be
+ * mapped or is not a valid image.
+ * */
+hashtable_mapped_t *hashtable_open_mapped(const char *path);
+int hashtable_close_mapped(hashtable_mapped_t *mapped);
+
+/* hashtable_mapped_get
+ *
+ * Retrieve the value mapped by 'key' from a frozen image, or NULL if there is no such key. The returned pointer
+ * points into the mapping itself and remains valid until hashtable_close_mapped. If 'value_len' is not NULL it
+ * is set to the number of value bytes.
+ * */
+const void *hashtable_mapped_get(hashtable_mapped_t const *mapped, const char *key, size_t keylen,
+                                 size_t *value_len);
+
+/* hashtable_mapped_exists_pair
+ *
+ * Check if the value 'key' is present in a frozen image. If so return 1, if not return 0.
+ * */
+int hashtable_mapped_exists_pair(hashtable_mapped_t const *mapped, const char *key, size_t keylen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSC_HASH_TABLE_FROZEN_H_
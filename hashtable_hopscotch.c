@@ -0,0 +1,310 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "hashtable_internal.h"
+#include "lookup3.h"
+
+extern uint32_t hashtable_seed;
+
+#define hash_str_key(str, len) hashlittle((str), (len), (hashtable_seed))
+
+#define HOP_RANGE  32       // neighbourhood size H, an entry is always within H - 1 slots of its home
+#define ADD_RANGE  512      // how far insertion looks for a free slot before growing instead
+#define GROW_TRIES 4        // doublings a single growth may take before the keys are deemed to collide outright
+
+
+/* hopscotch slots, an empty slot has a NULL key. 'hop' belongs to the slot as a home, not to the entry in it */
+typedef struct hopscotch_slot
+{
+    char *key;
+    void *value;
+    size_t keylen;
+    uint32_t hash;
+    uint32_t hop;       // bit i set if slot (this + i) holds an entry whose home is this slot
+}hopscotch_slot_t;
+
+
+static inline void _hopscotch_move(hopscotch_slot_t *to, hopscotch_slot_t *from)
+{
+    to->key = from->key;
+    to->value = from->value;
+    to->keylen = from->keylen;
+    to->hash = from->hash;
+
+    from->key = NULL;
+}
+
+
+static int _hopscotch_alloc(hashtable_t *table, size_t capacity)
+{
+    size_t size = HOP_RANGE;
+
+    while(size < capacity)
+        size <<= 1;
+
+    table->slots = calloc(size, sizeof(hopscotch_slot_t));
+    if(!table->slots)
+        return -1;
+
+    table->table_size = size;
+
+    return 0;
+}
+
+
+int _hopscotch_init(hashtable_t *table, size_t initial_size)
+{
+    if(table->max_load_factor == 0 || table->max_load_factor > 99)
+        table->max_load_factor = 90;
+
+    return _hopscotch_alloc(table, initial_size);
+}
+
+
+int _hopscotch_destroy(hashtable_t *table, void (*deallocator)(void*))
+{
+    hopscotch_slot_t *slots = table->slots;
+
+    for(size_t i = 0; i < table->table_size; i++)
+    {
+        if(slots[i].key == NULL)
+            continue;
+
+        if(deallocator)
+            deallocator(slots[i].value);
+        free(slots[i].key);
+    }
+
+    free(slots);
+    table->slots = NULL;
+
+    return 0;
+}
+
+
+/* _hopscotch_place
+ *
+ * Place an entry which is not yet in the table. Find the nearest free slot, then while it is outside the home's
+ * neighbourhood, hop it backwards by moving an earlier entry (which stays inside its own neighbourhood) into it.
+ * Returns 0 on success and -1 if no free slot can be brought close enough, in which case the table must grow.
+ * */
+static int _hopscotch_place(hashtable_t *table, hopscotch_slot_t *entry)
+{
+    hopscotch_slot_t *slots = table->slots;
+    size_t mask = table->table_size - 1;
+    size_t home = entry->hash & mask;
+    size_t dist, limit = table->table_size < ADD_RANGE ? table->table_size : ADD_RANGE;
+
+    for(dist = 0; dist < limit; dist++)
+        if(slots[(home + dist) & mask].key == NULL)
+            break;
+
+    if(dist == limit)
+        return -1;
+
+    while(dist >= HOP_RANGE)
+    {
+        size_t free_slot = (home + dist) & mask;
+        int moved = 0;
+
+        /* the homes whose neighbourhood reaches the free slot, furthest first so that it hops as far as possible */
+        for(size_t back = HOP_RANGE - 1; back > 0 && !moved; back--)
+        {
+            size_t candidate = (free_slot - back) & mask;
+            uint32_t hop = slots[candidate].hop;
+
+            for(size_t i = 0; i < back; i++)
+            {
+                if(!(hop & ((uint32_t)1 << i)))
+                    continue;
+
+                /* the earliest of its entries before the free slot */
+                _hopscotch_move(&slots[free_slot], &slots[(candidate + i) & mask]);
+                slots[candidate].hop = (hop & ~((uint32_t)1 << i)) | ((uint32_t)1 << back);
+
+                dist -= back - i;
+                moved = 1;
+                break;
+            }
+        }
+
+        if(!moved)
+            return -1;
+    }
+
+    _hopscotch_move(&slots[(home + dist) & mask], entry);
+    slots[home].hop |= (uint32_t)1 << dist;
+
+    return 0;
+}
+
+
+/* _hopscotch_grow
+ *
+ * Rehash into an array at least twice the size. A placement can fail even then, if too many keys share a
+ * neighbourhood, so we keep doubling (up to GROW_TRIES times) until everything fits. On failure nothing has changed.
+ * */
+static int _hopscotch_grow(hashtable_t *table)
+{
+    hopscotch_slot_t *old_slots = table->slots;
+    size_t old_size = table->table_size;
+
+    size_t new_size = old_size * HASHTABLE_GROWTH_FACTOR;
+
+    for(int tries = 0; tries < GROW_TRIES && new_size > old_size; tries++, new_size *= 2)
+    {
+        int ok = 1;
+
+        if(_hopscotch_alloc(table, new_size) != 0)
+            break;
+
+        for(size_t i = 0; i < old_size && ok; i++)
+        {
+            if(old_slots[i].key != NULL)
+            {
+                hopscotch_slot_t entry = old_slots[i];      // placing consumes the copy, not the old slot
+                ok = _hopscotch_place(table, &entry) == 0;
+            }
+        }
+
+        if(ok)
+        {
+            free(old_slots);
+            return 0;
+        }
+
+        free(table->slots);
+    }
+
+    table->slots = old_slots;
+    table->table_size = old_size;
+
+    return -1;
+}
+
+
+/* _hopscotch_find
+ *
+ * Return the slot holding 'key', whose hash is 'hash', or NULL. Only the slots named by the home's bitmap are
+ * looked at, all within H slots of it.
+ * */
+static hopscotch_slot_t *_hopscotch_find(hashtable_t const *table, const char *key, size_t keylen, uint32_t hash)
+{
+    hopscotch_slot_t *slots = table->slots;
+    size_t mask = table->table_size - 1;
+    size_t home = hash & mask;
+
+    for(uint32_t hop = slots[home].hop; hop != 0; hop &= hop - 1)
+    {
+        hopscotch_slot_t *slot = &slots[(home + (size_t)_lowest_set_bit(hop)) & mask];
+
+        if(slot->hash == hash && slot->keylen == keylen && memcmp(slot->key, key, keylen) == 0)
+            return slot;
+    }
+
+    return NULL;
+}
+
+
+int _hopscotch_set(hashtable_t *table, const char *key, size_t keylen, void *value, uint32_t replace,
+                   void (*deallocator)(void*))
+{
+    uint32_t hash = hash_str_key(key, keylen);
+    hopscotch_slot_t *slot = _hopscotch_find(table, key, keylen, hash);
+    hopscotch_slot_t entry;
+
+    if(slot != NULL)
+    {
+        if(!replace)
+            return -1;
+
+        if(deallocator)
+            deallocator(slot->value);
+        slot->value = value;
+
+        return 0;
+    }
+
+    if((table->num_items + 1) * 100 > table->table_size * table->max_load_factor)
+        _hopscotch_grow(table);     // still fine if this fails, until a key finds no place at all
+
+    entry.key = malloc(keylen + 1);
+    if(!entry.key)
+        return -1;
+
+    memcpy(entry.key, key, keylen);
+    entry.key[keylen] = '\0';
+    entry.value = value;
+    entry.keylen = keylen;
+    entry.hash = hash;
+
+    /* more than H keys with the same home cannot be placed at any size, so only one growth is worth trying */
+    if(_hopscotch_place(table, &entry) != 0
+       && (_hopscotch_grow(table) != 0 || _hopscotch_place(table, &entry) != 0))
+    {
+        free(entry.key);
+        return -1;
+    }
+
+    table->num_items++;
+
+    return 0;
+}
+
+
+const void *_hopscotch_get(hashtable_t const *table, const char *key, size_t keylen)
+{
+    hopscotch_slot_t *slot = _hopscotch_find(table, key, keylen, hash_str_key(key, keylen));
+
+    return slot ? slot->value : NULL;
+}
+
+
+int _hopscotch_exists_pair(hashtable_t const *table, const char *key, size_t keylen)
+{
+    return _hopscotch_find(table, key, keylen, hash_str_key(key, keylen)) != NULL;
+}
+
+
+int _hopscotch_remove(hashtable_t *table, const char *key, size_t keylen, void (*deallocator)(void*))
+{
+    hopscotch_slot_t *slots = table->slots;
+    hopscotch_slot_t *slot = _hopscotch_find(table, key, keylen, hash_str_key(key, keylen));
+    size_t mask = table->table_size - 1;
+
+    if(slot == NULL)
+        return -1;
+
+    size_t home = slot->hash & mask;
+    size_t dist = ((size_t)(slot - slots) - home) & mask;
+
+    if(deallocator)
+        deallocator(slot->value);
+    free(slot->key);
+
+    slot->key = NULL;
+    slots[home].hop &= ~((uint32_t)1 << dist);
+    table->num_items--;
+
+    return 0;
+}
+
+
+int _hopscotch_foreach(hashtable_t const *table, int (*fn)(const char *key, size_t keylen, void *value, void *ctx),
+                       void *ctx)
+{
+    hopscotch_slot_t *slots = table->slots;
+    int ret;
+
+    for(size_t i = 0; i < table->table_size; i++)
+    {
+        if(slots[i].key == NULL)
+            continue;
+
+        ret = fn(slots[i].key, slots[i].keylen, slots[i].value, ctx);
+        if(ret != 0)
+            return ret;
+    }
+
+    return 0;
+}
@@ -0,0 +1,107 @@
+/* Internal interface between hashtable.c and the alternative storage backends (see hashtable_create_backend).
+ *
+ * Each backend keeps its own storage in table->slots, sized by table->table_size in whatever unit it uses, and
+ * implements the operations below. hashtable.c dispatches to them on table->backend, and handles everything else
+ * itself.
+ * */
+
+#ifndef JSC_HASH_TABLE_INTERNAL_H_
+#define JSC_HASH_TABLE_INTERNAL_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "hashtable.h"
+#include "hashtable_keypool.h"
+
+/* _lowest_set_bit
+ *
+ * Index of the lowest set bit in a non-zero word.
+ * */
+static inline uint32_t _lowest_set_bit(uint64_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (uint32_t)__builtin_ctzll(word);
+#else
+    uint32_t index = 0;
+    while(!(word & 1))
+    {
+        word >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+
+/* _highest_set_bit
+ *
+ * Index of the highest set bit in a non-zero word.
+ * */
+static inline uint32_t _highest_set_bit(uint64_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - (uint32_t)__builtin_clzll(word);
+#else
+    uint32_t index = 0;
+    while(word >>= 1)
+        index++;
+    return index;
+#endif
+}
+
+
+/* hashtable_robinhood.c */
+int _robinhood_init(hashtable_t *table, size_t initial_size);
+int _robinhood_destroy(hashtable_t *table, void (*deallocator)(void*));
+int _robinhood_set(hashtable_t *table, const char *key, size_t keylen, void *value, uint32_t replace,
+                   void (*deallocator)(void*));
+const void *_robinhood_get(hashtable_t const *table, const char *key, size_t keylen);
+int _robinhood_exists_pair(hashtable_t const *table, const char *key, size_t keylen);
+int _robinhood_remove(hashtable_t *table, const char *key, size_t keylen, void (*deallocator)(void*));
+int _robinhood_foreach(hashtable_t const *table, int (*fn)(const char *key, size_t keylen, void *value, void *ctx),
+                       void *ctx);
+
+/* hashtable_cuckoo.c, table_size counts buckets of 4 slots */
+int _cuckoo_init(hashtable_t *table, size_t initial_size);
+int _cuckoo_destroy(hashtable_t *table, void (*deallocator)(void*));
+int _cuckoo_set(hashtable_t *table, const char *key, size_t keylen, void *value, uint32_t replace,
+                void (*deallocator)(void*));
+const void *_cuckoo_get(hashtable_t const *table, const char *key, size_t keylen);
+int _cuckoo_exists_pair(hashtable_t const *table, const char *key, size_t keylen);
+int _cuckoo_remove(hashtable_t *table, const char *key, size_t keylen, void (*deallocator)(void*));
+int _cuckoo_foreach(hashtable_t const *table, int (*fn)(const char *key, size_t keylen, void *value, void *ctx),
+                    void *ctx);
+
+/* hashtable_hopscotch.c */
+int _hopscotch_init(hashtable_t *table, size_t initial_size);
+int _hopscotch_destroy(hashtable_t *table, void (*deallocator)(void*));
+int _hopscotch_set(hashtable_t *table, const char *key, size_t keylen, void *value, uint32_t replace,
+                   void (*deallocator)(void*));
+const void *_hopscotch_get(hashtable_t const *table, const char *key, size_t keylen);
+int _hopscotch_exists_pair(hashtable_t const *table, const char *key, size_t keylen);
+int _hopscotch_remove(hashtable_t *table, const char *key, size_t keylen, void (*deallocator)(void*));
+int _hopscotch_foreach(hashtable_t const *table, int (*fn)(const char *key, size_t keylen, void *value, void *ctx),
+                       void *ctx);
+
+/* hashtable_cacheline.c, table_size counts buckets, max_load_factor is items per bucket */
+int _cacheline_init(hashtable_t *table, size_t initial_size);
+int _cacheline_destroy(hashtable_t *table, void (*deallocator)(void*));
+int _cacheline_set(hashtable_t *table, const char *key, size_t keylen, void *value, uint32_t replace,
+                   void (*deallocator)(void*));
+const void *_cacheline_get(hashtable_t const *table, const char *key, size_t keylen);
+int _cacheline_exists_pair(hashtable_t const *table, const char *key, size_t keylen);
+int _cacheline_remove(hashtable_t *table, const char *key, size_t keylen, void (*deallocator)(void*));
+int _cacheline_foreach(hashtable_t const *table, int (*fn)(const char *key, size_t keylen, void *value, void *ctx),
+                       void *ctx);
+
+/* hashtable_keypool.c, a key acquired once per item holding it is released when that item is destroyed */
+char *_keypool_acquire(hashtable_keypool_t *pool, const char *key, size_t keylen, uint32_t hash);
+void _keypool_release(hashtable_keypool_t *pool, char *key);
+size_t _keypool_keylen(const char *key);
+
+/* the same without taking the pool's lock, for a pool private to one table (its key prefixes) */
+char *_keypool_acquire_unlocked(hashtable_keypool_t *pool, const char *key, size_t keylen, uint32_t hash);
+char *_keypool_retain_unlocked(char *key);
+void _keypool_release_unlocked(hashtable_keypool_t *pool, char *key);
+
+#endif // JSC_HASH_TABLE_INTERNAL_H_
@@ -0,0 +1,262 @@
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "hashtable.h"
+#include "hashtable_internal.h"
+#include "hashtable_keypool.h"
+#include "lookup3.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+extern uint32_t hashtable_seed;
+
+#define hash_str_key(str, len) hashlittle((str), (len), (hashtable_seed))
+
+
+typedef struct keypool_entry
+{
+    struct keypool_entry *next;
+    size_t refcount;        // items holding the key, across all tables
+    size_t keylen;
+    uint32_t hash;          // the same hash the tables use, so interning never rehashes
+    char key[];             // null terminated, the pointer handed out to items
+}keypool_entry_t;
+
+
+struct hashtable_keypool
+{
+    size_t table_size;      // always a power of two
+    size_t num_keys;
+    keypool_entry_t **buckets;
+
+#ifdef HAVE_PTHREAD
+    pthread_mutex_t lock;
+#endif
+};
+
+
+static inline void _keypool_lock(hashtable_keypool_t *pool)
+{
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&pool->lock);
+#else
+    (void)pool;
+#endif
+}
+
+
+static inline void _keypool_unlock(hashtable_keypool_t *pool)
+{
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&pool->lock);
+#else
+    (void)pool;
+#endif
+}
+
+
+static inline keypool_entry_t *_keypool_entry(const char *key)
+{
+    return (keypool_entry_t *)(key - offsetof(keypool_entry_t, key));
+}
+
+
+hashtable_keypool_t *hashtable_keypool_create(size_t initial_size)
+{
+    hashtable_keypool_t *pool = malloc(sizeof(hashtable_keypool_t));
+    if(!pool)
+        return NULL;
+
+    pool->table_size = 2;
+    while(pool->table_size < initial_size)
+        pool->table_size <<= 1;
+
+    pool->num_keys = 0;
+    pool->buckets = calloc(pool->table_size, sizeof(keypool_entry_t*));
+    if(!pool->buckets)
+    {
+        free(pool);
+        return NULL;
+    }
+
+#ifdef HAVE_PTHREAD
+    if(pthread_mutex_init(&pool->lock, NULL) != 0)
+    {
+        free(pool->buckets);
+        free(pool);
+        return NULL;
+    }
+#endif
+
+    return pool;
+}
+
+
+int hashtable_keypool_destroy(hashtable_keypool_t *pool)
+{
+    if(!pool || pool->num_keys != 0)
+        return -1;
+
+#ifdef HAVE_PTHREAD
+    pthread_mutex_destroy(&pool->lock);
+#endif
+    free(pool->buckets);
+    free(pool);
+
+    return 0;
+}
+
+
+/* a failed growth just leaves the chains longer */
+static void _keypool_grow(hashtable_keypool_t *pool)
+{
+    size_t size = pool->table_size * HASHTABLE_GROWTH_FACTOR;
+    keypool_entry_t **buckets = calloc(size, sizeof(keypool_entry_t*)), *entry, *next;
+
+    if(!buckets)
+        return;
+
+    for(size_t i = 0; i < pool->table_size; i++)
+    {
+        for(entry = pool->buckets[i]; entry != NULL; entry = next)
+        {
+            next = entry->next;
+            entry->next = buckets[entry->hash & (size - 1)];
+            buckets[entry->hash & (size - 1)] = entry;
+        }
+    }
+
+    free(pool->buckets);
+    pool->buckets = buckets;
+    pool->table_size = size;
+}
+
+
+/* the key may already be the pool's own copy, in which case the pointers match and the bytes are never read */
+static keypool_entry_t *_keypool_find(hashtable_keypool_t const *pool, const char *key, size_t keylen, uint32_t hash)
+{
+    for(keypool_entry_t *entry = pool->buckets[hash & (pool->table_size - 1)]; entry != NULL; entry = entry->next)
+    {
+        if(entry->hash == hash && entry->keylen == keylen
+           && (entry->key == key || memcmp(entry->key, key, keylen) == 0))
+            return entry;
+    }
+
+    return NULL;
+}
+
+
+char *_keypool_acquire_unlocked(hashtable_keypool_t *pool, const char *key, size_t keylen, uint32_t hash)
+{
+    keypool_entry_t *entry = _keypool_find(pool, key, keylen, hash);
+
+    if(entry != NULL)
+    {
+        entry->refcount++;
+        return entry->key;
+    }
+
+    entry = malloc(sizeof(keypool_entry_t) + keylen + 1);
+    if(!entry)
+        return NULL;
+
+    memcpy(entry->key, key, keylen);
+    entry->key[keylen] = '\0';
+    entry->keylen = keylen;
+    entry->hash = hash;
+    entry->refcount = 1;
+
+    entry->next = pool->buckets[hash & (pool->table_size - 1)];
+    pool->buckets[hash & (pool->table_size - 1)] = entry;
+    pool->num_keys++;
+
+    if(pool->num_keys > pool->table_size)
+        _keypool_grow(pool);
+
+    return entry->key;
+}
+
+
+char *_keypool_acquire(hashtable_keypool_t *pool, const char *key, size_t keylen, uint32_t hash)
+{
+    char *pooled;
+
+    _keypool_lock(pool);
+    pooled = _keypool_acquire_unlocked(pool, key, keylen, hash);
+    _keypool_unlock(pool);
+
+    return pooled;
+}
+
+
+/* take another reference to a key already held, which needs no lookup */
+char *_keypool_retain_unlocked(char *key)
+{
+    _keypool_entry(key)->refcount++;
+
+    return key;
+}
+
+
+void _keypool_release_unlocked(hashtable_keypool_t *pool, char *key)
+{
+    keypool_entry_t *entry = _keypool_entry(key), **link;
+
+    if(--entry->refcount != 0)
+        return;
+
+    for(link = &pool->buckets[entry->hash & (pool->table_size - 1)]; *link != entry; link = &(*link)->next)
+        ;
+
+    *link = entry->next;
+    pool->num_keys--;
+    free(entry);
+}
+
+
+void _keypool_release(hashtable_keypool_t *pool, char *key)
+{
+    _keypool_lock(pool);
+    _keypool_release_unlocked(pool, key);
+    _keypool_unlock(pool);
+}
+
+
+/* no lock needed, an entry never changes while a reference to it is held */
+size_t _keypool_keylen(const char *key)
+{
+    return _keypool_entry(key)->keylen;
+}
+
+
+const char *hashtable_keypool_lookup(hashtable_keypool_t *pool, const char *key, size_t keylen)
+{
+    keypool_entry_t *entry;
+
+    if(!pool || !key)
+        return NULL;
+
+    _keypool_lock(pool);
+    entry = _keypool_find(pool, key, keylen, hash_str_key(key, keylen));
+    _keypool_unlock(pool);
+
+    return entry ? entry->key : NULL;
+}
+
+
+size_t hashtable_keypool_size(hashtable_keypool_t *pool)
+{
+    size_t size;
+
+    if(!pool)
+        return 0;
+
+    _keypool_lock(pool);
+    size = pool->num_keys;
+    _keypool_unlock(pool);
+
+    return size;
+}
@@ -0,0 +1,57 @@
+/* Shared key pools.
+ *
+ * When the same keys (user or session IDs, say) are held by many tables, each table would otherwise keep its own
+ * copy of every key. A key pool keeps one reference counted copy of each key instead, shared by all the tables
+ * attached to it with hashtable_set_keypool. A key is freed once the last item holding it is destroyed.
+ *
+ * Since tables sharing a pool also share key pointers, a key taken from one of them (by hashtable_foreach, or
+ * hashtable_keypool_lookup) and passed to another compares equal by pointer alone, without reading its bytes.
+ *
+ * The pool is locked when built with HAVE_PTHREAD, so tables sharing it may be used from different threads
+ * (each table still by one thread at a time).
+ * */
+
+#ifndef JSC_HASH_TABLE_KEYPOOL_H_
+#define JSC_HASH_TABLE_KEYPOOL_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct hashtable_keypool hashtable_keypool_t;
+
+
+/* hashtable_keypool_create
+ *
+ * Create an empty pool with room for about 'initial_size' keys before it grows. Returns NULL if this process fails.
+ * */
+hashtable_keypool_t *hashtable_keypool_create(size_t initial_size);
+
+/* hashtable_keypool_destroy
+ *
+ * Destroy the pool. Every table attached to it must have been destroyed first (or emptied), otherwise nothing is
+ * done. Will return 0 on success and -1 if not.
+ * */
+int hashtable_keypool_destroy(hashtable_keypool_t *pool);
+
+/* hashtable_keypool_lookup
+ *
+ * Return the pool's copy of 'key' (null terminated), or NULL if no table holds it. The copy stays valid for as
+ * long as some table holds the key.
+ * */
+const char *hashtable_keypool_lookup(hashtable_keypool_t *pool, const char *key, size_t keylen);
+
+/* hashtable_keypool_size
+ *
+ * The number of distinct keys in the pool.
+ * */
+size_t hashtable_keypool_size(hashtable_keypool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSC_HASH_TABLE_KEYPOOL_H_
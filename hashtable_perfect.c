@@ -0,0 +1,387 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "hashtable_perfect.h"
+#include "lookup3.h"
+
+extern uint32_t hashtable_seed;
+
+#define PERFECT_MAX_PILOT UINT16_MAX
+
+
+typedef struct perfect_key
+{
+    uint64_t hash;        // 64 bits of hash so that keys within a bucket rarely collide
+    size_t bucket;
+    const char *key;
+    size_t keylen;
+    void *value;
+}perfect_key_t;
+
+
+typedef struct perfect_collect
+{
+    perfect_key_t *keys;
+    size_t count;
+    size_t capacity;
+    int copy_keys;        // the table rebuilds its keys for each callback (key prefixes), so we keep copies
+}perfect_collect_t;
+
+
+/* _perfect_mix
+ *
+ * 64 bit finaliser (from murmur3), used to spread both key hashes and pilots over the slots.
+ * */
+static inline uint64_t _perfect_mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+
+    return x;
+}
+
+
+/* _perfect_hash
+ *
+ * 64 bits of key hash from a single pass over the key, hashlittle2 returning two 32 bit results.
+ * */
+static inline uint64_t _perfect_hash(const char *key, size_t keylen, uint32_t seed)
+{
+    uint32_t high = seed, low = seed ^ 0x9e3779b9;
+
+    hashlittle2(key, keylen, &high, &low);
+
+    return _perfect_mix(((uint64_t)high << 32) | low);
+}
+
+
+/* _perfect_bucket
+ *
+ * Skewed bucket assignment: 60% of the keys land in the first 30% of the buckets, so that the big buckets are
+ * placed while the table is still mostly empty (see the PTHash paper).
+ * */
+static inline size_t _perfect_bucket(hashtable_perfect_t const *perfect, uint64_t hash)
+{
+    uint64_t top = hash >> 32;
+
+    if((top & 0xff) < 154)
+        return (size_t)((top >> 8) % perfect->num_dense);
+
+    return perfect->num_dense + (size_t)((top >> 8) % (perfect->num_buckets - perfect->num_dense));
+}
+
+
+/* _perfect_slot
+ *
+ * The pilot is mixed in before the hash is reduced to a slot. Were 'hash ^ f(pilot)' reduced directly, two keys
+ * whose hashes share their low bits would land on the same slot for every pilot whenever the slot count is a power
+ * of two (8 for 7 keys), and their bucket could then never be placed.
+ * */
+static inline size_t _perfect_slot(hashtable_perfect_t const *perfect, uint64_t hash, uint16_t pilot)
+{
+    return (size_t)(_perfect_mix(hash ^ ((uint64_t)(pilot + 1) * 0x9e3779b97f4a7c15ULL)) % perfect->num_slots);
+}
+
+
+static int _perfect_collect_item(const char *key, size_t keylen, void *value, void *ctx)
+{
+    perfect_collect_t *collect = ctx;
+
+    if(collect->count == collect->capacity)
+    {
+        size_t new_capacity = collect->capacity ? collect->capacity * 2 : 64;
+        perfect_key_t *temp = realloc(collect->keys, new_capacity * sizeof(perfect_key_t));
+        if(!temp)
+            return -1;
+
+        collect->keys = temp;
+        collect->capacity = new_capacity;
+    }
+
+    if(collect->copy_keys)
+    {
+        char *copy = malloc(keylen + 1);
+        if(!copy)
+            return -1;
+
+        memcpy(copy, key, keylen + 1);
+        key = copy;
+    }
+
+    collect->keys[collect->count].key    = key;
+    collect->keys[collect->count].keylen = keylen;
+    collect->keys[collect->count].value  = value;
+    collect->count++;
+
+    return 0;
+}
+
+
+/* _perfect_search_pilots
+ *
+ * Try to place every bucket with the current seed. 'slots' receives the key index placed at each slot.
+ * Return 0 if every bucket found a pilot, -1 if not (the caller then retries with another seed).
+ * */
+static int _perfect_search_pilots(hashtable_perfect_t *perfect, perfect_collect_t *collect, size_t *slots)
+{
+    size_t n = collect->count;
+    size_t max_size = 0;
+    size_t *bucket_start = NULL, *order = NULL, *by_bucket = NULL, *size_start = NULL;
+    size_t placed[64];
+    uint8_t *taken = NULL;
+    int ret = -1;
+
+    for(size_t i = 0; i < n; i++)
+    {
+        collect->keys[i].hash   = _perfect_hash(collect->keys[i].key, collect->keys[i].keylen, perfect->seed);
+        collect->keys[i].bucket = _perfect_bucket(perfect, collect->keys[i].hash);
+    }
+
+    bucket_start = calloc(perfect->num_buckets + 1, sizeof(size_t));
+    by_bucket    = malloc((n ? n : 1) * sizeof(size_t));
+    order        = malloc(perfect->num_buckets * sizeof(size_t));
+    taken        = calloc(perfect->num_slots, 1);
+    if(!bucket_start || !by_bucket || !order || !taken)
+        goto cleanup;
+
+    /* group the keys by bucket */
+    for(size_t i = 0; i < n; i++)
+        bucket_start[collect->keys[i].bucket + 1]++;
+    for(size_t b = 0; b < perfect->num_buckets; b++)
+    {
+        bucket_start[b + 1] += bucket_start[b];
+        if(bucket_start[b + 1] - bucket_start[b] > max_size)
+            max_size = bucket_start[b + 1] - bucket_start[b];
+    }
+    if(max_size > sizeof(placed) / sizeof(placed[0]))
+        goto cleanup;    // absurdly skewed, try another seed
+
+    memcpy(order, bucket_start, perfect->num_buckets * sizeof(size_t));
+    for(size_t i = 0; i < n; i++)
+        by_bucket[order[collect->keys[i].bucket]++] = i;    // 'order' is just a fill cursor for now
+
+    /* now order the buckets by decreasing size (counting sort) */
+    size_start = calloc(max_size + 2, sizeof(size_t));
+    if(!size_start)
+        goto cleanup;
+
+    for(size_t b = 0; b < perfect->num_buckets; b++)
+        size_start[max_size - (bucket_start[b + 1] - bucket_start[b]) + 1]++;
+    for(size_t s = 0; s <= max_size; s++)
+        size_start[s + 1] += size_start[s];
+    for(size_t b = 0; b < perfect->num_buckets; b++)
+        order[size_start[max_size - (bucket_start[b + 1] - bucket_start[b])]++] = b;
+
+    for(size_t o = 0; o < perfect->num_buckets; o++)
+    {
+        size_t b = order[o];
+        size_t first = bucket_start[b], size = bucket_start[b + 1] - first;
+        uint32_t pilot;
+
+        if(size == 0)
+        {
+            perfect->pilots[b] = 0;
+            continue;
+        }
+
+        for(pilot = 0; pilot <= PERFECT_MAX_PILOT; pilot++)
+        {
+            size_t k;
+            for(k = 0; k < size; k++)
+            {
+                size_t slot = _perfect_slot(perfect, collect->keys[by_bucket[first + k]].hash, (uint16_t)pilot);
+                if(taken[slot])
+                    break;
+
+                taken[slot] = 1;      // claim it now, so that keys in the same bucket cannot share a slot
+                placed[k] = slot;
+            }
+
+            if(k == size)
+                break;               // every key found a free slot
+
+            while(k > 0)             // release whatever this pilot claimed and try the next one
+                taken[placed[--k]] = 0;
+        }
+
+        if(pilot > PERFECT_MAX_PILOT)
+            goto cleanup;
+
+        perfect->pilots[b] = (uint16_t)pilot;
+        for(size_t k = 0; k < size; k++)
+            slots[placed[k]] = by_bucket[first + k];
+    }
+
+    ret = 0;
+
+cleanup:
+    free(bucket_start);
+    free(by_bucket);
+    free(order);
+    free(size_start);
+    free(taken);
+
+    return ret;
+}
+
+
+static void _perfect_collect_free(perfect_collect_t *collect)
+{
+    for(size_t i = 0; collect->copy_keys && i < collect->count; i++)
+        free((char *)collect->keys[i].key);
+
+    free(collect->keys);
+}
+
+
+hashtable_perfect_t *hashtable_build_perfect(hashtable_t const *table)
+{
+    perfect_collect_t collect = {NULL, 0, 0, 0};
+    hashtable_perfect_t *perfect;
+    size_t *slots = NULL;
+    size_t heap_len = 0, hole = 0;
+    char *heap_pos;
+
+    if(!table)
+        return NULL;
+
+    perfect = calloc(1, sizeof(hashtable_perfect_t));
+    if(!perfect)
+        return NULL;
+
+    collect.copy_keys = table->prefixes != NULL;
+    if(hashtable_foreach(table, _perfect_collect_item, &collect) != 0)
+        goto fail;
+
+    perfect->num_items   = collect.count;
+    perfect->num_slots   = collect.count + collect.count / HASHTABLE_PERFECT_ALPHA + 1;
+    perfect->num_buckets = collect.count / HASHTABLE_PERFECT_BUCKET_SIZE + 2;
+    perfect->num_dense   = perfect->num_buckets * 3 / 10 + 1;
+
+    perfect->pilots  = malloc(perfect->num_buckets * sizeof(uint16_t));
+    perfect->remap   = calloc(perfect->num_slots - perfect->num_items, sizeof(uint32_t)); // unused slots -> 0
+    perfect->entries = malloc((collect.count ? collect.count : 1) * sizeof(hashtable_perfect_entry_t));
+    slots = malloc(perfect->num_slots * sizeof(size_t));
+    if(!perfect->pilots || !perfect->remap || !perfect->entries || !slots || perfect->num_slots > UINT32_MAX)
+        goto fail;
+
+    perfect->seed = hashtable_seed;
+    for(int attempt = 0; ; attempt++)
+    {
+        if(attempt == HASHTABLE_PERFECT_MAX_ATTEMPTS)
+            goto fail;
+
+        for(size_t s = 0; s < perfect->num_slots; s++)
+            slots[s] = SIZE_MAX;
+
+        if(_perfect_search_pilots(perfect, &collect, slots) == 0)
+            break;
+
+        perfect->seed = perfect->seed * 0x9e3779b1u + 1;    // different seed, different buckets
+    }
+
+    /* copy the keys into one contiguous heap */
+    for(size_t i = 0; i < collect.count; i++)
+        heap_len += collect.keys[i].keylen;
+
+    perfect->key_heap = malloc(heap_len ? heap_len : 1);
+    if(!perfect->key_heap)
+        goto fail;
+
+    /* slots past num_items are moved onto the holes below it, in order, making the function minimal */
+    heap_pos = perfect->key_heap;
+    for(size_t s = 0; s < perfect->num_slots; s++)
+    {
+        size_t dest = s;
+        if(slots[s] == SIZE_MAX)
+            continue;
+
+        if(s >= perfect->num_items)
+        {
+            while(slots[hole] != SIZE_MAX)
+                hole++;
+
+            dest = hole++;
+            perfect->remap[s - perfect->num_items] = (uint32_t)dest;
+        }
+
+        perfect_key_t *key = &collect.keys[slots[s]];
+        memcpy(heap_pos, key->key, key->keylen);
+        perfect->entries[dest].key    = heap_pos;
+        perfect->entries[dest].keylen = key->keylen;
+        perfect->entries[dest].value  = key->value;
+        heap_pos += key->keylen;
+    }
+
+    free(slots);
+    _perfect_collect_free(&collect);
+
+    return perfect;
+
+fail:
+    free(slots);
+    _perfect_collect_free(&collect);
+    hashtable_perfect_destroy(perfect);
+
+    return NULL;
+}
+
+
+int hashtable_perfect_destroy(hashtable_perfect_t *perfect)
+{
+    if(!perfect)
+        return -1;
+
+    free(perfect->pilots);
+    free(perfect->remap);
+    free(perfect->entries);
+    free(perfect->key_heap);
+    free(perfect);
+
+    return 0;
+}
+
+
+/* _perfect_find
+ *
+ * One hash, one slot, one key comparison.
+ * */
+static const hashtable_perfect_entry_t *_perfect_find(hashtable_perfect_t const *perfect, const char *key,
+                                                      size_t keylen)
+{
+    if(!perfect || !key || !perfect->num_items)
+        return NULL;
+
+    uint64_t hash = _perfect_hash(key, keylen, perfect->seed);
+    size_t slot = _perfect_slot(perfect, hash, perfect->pilots[_perfect_bucket(perfect, hash)]);
+
+    if(slot >= perfect->num_items)
+        slot = perfect->remap[slot - perfect->num_items];
+
+    const hashtable_perfect_entry_t *entry = &perfect->entries[slot];
+    if(entry->keylen != keylen || memcmp(entry->key, key, keylen) != 0)
+        return NULL;     // not one of our keys
+
+    return entry;
+}
+
+
+const void *hashtable_perfect_get(hashtable_perfect_t const *perfect, const char *key, size_t keylen)
+{
+    const hashtable_perfect_entry_t *entry = _perfect_find(perfect, key, keylen);
+    if(!entry)
+        return NULL;
+
+    return entry->value;
+}
+
+
+int hashtable_perfect_exists_pair(hashtable_perfect_t const *perfect, const char *key, size_t keylen)
+{
+    if(_perfect_find(perfect, key, keylen) != NULL)
+        return 1;
+    return 0;
+}
@@ -0,0 +1,73 @@
+/* Minimal perfect hashtables.
+ *
+ * For tables which are static once loaded we can build a minimal perfect hash function over the current keys
+ * (PTHash style: keys are split into small buckets and each bucket searches for a 'pilot' which sends all of
+ * its keys to free slots). Lookups then cost exactly one probe and one key comparison, and the index itself
+ * takes around 3.5 bits per key.
+ * */
+
+#ifndef JSC_HASH_TABLE_PERFECT_H_
+#define JSC_HASH_TABLE_PERFECT_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "hashtable.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HASHTABLE_PERFECT_BUCKET_SIZE 5       // average keys per pilot bucket
+#define HASHTABLE_PERFECT_ALPHA       99      // percentage of slots filled before remapping
+#define HASHTABLE_PERFECT_MAX_ATTEMPTS 16     // build seeds to try before giving up
+
+typedef struct hashtable_perfect_entry
+{
+    const char *key;       // points into the table's key heap
+    size_t keylen;
+    void *value;
+}hashtable_perfect_entry_t;
+
+
+typedef struct hashtable_perfect
+{
+    size_t num_items;
+    size_t num_slots;      // num_items / alpha, the range the pilots hash into
+    size_t num_buckets;
+    size_t num_dense;      // buckets[0..num_dense) receive 60% of the keys
+
+    uint32_t seed;
+    uint16_t *pilots;      // one per bucket
+    uint32_t *remap;       // slots >= num_items, mapped onto the holes left below num_items
+
+    hashtable_perfect_entry_t *entries;
+    char *key_heap;
+}hashtable_perfect_t;
+
+
+/* hashtable_build_perfect
+ *
+ * Build an immutable minimal perfect hashtable containing every (key, value) pair of 'table'. Keys are copied
+ * but the values are shared with 'table', so it remains our caller's job to destroy them.
+ * Returns NULL if the build fails.
+ * */
+hashtable_perfect_t *hashtable_build_perfect(hashtable_t const *table);
+int hashtable_perfect_destroy(hashtable_perfect_t *perfect);
+
+/* hashtable_perfect_get
+ *
+ * Retrieve the item in our perfect hashtable mapped by 'key' if such a value exists. Return NULL if not.
+ * */
+const void *hashtable_perfect_get(hashtable_perfect_t const *perfect, const char *key, size_t keylen);
+
+/* hashtable_perfect_exists_pair
+ *
+ * Check if the value 'key' is mapped to a value in our perfect hashtable. If so return 1, if not return 0.
+ * */
+int hashtable_perfect_exists_pair(hashtable_perfect_t const *perfect, const char *key, size_t keylen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSC_HASH_TABLE_PERFECT_H_
@@ -0,0 +1,257 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "hashtable_internal.h"
+#include "lookup3.h"
+
+extern uint32_t hashtable_seed;
+
+#define hash_str_key(str, len) hashlittle((str), (len), (hashtable_seed))
+
+
+/* Robin Hood slots, an empty slot has a NULL key */
+typedef struct robinhood_slot
+{
+    char *key;
+    void *value;
+    size_t keylen;
+    uint32_t hash;
+    uint32_t dist;      // how far the slot is from the key's home slot
+}robinhood_slot_t;
+
+
+static inline size_t _robinhood_mask(hashtable_t const *table)
+{
+    return table->table_size - 1;
+}
+
+
+static int _robinhood_alloc(hashtable_t *table, size_t capacity)
+{
+    size_t size = 8;
+
+    while(size < capacity)
+        size <<= 1;
+
+    table->slots = calloc(size, sizeof(robinhood_slot_t));
+    if(!table->slots)
+        return -1;
+
+    table->table_size = size;
+
+    return 0;
+}
+
+
+int _robinhood_init(hashtable_t *table, size_t initial_size)
+{
+    if(table->max_load_factor == 0 || table->max_load_factor > 99)
+        table->max_load_factor = 90;
+
+    return _robinhood_alloc(table, initial_size);
+}
+
+
+int _robinhood_destroy(hashtable_t *table, void (*deallocator)(void*))
+{
+    robinhood_slot_t *slots = table->slots;
+
+    for(size_t i = 0; i < table->table_size; i++)
+    {
+        if(slots[i].key == NULL)
+            continue;
+
+        if(deallocator)
+            deallocator(slots[i].value);
+        free(slots[i].key);
+    }
+
+    free(slots);
+    table->slots = NULL;
+
+    return 0;
+}
+
+
+/* _robinhood_place
+ *
+ * Robin Hood insertion of a key not already in the table: whenever the incoming entry is further from home than
+ * the resident one, they swap and we carry on placing the evicted resident. This keeps probe distances even.
+ * */
+static void _robinhood_place(hashtable_t *table, robinhood_slot_t entry)
+{
+    robinhood_slot_t *slots = table->slots;
+    size_t mask = _robinhood_mask(table);
+    size_t index = entry.hash & mask;
+
+    entry.dist = 0;
+    for(;; index = (index + 1) & mask, entry.dist++)
+    {
+        if(slots[index].key == NULL)
+        {
+            slots[index] = entry;
+            return;
+        }
+
+        if(slots[index].dist < entry.dist)
+        {
+            robinhood_slot_t resident = slots[index];
+            slots[index] = entry;
+            entry = resident;
+        }
+    }
+}
+
+
+static int _robinhood_grow(hashtable_t *table)
+{
+    robinhood_slot_t *old_slots = table->slots;
+    size_t old_size = table->table_size;
+
+    if(_robinhood_alloc(table, old_size * HASHTABLE_GROWTH_FACTOR) != 0)
+    {
+        table->slots = old_slots;
+        return -1;
+    }
+
+    for(size_t i = 0; i < old_size; i++)
+        if(old_slots[i].key != NULL)
+            _robinhood_place(table, old_slots[i]);
+
+    free(old_slots);
+
+    return 0;
+}
+
+
+/* _robinhood_find
+ *
+ * Return the slot holding 'key', whose hash is 'hash', or NULL. A miss stops as soon as we reach a slot nearer its home
+ * than we are to ours, since Robin Hood insertion would have placed our key before it.
+ * */
+static robinhood_slot_t *_robinhood_find(hashtable_t const *table, const char *key, size_t keylen, uint32_t hash)
+{
+    robinhood_slot_t *slots = table->slots;
+    size_t mask = _robinhood_mask(table);
+    size_t index = hash & mask;
+
+    for(uint32_t dist = 0;; index = (index + 1) & mask, dist++)
+    {
+        robinhood_slot_t *slot = &slots[index];
+
+        if(slot->key == NULL || slot->dist < dist)
+            return NULL;
+
+        if(slot->hash == hash && slot->keylen == keylen && memcmp(slot->key, key, keylen) == 0)
+            return slot;
+    }
+}
+
+
+int _robinhood_set(hashtable_t *table, const char *key, size_t keylen, void *value, uint32_t replace,
+                   void (*deallocator)(void*))
+{
+    uint32_t hash = hash_str_key(key, keylen);
+    robinhood_slot_t *slot = _robinhood_find(table, key, keylen, hash);
+    robinhood_slot_t entry;
+
+    if(slot != NULL)
+    {
+        if(!replace)
+            return -1;
+
+        if(deallocator)
+            deallocator(slot->value);
+        slot->value = value;
+
+        return 0;
+    }
+
+    /* a failed growth is only fatal once there is no free slot left */
+    if((table->num_items + 1) * 100 > table->table_size * table->max_load_factor
+       && _robinhood_grow(table) != 0 && table->num_items + 1 >= table->table_size)
+        return -1;
+
+    entry.key = malloc(keylen + 1);
+    if(!entry.key)
+        return -1;
+
+    memcpy(entry.key, key, keylen);
+    entry.key[keylen] = '\0';
+    entry.value = value;
+    entry.keylen = keylen;
+    entry.hash = hash;
+
+    _robinhood_place(table, entry);
+    table->num_items++;
+
+    return 0;
+}
+
+
+const void *_robinhood_get(hashtable_t const *table, const char *key, size_t keylen)
+{
+    robinhood_slot_t *slot = _robinhood_find(table, key, keylen, hash_str_key(key, keylen));
+
+    return slot ? slot->value : NULL;
+}
+
+
+int _robinhood_exists_pair(hashtable_t const *table, const char *key, size_t keylen)
+{
+    return _robinhood_find(table, key, keylen, hash_str_key(key, keylen)) != NULL;
+}
+
+
+/* _robinhood_remove
+ *
+ * Backward shift deletion: the following entries of the run move back one slot until one is found at its home
+ * (or an empty slot), so no tombstones are ever left behind.
+ * */
+int _robinhood_remove(hashtable_t *table, const char *key, size_t keylen, void (*deallocator)(void*))
+{
+    robinhood_slot_t *slots = table->slots;
+    robinhood_slot_t *slot = _robinhood_find(table, key, keylen, hash_str_key(key, keylen));
+    size_t mask = _robinhood_mask(table);
+    size_t hole, next;
+
+    if(slot == NULL)
+        return -1;
+
+    if(deallocator)
+        deallocator(slot->value);
+    free(slot->key);
+
+    hole = (size_t)(slot - slots);
+    for(next = (hole + 1) & mask; slots[next].key != NULL && slots[next].dist > 0; next = (next + 1) & mask)
+    {
+        slots[hole] = slots[next];
+        slots[hole].dist--;
+        hole = next;
+    }
+
+    slots[hole].key = NULL;
+    table->num_items--;
+
+    return 0;
+}
+
+
+int _robinhood_foreach(hashtable_t const *table, int (*fn)(const char *key, size_t keylen, void *value, void *ctx),
+                       void *ctx)
+{
+    robinhood_slot_t *slots = table->slots;
+    int ret;
+
+    for(size_t i = 0; i < table->table_size; i++)
+    {
+        if(slots[i].key == NULL)
+            continue;
+
+        ret = fn(slots[i].key, slots[i].keylen, slots[i].value, ctx);
+        if(ret != 0)
+            return ret;
+    }
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "hashtable.h"
+#include "hashtable_set.h"
+#include "lookup3.h"
+
+extern uint32_t hashtable_seed;
+
+#define hash_str_key(str, len) hashlittle((str), (len), (hashtable_seed))
+
+/* kept out of the header, whose C++ includers would otherwise warn about the flexible array member */
+struct hashtable_set_entry
+{
+    struct hashtable_set_entry *next;
+    uint32_t hash;
+    uint32_t keylen;
+    char key[];                 // not null terminated
+};
+
+
+static inline int _set_entry_matches(hash_set_entry_t const *entry, uint32_t hash, const char *key, size_t keylen)
+{
+    return entry->hash == hash && entry->keylen == keylen && memcmp(entry->key, key, keylen) == 0;
+}
+
+
+hashtable_set_t *hashtable_set_create(size_t initial_size, uint32_t max_load_factor)
+{
+    hashtable_set_t *set = malloc(sizeof(hashtable_set_t));
+    if(!set)
+        return NULL;
+
+    if(initial_size == 0)
+        initial_size = 1;
+
+    set->table_size = initial_size;
+    set->num_items = 0;
+    set->max_load_factor = max_load_factor ? max_load_factor : 1;
+
+    set->buckets = calloc(initial_size, sizeof(hash_set_entry_t*)); // important that we init to 0
+    if(!set->buckets)
+    {
+        free(set);
+        return NULL;
+    }
+
+    return set;
+}
+
+
+int hashtable_set_destroy(hashtable_set_t *set)
+{
+    hash_set_entry_t *curr, *tmp;
+
+    if(!set)
+        return -1;
+
+    for(size_t i = 0; i < set->table_size; i++)
+    {
+        for(curr = set->buckets[i]; curr != NULL; curr = tmp)
+        {
+            tmp = curr->next;
+            free(curr);
+        }
+    }
+
+    free(set->buckets);
+    free(set);
+
+    return 0;
+}
+
+
+/* _hashtable_set_grow
+ *
+ * Grow the bucket array in place, relinking the entries by their cached hash. On failure the set is untouched.
+ * */
+static int _hashtable_set_grow(hashtable_set_t *set)
+{
+    size_t new_size = set->table_size * HASHTABLE_GROWTH_FACTOR;
+    hash_set_entry_t **new_buckets, *curr, *tmp;
+
+    new_buckets = calloc(new_size, sizeof(hash_set_entry_t*));
+    if(!new_buckets)
+        return -1;
+
+    for(size_t i = 0; i < set->table_size; i++)
+    {
+        for(curr = set->buckets[i]; curr != NULL; curr = tmp)
+        {
+            tmp = curr->next;
+            curr->next = new_buckets[curr->hash % new_size];
+            new_buckets[curr->hash % new_size] = curr;
+        }
+    }
+
+    free(set->buckets);
+    set->buckets = new_buckets;
+    set->table_size = new_size;
+
+    return 0;
+}
+
+
+int hashtable_set_add(hashtable_set_t *set, const char *key, size_t keylen)
+{
+    hash_set_entry_t *curr, *entry;
+    uint32_t hash;
+    size_t index;
+
+    if(!set || !key || keylen > UINT32_MAX)
+        return -1;
+
+    hash = hash_str_key(key, keylen);
+    index = hash % set->table_size;
+
+    for(curr = set->buckets[index]; curr != NULL; curr = curr->next)
+    {
+        if(_set_entry_matches(curr, hash, key, keylen))
+            return 1;    // already a member
+    }
+
+    entry = malloc(sizeof(hash_set_entry_t) + keylen);
+    if(!entry)
+        return -1;
+
+    entry->hash = hash;
+    entry->keylen = (uint32_t)keylen;
+    memcpy(entry->key, key, keylen);
+
+    entry->next = set->buckets[index];
+    set->buckets[index] = entry;
+    set->num_items++;
+
+    if(set->num_items / set->table_size >= set->max_load_factor)
+        _hashtable_set_grow(set);
+
+    return 0;
+}
+
+
+int hashtable_set_contains(hashtable_set_t const *set, const char *key, size_t keylen)
+{
+    hash_set_entry_t *curr;
+    uint32_t hash;
+
+    if(!set || !key)
+        return 0;
+
+    hash = hash_str_key(key, keylen);
+    for(curr = set->buckets[hash % set->table_size]; curr != NULL; curr = curr->next)
+    {
+        if(_set_entry_matches(curr, hash, key, keylen))
+            return 1;
+    }
+
+    return 0;
+}
+
+
+int hashtable_set_discard(hashtable_set_t *set, const char *key, size_t keylen)
+{
+    hash_set_entry_t **link, *curr;
+    uint32_t hash;
+
+    if(!set || !set->num_items || !key)
+        return -1;
+
+    hash = hash_str_key(key, keylen);
+    for(link = &set->buckets[hash % set->table_size]; *link != NULL; link = &(*link)->next)
+    {
+        curr = *link;
+        if(_set_entry_matches(curr, hash, key, keylen))
+        {
+            *link = curr->next;
+            free(curr);
+            set->num_items--;
+
+            return 0;
+        }
+    }
+
+    return -1;
+}
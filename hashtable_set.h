@@ -0,0 +1,62 @@
+/* Hash sets.
+ *
+ * A membership-only relative of hashtable_t for dedup style workloads. Entries carry no value pointer or cache
+ * bookkeeping, and the key is stored in the same allocation as its entry, so each member costs a 16 byte
+ * header plus its key and one allocation rather than a full hash_item_t and a separate key copy.
+ * */
+
+#ifndef JSC_HASH_TABLE_SET_H_
+#define JSC_HASH_TABLE_SET_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct hashtable_set_entry hash_set_entry_t;     // defined in hashtable_set.c
+
+
+typedef struct hashtable_set
+{
+    size_t table_size;
+    size_t num_items;
+
+    uint32_t max_load_factor;
+
+    hash_set_entry_t **buckets;
+}hashtable_set_t;
+
+
+/* hashtable_set_create
+ *
+ * Create a set with 'initial_size' slots, and a maximum load factor of 'max_load_factor'. Returns NULL if this
+ * process fails.
+ * */
+hashtable_set_t *hashtable_set_create(size_t initial_size, uint32_t max_load_factor);
+int hashtable_set_destroy(hashtable_set_t *set);
+
+/* hashtable_set_add
+ *
+ * Add 'key' to the set. Returns 0 if it was added, 1 if it was already a member and -1 on failure.
+ * */
+int hashtable_set_add(hashtable_set_t *set, const char *key, size_t keylen);
+
+/* hashtable_set_contains
+ *
+ * Check if 'key' is a member of the set. If so return 1, if not return 0.
+ * */
+int hashtable_set_contains(hashtable_set_t const *set, const char *key, size_t keylen);
+
+/* hashtable_set_discard
+ *
+ * Remove 'key' from the set. Will return 0 on successful removal and -1 if it was not a member.
+ * */
+int hashtable_set_discard(hashtable_set_t *set, const char *key, size_t keylen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSC_HASH_TABLE_SET_H_
@@ -0,0 +1,752 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "hashtable_internal.h"
+#include "hashtable_splitorder.h"
+#include "lookup3.h"
+
+extern uint32_t hashtable_seed;
+
+#define hash_str_key(str, len) hashlittle((str), (len), (hashtable_seed))
+
+#define SEGMENT_BITS    10                    // the first segment holds 1 << this many buckets
+#define SEGMENTS        22                    // every later segment doubles the buckets, up to 1 << 31
+#define MAX_BUCKETS     ((size_t)1 << 31)     // the top bit of the hash only marks items in the split order
+#define EPOCH_SLOTS     HASHTABLE_MAX_THREADS // operations which can announce their epoch at once
+#define RECLAIM_BATCH   64                    // retired nodes between attempts to advance the epoch and free some
+
+#define MARKED(link)    ((link) & 1)
+#define NODE(link)      ((node_t *)((link) & ~(uintptr_t)1))
+
+
+typedef struct splitorder_node
+{
+    _Atomic uintptr_t next;                   // low bit set once the node is logically removed
+    uint32_t so_key;                          // reversed hash, odd for items and even for bucket dummies
+    _Atomic(void *) value;
+    struct splitorder_node *retired;          // link on the table's retired list once unlinked
+    uint64_t retire_epoch;                    // the epoch it was unlinked in
+    size_t keylen;
+    char key[];
+}node_t;
+
+
+/* padded so that operations announcing their epochs never share a cache line */
+typedef struct splitorder_epoch_slot
+{
+    _Atomic uint64_t epoch;                   // 0 when free, otherwise the announced epoch << 1 | 1
+    char pad[64 - sizeof(uint64_t)];
+}epoch_slot_t;
+
+
+struct hashtable_splitorder
+{
+    _Atomic size_t num_buckets;               // always a power of two
+    _Atomic size_t num_items;
+    size_t min_buckets;                       // compacting never goes below the count we were created with
+
+    /* bucket b of segment s > 0 is bucket (1 << (SEGMENT_BITS + s - 1)) + b, segments are allocated on demand */
+    _Atomic(_Atomic(node_t *) *) segments[SEGMENTS];
+    node_t *head;                             // dummy node of bucket 0, the start of the list
+
+    _Atomic uint64_t epoch;
+    _Atomic size_t overflow;                  // operations running without a slot, which hold the epoch back
+    _Atomic(node_t *) retired;
+    _Atomic size_t num_retired;
+    epoch_slot_t slots[EPOCH_SLOTS];
+};
+
+/* the value of a node once it is removed, so that a replace racing with a remove cannot be lost */
+static char _splitorder_removed;
+#define REMOVED ((void *)&_splitorder_removed)
+
+
+static inline uint32_t _splitorder_reverse(uint32_t x)
+{
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+
+    return (x >> 16) | (x << 16);
+}
+
+
+/* items set the top bit before reversing, so they sort after the dummy of their bucket and are always odd */
+static inline uint32_t _splitorder_item_key(uint32_t hash)
+{
+    return _splitorder_reverse(hash | 0x80000000u);
+}
+
+
+static inline uint32_t _splitorder_dummy_key(size_t bucket)
+{
+    return _splitorder_reverse((uint32_t)bucket);
+}
+
+
+/* order by split order key, then items with the same key by length and bytes */
+static inline int _splitorder_cmp(node_t const *node, uint32_t so_key, const char *key, size_t keylen)
+{
+    if(node->so_key != so_key)
+        return node->so_key < so_key ? -1 : 1;
+
+    if(!(so_key & 1))
+        return 0;
+
+    if(node->keylen != keylen)
+        return node->keylen < keylen ? -1 : 1;
+
+    return memcmp(node->key, key, keylen);
+}
+
+
+/* _splitorder_enter
+ *
+ * Announce the current epoch before an operation touches any node, in a free slot (starting from one picked by
+ * the thread's own address, so that a thread tends to find the same slot free each time). Returns the slot,
+ * or -1 if every slot was taken and the operation is counted in 'overflow' instead.
+ * */
+static int _splitorder_enter(hashtable_splitorder_t *table)
+{
+    static _Thread_local char thread_tag;
+    size_t start = (size_t)(((uint64_t)(uintptr_t)&thread_tag * 0x9e3779b97f4a7c15ULL) >> 32) % EPOCH_SLOTS;
+
+    for(size_t i = 0; i < EPOCH_SLOTS; i++)
+    {
+        size_t s = (start + i) % EPOCH_SLOTS;
+        uint64_t expected = 0;
+
+        if(atomic_load_explicit(&table->slots[s].epoch, memory_order_relaxed) != 0)
+            continue;
+
+        /* sequentially consistent, so that a reclaimer either sees the announcement or unlinked before it */
+        if(atomic_compare_exchange_strong(&table->slots[s].epoch, &expected, (atomic_load(&table->epoch) << 1) | 1))
+            return (int)s;
+    }
+
+    atomic_fetch_add(&table->overflow, 1);
+
+    return -1;
+}
+
+
+static void _splitorder_leave(hashtable_splitorder_t *table, int slot)
+{
+    if(slot >= 0)
+        atomic_store_explicit(&table->slots[slot].epoch, 0, memory_order_release);
+    else
+        atomic_fetch_sub_explicit(&table->overflow, 1, memory_order_release);
+}
+
+
+/* _splitorder_advance
+ *
+ * Move the epoch on if every running operation has announced the current one. Returns the epoch.
+ * */
+static uint64_t _splitorder_advance(hashtable_splitorder_t *table)
+{
+    uint64_t epoch = atomic_load(&table->epoch);
+
+    if(atomic_load(&table->overflow) != 0)
+        return epoch;
+
+    for(size_t s = 0; s < EPOCH_SLOTS; s++)
+    {
+        uint64_t announced = atomic_load(&table->slots[s].epoch);
+
+        if(announced != 0 && (announced >> 1) != epoch)
+            return epoch;
+    }
+
+    /* on failure someone else moved it on, and 'epoch' is updated to their value */
+    if(atomic_compare_exchange_strong(&table->epoch, &epoch, epoch + 1))
+        epoch++;
+
+    return epoch;
+}
+
+
+/* _splitorder_reclaim
+ *
+ * Free the retired nodes unlinked at least two epochs ago. The whole list is taken at once, so concurrent
+ * reclaimers work on disjoint nodes, and the nodes still too young are pushed back.
+ * */
+static void _splitorder_reclaim(hashtable_splitorder_t *table)
+{
+    uint64_t epoch = _splitorder_advance(table);
+    node_t *node = atomic_exchange_explicit(&table->retired, NULL, memory_order_acq_rel);
+    node_t *next, *keep = NULL, *keep_tail = NULL, *head;
+    size_t freed = 0;
+
+    for(; node != NULL; node = next)
+    {
+        next = node->retired;
+
+        if(node->retire_epoch + 2 <= epoch)
+        {
+            free(node);
+            freed++;
+            continue;
+        }
+
+        node->retired = keep;
+        if(keep == NULL)
+            keep_tail = node;
+        keep = node;
+    }
+
+    if(keep != NULL)
+    {
+        head = atomic_load_explicit(&table->retired, memory_order_relaxed);
+        do
+        {
+            keep_tail->retired = head;
+        }while(!atomic_compare_exchange_weak_explicit(&table->retired, &head, keep, memory_order_release,
+                                                      memory_order_relaxed));
+    }
+
+    atomic_fetch_sub_explicit(&table->num_retired, freed, memory_order_relaxed);
+}
+
+
+/* push onto the retired list, only the thread which unlinked a node does this so each node is retired once */
+static void _splitorder_retire(hashtable_splitorder_t *table, node_t *node)
+{
+    node_t *head = atomic_load_explicit(&table->retired, memory_order_relaxed);
+
+    node->retire_epoch = atomic_load(&table->epoch);    // read after the unlink
+    do
+    {
+        node->retired = head;
+    }while(!atomic_compare_exchange_weak_explicit(&table->retired, &head, node, memory_order_release,
+                                                  memory_order_relaxed));
+
+    if((atomic_fetch_add_explicit(&table->num_retired, 1, memory_order_relaxed) + 1) % RECLAIM_BATCH == 0)
+        _splitorder_reclaim(table);
+}
+
+
+/* _splitorder_find
+ *
+ * Walk the list from 'start' to where 'key' belongs, unlinking any removed nodes on the way (Michael's lock-free
+ * list). Sets 'prev' to the link which points at 'cur', the first node not ordered before the key. Returns 1 if
+ * 'cur' holds the key and 0 if not. The caller has entered an epoch, so no node is freed under the walk, which
+ * can safely carry on through a node removed meanwhile and restarts only when a link it depends on has changed.
+ * */
+static int _splitorder_find(hashtable_splitorder_t *table, node_t *start, uint32_t so_key, const char *key,
+                            size_t keylen, _Atomic uintptr_t **prev_out, node_t **cur_out)
+{
+    _Atomic uintptr_t *prev;
+    uintptr_t link, next;
+    node_t *cur;
+    int cmp;
+
+retry:
+    prev = &start->next;
+    link = atomic_load_explicit(prev, memory_order_acquire);
+
+    for(;;)
+    {
+        cur = NODE(link);
+        if(cur == NULL)
+        {
+            *prev_out = prev;
+            *cur_out = NULL;
+            return 0;
+        }
+
+        next = atomic_load_explicit(&cur->next, memory_order_acquire);
+        if(MARKED(next))
+        {
+            uintptr_t expected = (uintptr_t)cur;
+
+            if(!atomic_compare_exchange_strong_explicit(prev, &expected, next & ~(uintptr_t)1,
+                                                        memory_order_acq_rel, memory_order_relaxed))
+                goto retry;
+
+            _splitorder_retire(table, cur);
+            link = next & ~(uintptr_t)1;
+            continue;
+        }
+
+        /* 'prev' was marked or moved on since we read it */
+        if(atomic_load_explicit(prev, memory_order_acquire) != (uintptr_t)cur)
+            goto retry;
+
+        cmp = _splitorder_cmp(cur, so_key, key, keylen);
+        if(cmp >= 0)
+        {
+            *prev_out = prev;
+            *cur_out = cur;
+            return cmp == 0;
+        }
+
+        prev = &cur->next;
+        link = next;
+    }
+}
+
+
+/* _splitorder_insert
+ *
+ * Link 'node' into the list after 'start', returning it, or the node already there with the same key.
+ * */
+static node_t *_splitorder_insert(hashtable_splitorder_t *table, node_t *start, node_t *node)
+{
+    _Atomic uintptr_t *prev;
+    node_t *cur;
+
+    for(;;)
+    {
+        if(_splitorder_find(table, start, node->so_key, node->key, node->keylen, &prev, &cur))
+            return cur;
+
+        uintptr_t expected = (uintptr_t)cur;
+
+        atomic_store_explicit(&node->next, (uintptr_t)cur, memory_order_relaxed);
+        if(atomic_compare_exchange_strong_explicit(prev, &expected, (uintptr_t)node, memory_order_release,
+                                                   memory_order_relaxed))
+            return node;
+    }
+}
+
+
+static node_t *_splitorder_node_create(uint32_t so_key, const char *key, size_t keylen, void *value)
+{
+    node_t *node = malloc(sizeof(node_t) + keylen + 1);
+
+    if(!node)
+        return NULL;
+
+    atomic_init(&node->next, 0);
+    atomic_init(&node->value, value);
+    node->so_key = so_key;
+    node->retired = NULL;
+    node->retire_epoch = 0;
+    node->keylen = keylen;
+    memcpy(node->key, key, keylen);
+    node->key[keylen] = '\0';
+
+    return node;
+}
+
+
+/* _splitorder_bucket
+ *
+ * Return the shortcut of 'bucket', allocating its segment if this is the first bucket used in it. Returns NULL if
+ * that allocation fails.
+ * */
+static _Atomic(node_t *) *_splitorder_bucket(hashtable_splitorder_t *table, size_t bucket)
+{
+    _Atomic(node_t *) *segment, *fresh = NULL;
+    size_t s = 0, offset = bucket, size = (size_t)1 << SEGMENT_BITS;
+
+    if(bucket >= size)
+    {
+        int top = (int)_highest_set_bit(bucket);
+
+        s = (size_t)(top - SEGMENT_BITS + 1);
+        size = (size_t)1 << top;
+        offset = bucket - size;
+    }
+
+    segment = atomic_load_explicit(&table->segments[s], memory_order_acquire);
+    if(segment == NULL)
+    {
+        /* all zero is a segment of uninitialised buckets, the loser of a race frees its copy */
+        fresh = calloc(size, sizeof(_Atomic(node_t *)));
+        if(!fresh)
+            return NULL;
+
+        if(atomic_compare_exchange_strong_explicit(&table->segments[s], &segment, fresh, memory_order_acq_rel,
+                                                   memory_order_acquire))
+            segment = fresh;
+        else
+            free(fresh);
+    }
+
+    return &segment[offset];
+}
+
+
+/* _splitorder_dummy
+ *
+ * Return the dummy node of 'bucket'. A bucket is initialised on first use by inserting its dummy starting from
+ * the dummy of its parent, the bucket it was split from (the same index without its top bit), which is itself
+ * initialised first if need be. Returns NULL only if out of memory.
+ * */
+static node_t *_splitorder_dummy(hashtable_splitorder_t *table, size_t bucket)
+{
+    _Atomic(node_t *) *slot = _splitorder_bucket(table, bucket);
+    node_t *dummy, *parent, *fresh;
+
+    if(!slot)
+        return NULL;
+
+    dummy = atomic_load_explicit(slot, memory_order_acquire);
+    if(dummy)
+        return dummy;
+
+    /* bucket 0 is set up by create, so 'bucket' has a top bit here */
+    parent = _splitorder_dummy(table, bucket & ~((size_t)1 << _highest_set_bit(bucket)));
+    if(!parent)
+        return NULL;
+
+    fresh = _splitorder_node_create(_splitorder_dummy_key(bucket), "", 0, NULL);
+    if(!fresh)
+        return NULL;
+
+    dummy = _splitorder_insert(table, parent, fresh);
+    if(dummy != fresh)
+        free(fresh);
+
+    atomic_store_explicit(slot, dummy, memory_order_release);
+
+    return dummy;
+}
+
+
+static node_t *_splitorder_start(hashtable_splitorder_t *table, uint32_t hash)
+{
+    size_t num_buckets = atomic_load_explicit(&table->num_buckets, memory_order_relaxed);
+
+    return _splitorder_dummy(table, hash & (num_buckets - 1));
+}
+
+
+hashtable_splitorder_t *hashtable_splitorder_create(size_t initial_buckets)
+{
+    hashtable_splitorder_t *table = malloc(sizeof(hashtable_splitorder_t));
+    _Atomic(node_t *) *slot;
+    size_t num_buckets = 2;
+
+    if(!table)
+        return NULL;
+
+    while(num_buckets < initial_buckets && num_buckets < MAX_BUCKETS)
+        num_buckets <<= 1;
+
+    atomic_init(&table->num_buckets, num_buckets);
+    atomic_init(&table->num_items, 0);
+    table->min_buckets = num_buckets;
+    atomic_init(&table->epoch, 1);
+    atomic_init(&table->overflow, 0);
+    atomic_init(&table->retired, NULL);
+    atomic_init(&table->num_retired, 0);
+    for(size_t s = 0; s < EPOCH_SLOTS; s++)
+        atomic_init(&table->slots[s].epoch, 0);
+    for(int s = 0; s < SEGMENTS; s++)
+        atomic_init(&table->segments[s], NULL);
+
+    table->head = _splitorder_node_create(_splitorder_dummy_key(0), "", 0, NULL);
+    slot = table->head ? _splitorder_bucket(table, 0) : NULL;
+    if(!slot)
+    {
+        free(table->head);
+        free(table);
+        return NULL;
+    }
+
+    atomic_init(slot, table->head);
+
+    return table;
+}
+
+
+int hashtable_splitorder_destroy(hashtable_splitorder_t *table, void (*deallocator)(void*))
+{
+    node_t *node, *next;
+
+    if(!table)
+        return -1;
+
+    for(node = table->head; node != NULL; node = next)
+    {
+        next = NODE(atomic_load_explicit(&node->next, memory_order_relaxed));
+
+        if((node->so_key & 1) && deallocator)
+        {
+            void *value = atomic_load_explicit(&node->value, memory_order_relaxed);
+            if(value != REMOVED)
+                deallocator(value);
+        }
+
+        free(node);
+    }
+
+    /* the values of retired nodes were all handed back by remove */
+    for(node = atomic_load_explicit(&table->retired, memory_order_relaxed); node != NULL; node = next)
+    {
+        next = node->retired;
+        free(node);
+    }
+
+    for(int s = 0; s < SEGMENTS; s++)
+        free(atomic_load_explicit(&table->segments[s], memory_order_relaxed));
+
+    free(table);
+
+    return 0;
+}
+
+
+/* _splitorder_set
+ *
+ * A value is replaced by CAS so that it can never overwrite the REMOVED left by a concurrent remove, in which case
+ * we search again and find the node gone. The bucket count doubles once the average bucket holds more than
+ * HASHTABLE_SPLITORDER_MAX_LOAD items, and that is all growing takes.
+ * */
+static int _splitorder_set(hashtable_splitorder_t *table, const char *key, size_t keylen, void *value,
+                           uint32_t replace, void **old_value)
+{
+    uint32_t hash = hash_str_key(key, keylen);
+    uint32_t so_key = _splitorder_item_key(hash);
+    size_t num_buckets = atomic_load_explicit(&table->num_buckets, memory_order_relaxed);
+    node_t *start = _splitorder_dummy(table, hash & (num_buckets - 1));
+    node_t *cur, *node = NULL;
+    _Atomic uintptr_t *prev;
+
+    if(!start)
+        return -1;
+
+    for(;;)
+    {
+        if(_splitorder_find(table, start, so_key, key, keylen, &prev, &cur))
+        {
+            void *old = atomic_load_explicit(&cur->value, memory_order_acquire);
+
+            if(!replace)
+            {
+                free(node);
+                return -1;
+            }
+
+            while(old != REMOVED)
+            {
+                if(atomic_compare_exchange_weak_explicit(&cur->value, &old, value, memory_order_acq_rel,
+                                                         memory_order_acquire))
+                {
+                    free(node);
+                    if(old_value)
+                        *old_value = old;
+                    return 0;
+                }
+            }
+
+            continue;
+        }
+
+        if(!node)
+        {
+            node = _splitorder_node_create(so_key, key, keylen, value);
+            if(!node)
+                return -1;
+        }
+
+        uintptr_t expected = (uintptr_t)cur;
+
+        atomic_store_explicit(&node->next, (uintptr_t)cur, memory_order_relaxed);
+        if(atomic_compare_exchange_strong_explicit(prev, &expected, (uintptr_t)node, memory_order_release,
+                                                   memory_order_relaxed))
+            break;
+    }
+
+    if(atomic_fetch_add_explicit(&table->num_items, 1, memory_order_relaxed) + 1
+       > num_buckets * HASHTABLE_SPLITORDER_MAX_LOAD && num_buckets < MAX_BUCKETS)
+        atomic_compare_exchange_strong_explicit(&table->num_buckets, &num_buckets, num_buckets * 2,
+                                                memory_order_relaxed, memory_order_relaxed);
+
+    return 0;
+}
+
+
+static void *_splitorder_get(hashtable_splitorder_t *table, const char *key, size_t keylen)
+{
+    uint32_t hash = hash_str_key(key, keylen);
+    node_t *start = _splitorder_start(table, hash);
+    node_t *cur;
+    _Atomic uintptr_t *prev;
+    void *value;
+
+    if(!start || !_splitorder_find(table, start, _splitorder_item_key(hash), key, keylen, &prev, &cur))
+        return NULL;
+
+    value = atomic_load_explicit(&cur->value, memory_order_acquire);
+
+    return value == REMOVED ? NULL : value;
+}
+
+
+static int _splitorder_exists_pair(hashtable_splitorder_t *table, const char *key, size_t keylen)
+{
+    uint32_t hash = hash_str_key(key, keylen);
+    node_t *start = _splitorder_start(table, hash);
+    node_t *cur;
+    _Atomic uintptr_t *prev;
+
+    if(!start || !_splitorder_find(table, start, _splitorder_item_key(hash), key, keylen, &prev, &cur))
+        return 0;
+
+    return atomic_load_explicit(&cur->value, memory_order_acquire) != REMOVED;
+}
+
+
+/* _splitorder_remove
+ *
+ * Marking the node's link removes it logically and decides between racing removers. The node is then unlinked,
+ * either here or, if its predecessor changed meanwhile, by the search we make to clean up.
+ * */
+static int _splitorder_remove(hashtable_splitorder_t *table, const char *key, size_t keylen, void **value)
+{
+    uint32_t hash = hash_str_key(key, keylen);
+    uint32_t so_key = _splitorder_item_key(hash);
+    node_t *start = _splitorder_start(table, hash);
+    node_t *cur;
+    _Atomic uintptr_t *prev;
+    uintptr_t next;
+    void *old;
+
+    if(!start)
+        return -1;
+
+    for(;;)
+    {
+        if(!_splitorder_find(table, start, so_key, key, keylen, &prev, &cur))
+            return -1;
+
+        next = atomic_fetch_or_explicit(&cur->next, 1, memory_order_acq_rel);
+        if(!MARKED(next))
+            break;
+    }
+
+    old = atomic_exchange_explicit(&cur->value, REMOVED, memory_order_acq_rel);
+
+    uintptr_t expected = (uintptr_t)cur;
+
+    if(atomic_compare_exchange_strong_explicit(prev, &expected, next, memory_order_acq_rel, memory_order_relaxed))
+        _splitorder_retire(table, cur);
+    else
+        _splitorder_find(table, start, so_key, key, keylen, &prev, &cur);
+
+    atomic_fetch_sub_explicit(&table->num_items, 1, memory_order_relaxed);
+
+    if(value)
+        *value = old;
+
+    return 0;
+}
+
+
+int hashtable_splitorder_set(hashtable_splitorder_t *table, const char *key, size_t keylen, void *value,
+                             uint32_t replace, void **old_value)
+{
+    int slot = _splitorder_enter(table);
+    int result = _splitorder_set(table, key, keylen, value, replace, old_value);
+
+    _splitorder_leave(table, slot);
+
+    return result;
+}
+
+
+void *hashtable_splitorder_get(hashtable_splitorder_t *table, const char *key, size_t keylen)
+{
+    int slot = _splitorder_enter(table);
+    void *value = _splitorder_get(table, key, keylen);
+
+    _splitorder_leave(table, slot);
+
+    return value;
+}
+
+
+int hashtable_splitorder_exists_pair(hashtable_splitorder_t *table, const char *key, size_t keylen)
+{
+    int slot = _splitorder_enter(table);
+    int exists = _splitorder_exists_pair(table, key, keylen);
+
+    _splitorder_leave(table, slot);
+
+    return exists;
+}
+
+
+int hashtable_splitorder_remove(hashtable_splitorder_t *table, const char *key, size_t keylen, void **value)
+{
+    int slot = _splitorder_enter(table);
+    int result = _splitorder_remove(table, key, keylen, value);
+
+    _splitorder_leave(table, slot);
+
+    return result;
+}
+
+
+size_t hashtable_splitorder_size(hashtable_splitorder_t *table)
+{
+    return atomic_load_explicit(&table->num_items, memory_order_relaxed);
+}
+
+
+/* hashtable_splitorder_compact
+ *
+ * With no other thread in the table every retired node can go, and so can the dummies of the buckets we give up,
+ * which unlink like any other node. Their items stay where they are in the list, and are found again from the
+ * dummy of the bucket each now maps to.
+ * */
+int hashtable_splitorder_compact(hashtable_splitorder_t *table)
+{
+    size_t num_buckets, num_items;
+    _Atomic(node_t *) *segment;
+    node_t *node, *next;
+    _Atomic uintptr_t *prev;
+
+    if(!table)
+        return -1;
+
+    for(node = atomic_exchange_explicit(&table->retired, NULL, memory_order_acquire); node != NULL; node = next)
+    {
+        next = node->retired;
+        free(node);
+    }
+    atomic_store_explicit(&table->num_retired, 0, memory_order_relaxed);
+
+    num_buckets = atomic_load_explicit(&table->num_buckets, memory_order_relaxed);
+    num_items = atomic_load_explicit(&table->num_items, memory_order_relaxed);
+    while(num_buckets / 2 >= table->min_buckets && num_items <= num_buckets / 2 * HASHTABLE_SPLITORDER_MAX_LOAD / 2)
+        num_buckets /= 2;
+    atomic_store_explicit(&table->num_buckets, num_buckets, memory_order_relaxed);
+
+    /* the head is the dummy of bucket 0, which is always kept */
+    prev = &table->head->next;
+    while((node = NODE(atomic_load_explicit(prev, memory_order_relaxed))) != NULL)
+    {
+        uintptr_t link = atomic_load_explicit(&node->next, memory_order_relaxed);
+
+        if(MARKED(link) || (!(node->so_key & 1) && _splitorder_reverse(node->so_key) >= num_buckets))
+        {
+            atomic_store_explicit(prev, link & ~(uintptr_t)1, memory_order_relaxed);
+            free(node);
+            continue;
+        }
+
+        prev = &node->next;
+    }
+
+    for(int s = 1; s < SEGMENTS; s++)
+    {
+        if(((size_t)1 << (SEGMENT_BITS + s - 1)) < num_buckets)
+            continue;
+
+        free(atomic_load_explicit(&table->segments[s], memory_order_relaxed));
+        atomic_store_explicit(&table->segments[s], NULL, memory_order_relaxed);
+    }
+
+    segment = atomic_load_explicit(&table->segments[0], memory_order_relaxed);
+    for(size_t b = num_buckets; b < ((size_t)1 << SEGMENT_BITS); b++)
+        atomic_store_explicit(&segment[b], NULL, memory_order_relaxed);
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+/* Split-ordered hashtables.
+ *
+ * A lock-free table which grows without moving any item (Shalev and Shavit's split-ordered lists). All items sit
+ * in one lock-free linked list sorted by their bit reversed hash, and the bucket array only holds shortcuts into
+ * that list: bucket b points at a dummy node placed where the keys of bucket b begin. Since reversing the hash
+ * puts the keys of bucket b + n right after those of bucket b, doubling the number of buckets just adds new
+ * shortcuts, each made lazily by the first operation to use its bucket.
+ *
+ * Any number of threads may set, get and remove at once, and none of them ever blocks, including while the table
+ * grows. Removed nodes are freed by epoch based reclamation: every operation announces the epoch it started in,
+ * and a node unlinked in epoch e is freed once the epoch has moved on to e + 2, which it can only do after every
+ * operation that might still be walking through the node has finished. Up to HASHTABLE_MAX_THREADS operations
+ * announce their own epoch, any more running at the same time simply hold reclamation back until they finish.
+ *
+ * The bucket count follows the peak number of items. hashtable_splitorder_compact gives back the buckets the
+ * current items no longer need, and the removed nodes not reclaimed yet, while no other thread is using the table.
+ *
+ * Values are not owned by the table: a value which is replaced or removed is handed back to the writer to
+ * reclaim once no reader can be using it.
+ * */
+
+#ifndef JSC_HASH_TABLE_SPLITORDER_H_
+#define JSC_HASH_TABLE_SPLITORDER_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "hashtable.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HASHTABLE_SPLITORDER_MAX_LOAD     2       // average items per bucket before the bucket count doubles
+
+typedef struct hashtable_splitorder hashtable_splitorder_t;
+
+
+/* hashtable_splitorder_create
+ *
+ * Create a table starting out with at least 'initial_buckets' buckets. Returns NULL if this process fails.
+ * */
+hashtable_splitorder_t *hashtable_splitorder_create(size_t initial_buckets);
+
+/* hashtable_splitorder_destroy
+ *
+ * Destroy the table, passing every value to 'deallocator' if it is not NULL. No other thread may be using it.
+ * */
+int hashtable_splitorder_destroy(hashtable_splitorder_t *table, void (*deallocator)(void*));
+
+/* hashtable_splitorder_set
+ *
+ * Set 'key' to 'value', replacing an existing value only if 'replace' is non-zero, in which case the value
+ * replaced is stored in 'old_value' (if not NULL) for the caller to reclaim. Safe to call from any number of
+ * threads. Returns 0 if the value was set, and -1 if not (the key exists and 'replace' is 0, or out of memory).
+ * */
+int hashtable_splitorder_set(hashtable_splitorder_t *table, const char *key, size_t keylen, void *value,
+                             uint32_t replace, void **old_value);
+
+/* hashtable_splitorder_get
+ *
+ * Retrieve the value mapped by 'key', or NULL if there is no such key. Never blocks.
+ * */
+void *hashtable_splitorder_get(hashtable_splitorder_t *table, const char *key, size_t keylen);
+
+/* hashtable_splitorder_exists_pair
+ *
+ * Check if 'key' is in the table. If so return 1, if not return 0. Never blocks.
+ * */
+int hashtable_splitorder_exists_pair(hashtable_splitorder_t *table, const char *key, size_t keylen);
+
+/* hashtable_splitorder_size
+ *
+ * The number of keys in the table. Never blocks.
+ * */
+size_t hashtable_splitorder_size(hashtable_splitorder_t *table);
+
+/* hashtable_splitorder_compact
+ *
+ * Free every removed node still waiting to be reclaimed, and halve the bucket count for as long as the buckets
+ * left would average no more than half of HASHTABLE_SPLITORDER_MAX_LOAD items (but never below the count the
+ * table was created with). No other thread may be using the table. Returns 0 on success and -1 if 'table' is NULL.
+ * */
+int hashtable_splitorder_compact(hashtable_splitorder_t *table);
+
+/* hashtable_splitorder_remove
+ *
+ * Remove 'key' from the table, storing its value in 'value' (if not NULL) for the caller to reclaim.
+ * Returns 0 on success and -1 if there is no such key.
+ * */
+int hashtable_splitorder_remove(hashtable_splitorder_t *table, const char *key, size_t keylen, void **value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSC_HASH_TABLE_SPLITORDER_H_
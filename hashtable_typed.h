@@ -0,0 +1,226 @@
+/* Type specialised hashtables.
+ *
+ * HASHTABLE_DEFINE stamps out a fully typed table, with keys and values stored inline in one slot array, so
+ * that small values such as counters and offsets need no allocation of their own and lookups chase no
+ * pointers. The hash and comparison are passed in by name and are inlined into every operation.
+ *
+ * e.g.
+ *     HASHTABLE_DEFINE(counts, uint64_t, uint32_t, hashtable_typed_hash_u64, HASHTABLE_TYPED_EQ)
+ *
+ *     counts_t *table = counts_create(64);
+ *     counts_set(table, 42, 1, 0);
+ *     uint32_t *count = counts_get(table, 42);
+ *
+ * 'hash_fn' takes a key and returns a uint64_t, 'eq_fn' takes two keys and returns non-zero if they are equal.
+ * The generated functions are static inline, so HASHTABLE_DEFINE can be used in a header.
+ * */
+
+#ifndef JSC_HASH_TABLE_TYPED_H_
+#define JSC_HASH_TABLE_TYPED_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HASHTABLE_TYPED_MAX_LOAD 75        // percentage of slots used before the table grows
+
+#define HASHTABLE_TYPED_EQ(a, b) ((a) == (b))
+
+/* hashtable_typed_hash_u64
+ *
+ * Default hash for integer keys. The table spreads the hash with a multiply itself, so this only needs to fold
+ * the key into 64 bits.
+ * */
+static inline uint64_t hashtable_typed_hash_u64(uint64_t key)
+{
+    return key ^ (key >> 29);
+}
+
+
+#define HASHTABLE_DEFINE(name, key_type, value_type, hash_fn, eq_fn)                                         \
+                                                                                                             \
+typedef struct name##_slot                                                                                   \
+{                                                                                                            \
+    key_type key;                                                                                            \
+    value_type value;                                                                                        \
+}name##_slot_t;                                                                                              \
+                                                                                                             \
+typedef struct name                                                                                          \
+{                                                                                                            \
+    size_t capacity;           /* always a power of two */                                                   \
+    size_t num_items;                                                                                        \
+    uint32_t shift;            /* 64 - log2(capacity) */                                                     \
+                                                                                                             \
+    uint8_t *used;             /* kept apart from the slots, so probing a run reads one dense array */       \
+    name##_slot_t *slots;                                                                                    \
+}name##_t;                                                                                                   \
+                                                                                                             \
+static inline size_t name##_home(name##_t const *table, key_type key)                                        \
+{                                                                                                            \
+    return (size_t)(((uint64_t)hash_fn(key) * 0x9e3779b97f4a7c15ULL) >> table->shift);                       \
+}                                                                                                            \
+                                                                                                             \
+static inline int name##_init(name##_t *table, size_t capacity)                                              \
+{                                                                                                            \
+    uint32_t bits = 1;                                                                                       \
+    while(((size_t)1 << bits) < capacity)                                                                    \
+        bits++;                                                                                              \
+                                                                                                             \
+    table->used = (uint8_t *)calloc((size_t)1 << bits, sizeof(uint8_t));                                     \
+    table->slots = (name##_slot_t *)malloc(((size_t)1 << bits) * sizeof(name##_slot_t));                     \
+    if(!table->used || !table->slots)                                                                        \
+    {                                                                                                        \
+        free(table->used);                                                                                   \
+        free(table->slots);                                                                                  \
+        return -1;                                                                                           \
+    }                                                                                                        \
+                                                                                                             \
+    table->capacity = (size_t)1 << bits;                                                                     \
+    table->shift = 64 - bits;                                                                                \
+    table->num_items = 0;                                                                                    \
+                                                                                                             \
+    return 0;                                                                                                \
+}                                                                                                            \
+                                                                                                             \
+static inline name##_t *name##_create(size_t initial_size)                                                   \
+{                                                                                                            \
+    name##_t *table = (name##_t *)malloc(sizeof(name##_t));                                                  \
+    if(!table)                                                                                               \
+        return NULL;                                                                                         \
+                                                                                                             \
+    if(name##_init(table, initial_size) != 0)                                                                \
+    {                                                                                                        \
+        free(table);                                                                                         \
+        return NULL;                                                                                         \
+    }                                                                                                        \
+                                                                                                             \
+    return table;                                                                                            \
+}                                                                                                            \
+                                                                                                             \
+static inline int name##_destroy(name##_t *table)                                                            \
+{                                                                                                            \
+    if(!table)                                                                                               \
+        return -1;                                                                                           \
+                                                                                                             \
+    free(table->used);                                                                                       \
+    free(table->slots);                                                                                      \
+    free(table);                                                                                             \
+                                                                                                             \
+    return 0;                                                                                                \
+}                                                                                                            \
+                                                                                                             \
+/* linear probing, returns the slot holding 'key' or the empty slot ending its run */                       \
+static inline size_t name##_probe(name##_t const *table, key_type key)                                       \
+{                                                                                                            \
+    size_t mask = table->capacity - 1;                                                                       \
+    size_t index = name##_home(table, key);                                                                  \
+                                                                                                             \
+    while(table->used[index] && !(eq_fn(table->slots[index].key, key)))                                     \
+        index = (index + 1) & mask;                                                                          \
+                                                                                                             \
+    return index;                                                                                            \
+}                                                                                                            \
+                                                                                                             \
+static inline int name##_grow(name##_t *table)                                                               \
+{                                                                                                            \
+    name##_t old = *table;                                                                                   \
+                                                                                                             \
+    if(name##_init(table, old.capacity * 2) != 0)                                                            \
+    {                                                                                                        \
+        *table = old;                                                                                        \
+        return -1;                                                                                           \
+    }                                                                                                        \
+                                                                                                             \
+    for(size_t i = 0; i < old.capacity; i++)                                                                 \
+    {                                                                                                        \
+        if(!old.used[i])                                                                                     \
+            continue;                                                                                        \
+                                                                                                             \
+        size_t index = name##_probe(table, old.slots[i].key);                                                \
+        table->used[index] = 1;                                                                              \
+        table->slots[index] = old.slots[i];                                                                  \
+    }                                                                                                        \
+    table->num_items = old.num_items;                                                                        \
+                                                                                                             \
+    free(old.used);                                                                                          \
+    free(old.slots);                                                                                         \
+                                                                                                             \
+    return 0;                                                                                                \
+}                                                                                                            \
+                                                                                                             \
+/* returns 0 if the value was set, and -1 if not (including when 'key' exists and 'replace' is 0) */         \
+static inline int name##_set(name##_t *table, key_type key, value_type value, uint32_t replace)              \
+{                                                                                                            \
+    if(!table)                                                                                               \
+        return -1;                                                                                           \
+                                                                                                             \
+    if((table->num_items + 1) * 100 > table->capacity * HASHTABLE_TYPED_MAX_LOAD                             \
+       && name##_grow(table) != 0 && table->num_items + 1 >= table->capacity)                                \
+        return -1;     /* could not grow, and there is no free slot left to probe into */                    \
+                                                                                                             \
+    size_t index = name##_probe(table, key);                                                                 \
+    if(table->used[index])                                                                                   \
+    {                                                                                                        \
+        if(!replace)                                                                                         \
+            return -1;                                                                                       \
+                                                                                                             \
+        table->slots[index].value = value;                                                                   \
+        return 0;                                                                                            \
+    }                                                                                                        \
+                                                                                                             \
+    table->used[index] = 1;                                                                                  \
+    table->slots[index].key = key;                                                                           \
+    table->slots[index].value = value;                                                                       \
+    table->num_items++;                                                                                      \
+                                                                                                             \
+    return 0;                                                                                                \
+}                                                                                                            \
+                                                                                                             \
+/* returns a pointer to the value stored inline in the table, valid until the next set or remove */          \
+static inline value_type *name##_get(name##_t const *table, key_type key)                                    \
+{                                                                                                            \
+    if(!table)                                                                                               \
+        return NULL;                                                                                         \
+                                                                                                             \
+    size_t index = name##_probe(table, key);                                                                 \
+    if(!table->used[index])                                                                                  \
+        return NULL;                                                                                         \
+                                                                                                             \
+    return &table->slots[index].value;                                                                       \
+}                                                                                                            \
+                                                                                                             \
+static inline int name##_exists_pair(name##_t const *table, key_type key)                                    \
+{                                                                                                            \
+    return name##_get(table, key) != NULL;                                                                   \
+}                                                                                                            \
+                                                                                                             \
+/* backward shift deletion: later members of the run move up to close the gap, so no tombstones are left */ \
+static inline int name##_remove(name##_t *table, key_type key)                                               \
+{                                                                                                            \
+    if(!table || !table->num_items)                                                                         \
+        return -1;                                                                                           \
+                                                                                                             \
+    size_t mask = table->capacity - 1;                                                                       \
+    size_t hole = name##_probe(table, key);                                                                  \
+    if(!table->used[hole])                                                                                   \
+        return -1;                                                                                           \
+                                                                                                             \
+    for(size_t next = (hole + 1) & mask; table->used[next]; next = (next + 1) & mask)                        \
+    {                                                                                                        \
+        size_t home = name##_home(table, table->slots[next].key);                                            \
+                                                                                                             \
+        /* 'next' may only move back if its home is not between the hole and itself */                      \
+        if(((next - home) & mask) >= ((next - hole) & mask))                                                 \
+        {                                                                                                    \
+            table->slots[hole] = table->slots[next];                                                         \
+            hole = next;                                                                                     \
+        }                                                                                                    \
+    }                                                                                                        \
+                                                                                                             \
+    table->used[hole] = 0;                                                                                   \
+    table->num_items--;                                                                                      \
+                                                                                                             \
+    return 0;                                                                                                \
+}
+
+#endif // JSC_HASH_TABLE_TYPED_H_
@@ -0,0 +1,234 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "hashtable.h"
+#include "hashtable_u64.h"
+
+extern uint32_t hashtable_seed;
+
+#define HASH_U64_MULTIPLIER 0x9e3779b97f4a7c15ULL    // 2^64 / golden ratio
+
+
+/* _hash_u64_index
+ *
+ * Fibonacci hashing: one multiply, then keep the top bits (which depend on every bit of the key). The seed is
+ * mixed in first so that the layout still differs between processes.
+ * */
+static inline size_t _hash_u64_index(hashtable_u64_t const *table, uint64_t key)
+{
+    return (size_t)(((key ^ hashtable_seed) * HASH_U64_MULTIPLIER) >> table->shift);
+}
+
+
+static int _hashtable_u64_init_buckets(hashtable_u64_t *table, size_t size)
+{
+    uint32_t bits = 0;
+
+    while(((size_t)1 << bits) < size)
+        bits++;
+
+    table->buckets = calloc((size_t)1 << bits, sizeof(hash_u64_item_t*)); // important that we init to 0
+    if(!table->buckets)
+        return -1;
+
+    table->table_size = (size_t)1 << bits;
+    table->shift = 64 - bits;
+
+    return 0;
+}
+
+
+hashtable_u64_t *hashtable_u64_create(size_t initial_size, uint32_t max_load_factor)
+{
+    hashtable_u64_t *table = malloc(sizeof(hashtable_u64_t));
+    if(!table)
+        return NULL;
+
+    table->num_items = 0;
+    table->max_load_factor = max_load_factor ? max_load_factor : 1;
+    table->deallocator = NULL;
+
+    /* at least two buckets, so that the shift is always less than 64 */
+    if(_hashtable_u64_init_buckets(table, initial_size < 2 ? 2 : initial_size) != 0)
+    {
+        free(table);
+        return NULL;
+    }
+
+    return table;
+}
+
+
+int hashtable_u64_destroy(hashtable_u64_t *table, void (*deallocator)(void*))
+{
+    hash_u64_item_t *curr_item, *tmp;
+
+    if(!table)
+        return -1;
+
+    if(deallocator == NULL)
+        deallocator = table->deallocator;
+
+    for(size_t i = 0; i < table->table_size; i++)
+    {
+        curr_item = table->buckets[i];
+        while(curr_item != NULL)
+        {
+            tmp = curr_item->next;
+
+            if(deallocator != NULL)
+                deallocator(curr_item->value);
+
+            free(curr_item);
+            curr_item = tmp;
+        }
+    }
+
+    free(table->buckets);
+    free(table);
+
+    return 0;
+}
+
+
+/* _hashtable_u64_grow
+ *
+ * Double the bucket array in place, relinking the existing items. On failure the table is left as it was.
+ * */
+static int _hashtable_u64_grow(hashtable_u64_t *table)
+{
+    hash_u64_item_t **old_buckets = table->buckets, *curr_item, *tmp;
+    size_t old_size = table->table_size;
+    uint32_t old_shift = table->shift;
+
+    if(_hashtable_u64_init_buckets(table, old_size * HASHTABLE_GROWTH_FACTOR) != 0)
+    {
+        table->buckets = old_buckets;
+        table->table_size = old_size;
+        table->shift = old_shift;
+        return -1;
+    }
+
+    for(size_t i = 0; i < old_size; i++)
+    {
+        for(curr_item = old_buckets[i]; curr_item != NULL; curr_item = tmp)
+        {
+            size_t index = _hash_u64_index(table, curr_item->key);
+
+            tmp = curr_item->next;
+            curr_item->next = table->buckets[index];
+            table->buckets[index] = curr_item;
+        }
+    }
+
+    free(old_buckets);
+
+    return 0;
+}
+
+
+int hashtable_u64_set(hashtable_u64_t *table, uint64_t key, void *value, uint32_t replace,
+                      void (*deallocator)(void*))
+{
+    hash_u64_item_t *curr_item;
+    size_t index;
+
+    if(!table)
+        return -1;
+
+    index = _hash_u64_index(table, key);
+    for(curr_item = table->buckets[index]; curr_item != NULL; curr_item = curr_item->next)
+    {
+        if(curr_item->key == key)
+        {
+            if(!replace)
+                return -1;
+
+            if(deallocator != NULL)
+                deallocator(curr_item->value);
+
+            curr_item->value = value;
+            return 0;
+        }
+    }
+
+    curr_item = malloc(sizeof(hash_u64_item_t));
+    if(!curr_item)
+        return -1;
+
+    /* chains are unordered, so push onto the front */
+    curr_item->key = key;
+    curr_item->value = value;
+    curr_item->next = table->buckets[index];
+    table->buckets[index] = curr_item;
+    table->num_items++;
+
+    /* if the bigger bucket array cannot be had, the chains simply get longer until a later insert grows them */
+    if(table->num_items / table->table_size >= table->max_load_factor)
+        _hashtable_u64_grow(table);
+
+    return 0;
+}
+
+
+static hash_u64_item_t *_hashtable_u64_find(hashtable_u64_t const *table, uint64_t key)
+{
+    hash_u64_item_t *curr_item;
+
+    if(!table)
+        return NULL;
+
+    for(curr_item = table->buckets[_hash_u64_index(table, key)]; curr_item != NULL; curr_item = curr_item->next)
+    {
+        if(curr_item->key == key)
+            return curr_item;
+    }
+
+    return NULL;
+}
+
+
+const void *hashtable_u64_get(hashtable_u64_t const *table, uint64_t key)
+{
+    hash_u64_item_t *pair = _hashtable_u64_find(table, key);
+    if(!pair)
+        return NULL;
+
+    return pair->value;
+}
+
+
+int hashtable_u64_exists_pair(hashtable_u64_t const *table, uint64_t key)
+{
+    if(_hashtable_u64_find(table, key) != NULL)
+        return 1;
+    return 0;
+}
+
+
+int _hashtable_u64_remove(hashtable_u64_t *table, uint64_t key, void (*deallocator)(void*))
+{
+    hash_u64_item_t **link, *curr_item;
+
+    if(!table || !table->num_items)
+        return -1;
+
+    /* walk the links themselves, so that removing the head needs no special case */
+    for(link = &table->buckets[_hash_u64_index(table, key)]; *link != NULL; link = &(*link)->next)
+    {
+        curr_item = *link;
+        if(curr_item->key == key)
+        {
+            *link = curr_item->next;
+
+            if(deallocator != NULL)
+                deallocator(curr_item->value);
+
+            free(curr_item);
+            table->num_items--;
+
+            return 0;
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,91 @@
+/* Integer keyed hashtables.
+ *
+ * A variant of hashtable_t for tables keyed by 64-bit integers (IDs and the like). Keys are stored inline in the
+ * items rather than being formatted into strings, hashed with a single multiply (Fibonacci hashing over a power
+ * of two bucket array) and compared with a single integer compare.
+ * */
+
+#ifndef JSC_HASH_TABLE_U64_H_
+#define JSC_HASH_TABLE_U64_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct hashtable_u64_item
+{
+    struct hashtable_u64_item *next;
+    uint64_t key;
+    void *value;
+}hash_u64_item_t;
+
+
+typedef struct hashtable_u64
+{
+    size_t table_size;            // always a power of two
+    size_t num_items;
+
+    uint32_t max_load_factor;
+    uint32_t shift;               // 64 - log2(table_size), the hash keeps the top bits of the product
+
+    hash_u64_item_t **buckets;
+    void (*deallocator)(void*);   // none by default
+}hashtable_u64_t;
+
+
+/* hashtable_u64_create
+ *
+ * Create a table with at least 'initial_size' slots (rounded up to a power of two), and a maximum load factor
+ * of 'max_load_factor'. Returns NULL if this process fails.
+ * */
+hashtable_u64_t *hashtable_u64_create(size_t initial_size, uint32_t max_load_factor);
+int hashtable_u64_destroy(hashtable_u64_t *table, void (*deallocator)(void*));
+
+/* hashtable_u64_set
+ *
+ * Set the entry 'key' to 'value', with the same 'replace' and 'deallocator' semantics as hashtable_set. The table
+ * grows in place, so unlike hashtable_set this takes the table itself.
+ * Returns 0 if the value was set, and -1 if not (including when 'key' exists and 'replace' is 0).
+ * */
+int hashtable_u64_set(hashtable_u64_t *table, uint64_t key, void *value, uint32_t replace,
+                      void (*deallocator)(void*));
+
+#define hashtable_u64_set_no_replace(table, key, value)  \
+    hashtable_u64_set((table), (key), (value), 0, NULL)
+
+#define hashtable_u64_set_replace(table, key, value)    \
+    hashtable_u64_set((table), (key), (value), 1, NULL)
+
+/* hashtable_u64_get
+ *
+ * Retrieve the value mapped by 'key' if such a value exists. Return NULL if not.
+ * */
+const void *hashtable_u64_get(hashtable_u64_t const *table, uint64_t key);
+
+/* hashtable_u64_exists_pair
+ *
+ * Check if 'key' is mapped to a value in our table. If so return 1, if not return 0.
+ * */
+int hashtable_u64_exists_pair(hashtable_u64_t const *table, uint64_t key);
+
+/* _hashtable_u64_remove
+ *
+ * Remove the item mapped by 'key', passing its value to 'deallocator' if that is not NULL.
+ * Will return 0 on successful removal and -1 if not.
+ * */
+int _hashtable_u64_remove(hashtable_u64_t *table, uint64_t key, void (*deallocator)(void*));
+
+#define hashtable_u64_remove(table, key)    \
+    _hashtable_u64_remove((table), (key), NULL)
+
+#define hashtable_u64_remove_and_destroy(table, key, deallocator)    \
+    _hashtable_u64_remove((table), (key), (deallocator))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSC_HASH_TABLE_U64_H_
@@ -0,0 +1,50 @@
+#!/bin/sh
+# Build and run every test program against the library sources.
+#
+# lookup3.c (Bob Jenkins' hashlittle and hashlittle2) is not part of this tree: point LOOKUP3 at the directory
+# holding lookup3.c and lookup3.h. The tests are built with HAVE_PTHREAD, which the concurrency tests need.
+#
+#     LOOKUP3=/path/to/lookup3 tests/run_tests.sh [test_name ...]
+
+set -e
+
+: "${LOOKUP3:?set LOOKUP3 to the directory holding lookup3.c and lookup3.h}"
+: "${CC:=cc}"
+: "${CXX:=c++}"
+: "${CFLAGS:=-O2 -g -Wall -Wextra}"
+: "${CXXFLAGS:=$CFLAGS}"
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+out=${TEST_BUILD_DIR:-"$root/tests/build"}
+defs="-DHAVE_PTHREAD -DHAVE_UNISTD_H"
+
+mkdir -p "$out"
+
+objs=""
+for src in "$root"/*.c "$LOOKUP3/lookup3.c"; do
+    obj="$out/$(basename "$src" .c).o"
+    $CC -std=gnu11 $CFLAGS $defs -I"$root" -I"$LOOKUP3" -c "$src" -o "$obj"
+    objs="$objs $obj"
+done
+
+if [ $# -eq 0 ]; then
+    set -- $(cd "$root/tests" && ls test_*.c test_*.cpp 2>/dev/null | sed 's/\.[^.]*$//')
+fi
+
+failed=0
+for name in "$@"; do
+    if [ -f "$root/tests/$name.cpp" ]; then
+        $CXX -std=c++17 $CXXFLAGS -I"$root" "$root/tests/$name.cpp" $objs -o "$out/$name" -pthread
+    else
+        $CC -std=gnu11 $CFLAGS $defs -I"$root" "$root/tests/$name.c" $objs -o "$out/$name" -pthread
+    fi
+
+    if (cd "$out" && "./$name"); then
+        echo "PASS $name"
+    else
+        echo "FAIL $name"
+        failed=1
+    fi
+done
+
+exit $failed
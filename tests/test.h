@@ -0,0 +1,52 @@
+/* Shared helpers for the test programs.
+ *
+ * Every test is a plain C main built against the library sources, see run_tests.sh. A failed CHECK reports where
+ * it failed and exits non-zero, so a test passes by returning from main.
+ * */
+
+#ifndef JSC_HASH_TABLE_TEST_H_
+#define JSC_HASH_TABLE_TEST_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CHECK(cond)                                                                         \
+    do                                                                                      \
+    {                                                                                       \
+        if(!(cond))                                                                         \
+        {                                                                                   \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond);        \
+            exit(1);                                                                        \
+        }                                                                                   \
+    } while(0)
+
+/* values are small integers smuggled through the void * of the tables, 0 being reserved for NULL */
+#define TEST_VALUE(i) ((void *)(uintptr_t)((i) + 1))
+
+/* test_key
+ *
+ * Write the i'th test key into 'buf' and return its length.
+ * */
+static inline size_t test_key(char *buf, size_t size, const char *prefix, size_t i)
+{
+    return (size_t)snprintf(buf, size, "%s%zu", prefix, i);
+}
+
+
+/* test_random
+ *
+ * A small xorshift generator, so that runs are repeatable whatever the platform's rand.
+ * */
+static inline uint64_t test_random(uint64_t *state)
+{
+    uint64_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+
+    return *state = x;
+}
+
+#endif // JSC_HASH_TABLE_TEST_H_
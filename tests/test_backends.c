@@ -0,0 +1,118 @@
+/* Tests for the storage backends of hashtable_create_backend (hashtable_robinhood.c, hashtable_cuckoo.c,
+ * hashtable_hopscotch.c and hashtable_cacheline.c), each put through the same round-trips and growth as the
+ * chained table they stand in for. */
+
+#include <string.h>
+#include "../hashtable.h"
+#include "test.h"
+
+#define NUM_KEYS 200000
+
+
+static size_t freed;
+
+static void count_free(void *value)
+{
+    (void)value;
+    freed++;
+}
+
+
+static int count_item(const char *key, size_t keylen, void *value, void *ctx)
+{
+    size_t i = (uintptr_t)value - 1;
+    char expected[32];
+
+    CHECK(test_key(expected, sizeof(expected), "key", i) == keylen && memcmp(expected, key, keylen) == 0);
+    (*(size_t *)ctx)++;
+
+    return 0;
+}
+
+
+static void test_backend(hashtable_flag backend, uint32_t max_load_factor)
+{
+    hashtable_t *table = hashtable_create_backend(1, max_load_factor, backend);
+    char key[32];
+    size_t len, count = 0;
+    uint64_t random = 88172645463325252ULL;
+
+    CHECK(table != NULL);
+    CHECK(table->backend == backend);
+
+    CHECK(hashtable_set_no_replace(&table, "", 0, TEST_VALUE(0)) == 0);
+    CHECK(hashtable_get(table, "", 0) == TEST_VALUE(0));
+    CHECK(hashtable_remove(table, "", 0) == 0);
+    CHECK(hashtable_remove(table, "", 0) == -1);
+
+    /* growth under load, starting from a single slot */
+    for(size_t i = 0; i < NUM_KEYS; i++)
+    {
+        len = test_key(key, sizeof(key), "key", i);
+        CHECK(hashtable_set_no_replace(&table, key, len, TEST_VALUE(i)) == 0);
+    }
+    CHECK(table->num_items == NUM_KEYS);
+
+    for(size_t i = 0; i < NUM_KEYS; i++)
+    {
+        len = test_key(key, sizeof(key), "key", i);
+        CHECK(hashtable_get(table, key, len) == TEST_VALUE(i));
+        CHECK(hashtable_set_no_replace(&table, key, len, TEST_VALUE(0)) == -1);
+        len = test_key(key, sizeof(key), "missing", i);
+        CHECK(hashtable_get(table, key, len) == NULL);
+    }
+
+    CHECK(hashtable_foreach(table, count_item, &count) == 0);
+    CHECK(count == NUM_KEYS);
+
+    /* replacement hands the old value to the deallocator */
+    freed = 0;
+    CHECK(hashtable_set_replace_and_destroy(&table, "key7", 4, TEST_VALUE(7), count_free) == 0);
+    CHECK(freed == 1);
+
+    /* random removals and re-insertions, the removals shifting, hopping and unstashing the keys left behind */
+    for(size_t round = 0; round < NUM_KEYS; round++)
+    {
+        size_t i = test_random(&random) % NUM_KEYS;
+
+        len = test_key(key, sizeof(key), "key", i);
+        if(hashtable_exists_pair(table, key, len))
+            CHECK(hashtable_remove(table, key, len) == 0);
+        else CHECK(hashtable_set_no_replace(&table, key, len, TEST_VALUE(i)) == 0);
+    }
+
+    count = 0;
+    for(size_t i = 0; i < NUM_KEYS; i++)
+    {
+        len = test_key(key, sizeof(key), "key", i);
+        if(hashtable_exists_pair(table, key, len))
+        {
+            CHECK(hashtable_get(table, key, len) == TEST_VALUE(i));
+            count++;
+        }
+    }
+    CHECK(count == table->num_items);
+
+    freed = 0;
+    CHECK(hashtable_destroy(table, count_free) == 0);
+    CHECK(freed == count);
+}
+
+
+int main(void)
+{
+    set_hashtable_seed(0);
+
+    test_backend(HASHTABLE_BACKEND_CHAINED, 0);
+    test_backend(HASHTABLE_BACKEND_ROBINHOOD, 0);
+    test_backend(HASHTABLE_BACKEND_ROBINHOOD, 99);
+    test_backend(HASHTABLE_BACKEND_CUCKOO, 0);
+    test_backend(HASHTABLE_BACKEND_CUCKOO, 99);
+    test_backend(HASHTABLE_BACKEND_HOPSCOTCH, 0);
+    test_backend(HASHTABLE_BACKEND_HOPSCOTCH, 99);
+    test_backend(HASHTABLE_BACKEND_CACHELINE, 0);
+
+    CHECK(hashtable_create_backend(16, 0, 99) == NULL);     // no such backend
+
+    return 0;
+}
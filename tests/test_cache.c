@@ -0,0 +1,134 @@
+/* Tests for bounded tables (hashtable_create_bounded): the order in which LRU and CLOCK evict, and the byte budget. */
+
+#include <string.h>
+#include "../hashtable.h"
+#include "test.h"
+
+
+static size_t evicted;
+
+static void count_evicted(void *value)
+{
+    (void)value;
+    evicted++;
+}
+
+
+static void test_lru_order(void)
+{
+    hashtable_t *table = hashtable_create_bounded(4, 1, 3, 0, HASHTABLE_EVICT_LRU, NULL, count_evicted);
+    evicted = 0;
+
+    CHECK(table != NULL);
+    CHECK(hashtable_set_no_replace(&table, "a", 1, TEST_VALUE(0)) == 0);
+    CHECK(hashtable_set_no_replace(&table, "b", 1, TEST_VALUE(1)) == 0);
+    CHECK(hashtable_set_no_replace(&table, "c", 1, TEST_VALUE(2)) == 0);
+
+    CHECK(hashtable_get(table, "a", 1) == TEST_VALUE(0));     // b is now the least recently used
+    CHECK(hashtable_set_no_replace(&table, "d", 1, TEST_VALUE(3)) == 0);
+    CHECK(evicted == 1 && table->num_items == 3);
+    CHECK(!hashtable_exists_pair(table, "b", 1));
+
+    CHECK(hashtable_get(table, "c", 1) == TEST_VALUE(2));     // recency is now c, d, a
+    CHECK(hashtable_set_replace(&table, "d", 1, TEST_VALUE(4)) == 0);    // and replacing d makes it d, c, a
+    CHECK(hashtable_set_no_replace(&table, "e", 1, TEST_VALUE(5)) == 0);
+    CHECK(!hashtable_exists_pair(table, "a", 1));
+    CHECK(hashtable_exists_pair(table, "c", 1) && hashtable_exists_pair(table, "d", 1));
+
+    CHECK(hashtable_set_no_replace(&table, "f", 1, TEST_VALUE(6)) == 0);
+    CHECK(!hashtable_exists_pair(table, "c", 1));
+    CHECK(evicted == 3);
+
+    /* a removed item leaves the recency list with it */
+    CHECK(hashtable_remove(table, "d", 1) == 0);
+    CHECK(hashtable_set_no_replace(&table, "g", 1, TEST_VALUE(7)) == 0);
+    CHECK(evicted == 3 && table->num_items == 3);
+
+    hashtable_destroy(table, NULL);
+    CHECK(evicted == 6);
+}
+
+
+static void test_clock_order(void)
+{
+    hashtable_t *table = hashtable_create_bounded(4, 1, 3, 0, HASHTABLE_EVICT_CLOCK, NULL, NULL);
+
+    CHECK(hashtable_set_no_replace(&table, "a", 1, TEST_VALUE(0)) == 0);
+    CHECK(hashtable_set_no_replace(&table, "b", 1, TEST_VALUE(1)) == 0);
+    CHECK(hashtable_set_no_replace(&table, "c", 1, TEST_VALUE(2)) == 0);
+
+    /* the hand starts at the oldest item, a, which is referenced and so gets a second chance */
+    CHECK(hashtable_get(table, "a", 1) == TEST_VALUE(0));
+    CHECK(hashtable_set_no_replace(&table, "d", 1, TEST_VALUE(3)) == 0);
+    CHECK(hashtable_exists_pair(table, "a", 1));
+    CHECK(!hashtable_exists_pair(table, "b", 1));
+
+    CHECK(hashtable_set_no_replace(&table, "e", 1, TEST_VALUE(4)) == 0);
+    CHECK(!hashtable_exists_pair(table, "c", 1));
+    CHECK(table->num_items == 3);
+
+    hashtable_destroy(table, NULL);
+}
+
+
+static void test_clock_scan_resistance(void)
+{
+    hashtable_t *table = hashtable_create_bounded(16, 1, 8, 0, HASHTABLE_EVICT_CLOCK, NULL, NULL);
+    char key[32];
+
+    CHECK(hashtable_set_no_replace(&table, "hot1", 4, TEST_VALUE(1)) == 0);
+    CHECK(hashtable_set_no_replace(&table, "hot2", 4, TEST_VALUE(2)) == 0);
+
+    /* a long scan of keys used once must not flush the keys which keep being hit */
+    for(size_t i = 0; i < 10000; i++)
+    {
+        CHECK(hashtable_get(table, "hot1", 4) == TEST_VALUE(1));
+        CHECK(hashtable_get(table, "hot2", 4) == TEST_VALUE(2));
+        CHECK(hashtable_set_no_replace(&table, key, test_key(key, sizeof(key), "scan", i), TEST_VALUE(i)) == 0);
+        CHECK(table->num_items <= 8);
+    }
+
+    hashtable_destroy(table, NULL);
+}
+
+
+static size_t value_size(const void *value)
+{
+    return (uintptr_t)value;
+}
+
+
+static void test_byte_budget(void)
+{
+    hashtable_t *table = hashtable_create_bounded(16, 1, 0, 4096, HASHTABLE_EVICT_LRU, value_size, NULL);
+    char key[32];
+
+    for(size_t i = 0; i < 1000; i++)
+    {
+        CHECK(hashtable_set_no_replace(&table, key, test_key(key, sizeof(key), "k", i), (void *)(uintptr_t)100) == 0);
+        CHECK(table->num_bytes <= 4096);
+    }
+    CHECK(table->num_items < 1000);
+    CHECK(hashtable_exists_pair(table, key, test_key(key, sizeof(key), "k", 999)));
+
+    /* an item bigger than the whole budget survives its own insertion, at the expense of every other */
+    CHECK(hashtable_set_no_replace(&table, "huge", 4, (void *)(uintptr_t)10000) == 0);
+    CHECK(table->num_items == 1 && hashtable_exists_pair(table, "huge", 4));
+
+    hashtable_destroy(table, NULL);
+}
+
+
+int main(void)
+{
+    set_hashtable_seed(0);
+
+    test_lru_order();
+    test_clock_order();
+    test_clock_scan_resistance();
+    test_byte_budget();
+
+    CHECK(hashtable_create_bounded(4, 1, 3, 0, 42, NULL, NULL) == NULL);     // no such policy
+
+    return 0;
+}
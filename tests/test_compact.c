@@ -0,0 +1,110 @@
+/* Tests for compact tables (hashtable_compact.c): round-trips with pointer values and with handles, growth, and
+ * entries and key space reused after removals. */
+
+#include <string.h>
+#include "../hashtable_compact.h"
+#include "test.h"
+
+#define NUM_KEYS 100000
+
+
+static int count_item(const char *key, size_t keylen, void *value, void *ctx)
+{
+    size_t i = hashtable_compact_handle_of(value);
+    char expected[32];
+
+    CHECK(test_key(expected, sizeof(expected), "key", i) == keylen && memcmp(expected, key, keylen) == 0);
+    (*(size_t *)ctx)++;
+
+    return 0;
+}
+
+
+static void test_pointers(void)
+{
+    hashtable_compact_t *table = hashtable_compact_create(1, 0, 0);
+    char key[32];
+    size_t len;
+
+    CHECK(table != NULL);
+
+    for(size_t i = 0; i < NUM_KEYS; i++)
+    {
+        len = test_key(key, sizeof(key), "key", i);
+        CHECK(hashtable_compact_set_no_replace(table, key, len, TEST_VALUE(i)) == 0);
+    }
+    CHECK(table->num_items == NUM_KEYS);
+
+    for(size_t i = 0; i < NUM_KEYS; i++)
+    {
+        len = test_key(key, sizeof(key), "key", i);
+        CHECK(hashtable_compact_get(table, key, len) == TEST_VALUE(i));
+        CHECK(hashtable_compact_set_no_replace(table, key, len, TEST_VALUE(0)) == -1);
+        CHECK(hashtable_compact_get(table, key, len - 1) == (len > 4 ? TEST_VALUE(i / 10) : NULL));
+    }
+
+    /* churn: each round removes every key and sets it again under a longer name, so the key heap can only keep
+     * up by dropping the garbage and the entries must come back off the free list */
+    for(size_t round = 0; round < 4; round++)
+    {
+        for(size_t i = 0; i < NUM_KEYS; i++)
+        {
+            len = test_key(key, sizeof(key), round ? "longer-key" : "key", i);
+            CHECK(hashtable_compact_remove(table, key, len) == 0);
+            len = test_key(key, sizeof(key), "longer-key", i);
+            CHECK(hashtable_compact_set_no_replace(table, key, len, TEST_VALUE(i + round)) == 0);
+        }
+        CHECK(table->entries_used == NUM_KEYS);
+    }
+    CHECK(table->keys_used < 2 * NUM_KEYS * 3);
+
+    for(size_t i = 0; i < NUM_KEYS; i++)
+    {
+        len = test_key(key, sizeof(key), "longer-key", i);
+        CHECK(hashtable_compact_get(table, key, len) == TEST_VALUE(i + 3));
+        len = test_key(key, sizeof(key), "key", i);
+        CHECK(hashtable_compact_exists_pair(table, key, len) == 0);
+    }
+
+    CHECK(hashtable_compact_destroy(table, NULL) == 0);
+}
+
+
+static void test_handles(void)
+{
+    hashtable_compact_t *table = hashtable_compact_create(16, 4, HASHTABLE_COMPACT_HANDLES);
+    char key[32];
+    size_t len, count = 0;
+
+    CHECK(table != NULL && table->values == NULL);
+
+    for(size_t i = 0; i < NUM_KEYS; i++)
+    {
+        len = test_key(key, sizeof(key), "key", i);
+        CHECK(hashtable_compact_set_no_replace(table, key, len, hashtable_compact_handle(i)) == 0);
+    }
+
+    /* handle 0 reads back as NULL, so only exists_pair tells it apart from a missing key */
+    CHECK(hashtable_compact_get(table, "key0", 4) == NULL && hashtable_compact_exists_pair(table, "key0", 4));
+    for(size_t i = 0; i < NUM_KEYS; i++)
+    {
+        len = test_key(key, sizeof(key), "key", i);
+        CHECK(hashtable_compact_handle_of(hashtable_compact_get(table, key, len)) == i);
+    }
+
+    CHECK(hashtable_compact_foreach(table, count_item, &count) == 0);
+    CHECK(count == NUM_KEYS);
+
+    CHECK(hashtable_compact_destroy(table, NULL) == 0);
+}
+
+
+int main(void)
+{
+    set_hashtable_seed(0);
+
+    test_pointers();
+    test_handles();
+
+    return 0;
+}
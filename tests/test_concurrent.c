@@ -0,0 +1,156 @@
+/* Tests for the concurrent cuckoo table (hashtable_concurrent.c): single-threaded round-trips up to capacity, then
+ * writers and lock-free readers hammering it from many threads at once. */
+
+#include <pthread.h>
+#include <string.h>
+#include "../hashtable_concurrent.h"
+#include "test.h"
+
+#define NUM_THREADS     8
+#define KEYS_PER_THREAD 20000
+#define ROUNDS          4
+#define HOT_KEYS        16
+
+/* the value of key i of thread t is always TEST_VALUE(i * NUM_THREADS + t) or that plus CONCURRENT_REPLACED */
+#define CONCURRENT_REPLACED ((size_t)1 << 40)
+
+typedef struct stress_worker
+{
+    hashtable_concurrent_t *table;
+    size_t id;
+    pthread_t thread;
+}stress_worker_t;
+
+
+static void test_round_trip(void)
+{
+    hashtable_concurrent_t *table = hashtable_concurrent_create(1000);
+    char key[MAX_KEY_LEN + 2];
+    void *old;
+    size_t len, added = 0;
+
+    CHECK(table != NULL);
+    CHECK(hashtable_concurrent_set(table, "k", 1, TEST_VALUE(1), 0, NULL) == 0);
+    CHECK(hashtable_concurrent_set(table, "k", 1, TEST_VALUE(2), 0, NULL) == -1);
+    CHECK(hashtable_concurrent_set(table, "k", 1, TEST_VALUE(2), 1, &old) == 0 && old == TEST_VALUE(1));
+    CHECK(hashtable_concurrent_get(table, "k", 1) == TEST_VALUE(2));
+    CHECK(hashtable_concurrent_remove(table, "k", 1, &old) == 0 && old == TEST_VALUE(2));
+    CHECK(hashtable_concurrent_remove(table, "k", 1, &old) == -1);
+    CHECK(hashtable_concurrent_exists_pair(table, "k", 1) == 0);
+
+    memset(key, 'x', sizeof(key));
+    CHECK(hashtable_concurrent_set(table, key, MAX_KEY_LEN + 1, TEST_VALUE(1), 0, NULL) == -1);
+
+    /* fill it until it refuses, every key added must still be there */
+    for(size_t i = 0; i < 10000; i++)
+    {
+        len = test_key(key, sizeof(key), "k", i);
+        if(hashtable_concurrent_set(table, key, len, TEST_VALUE(i), 0, NULL) != 0)
+            break;
+        added++;
+    }
+    CHECK(added >= 1000);
+    CHECK(hashtable_concurrent_size(table) == added);
+    for(size_t i = 0; i < added; i++)
+        CHECK(hashtable_concurrent_get(table, key, test_key(key, sizeof(key), "k", i)) == TEST_VALUE(i));
+
+    CHECK(hashtable_concurrent_destroy(table, NULL) == 0);
+}
+
+
+static int valid_value(void *value, size_t i, size_t owner)
+{
+    size_t v = (uintptr_t)value - 1;
+
+    return value == NULL || v == i * NUM_THREADS + owner || v == i * NUM_THREADS + owner + CONCURRENT_REPLACED;
+}
+
+
+static void *stress(void *arg)
+{
+    stress_worker_t *worker = arg;
+    hashtable_concurrent_t *table = worker->table;
+    uint64_t random = 0x2545f4914f6cdd1dULL * (worker->id + 1);
+    char key[32];
+    size_t len;
+    void *old;
+
+    for(size_t round = 0; round < ROUNDS; round++)
+    {
+        /* insert, replace and read back our own keys, while peeking at the keys of every other thread */
+        for(size_t i = 0; i < KEYS_PER_THREAD; i++)
+        {
+            size_t other = test_random(&random) % NUM_THREADS, j = test_random(&random) % KEYS_PER_THREAD;
+            char peek[32];
+
+            len = test_key(key, sizeof(key), "t", i * NUM_THREADS + worker->id);
+            CHECK(hashtable_concurrent_set(table, key, len, TEST_VALUE(i * NUM_THREADS + worker->id), 0, NULL) == 0);
+            CHECK(hashtable_concurrent_get(table, key, len) == TEST_VALUE(i * NUM_THREADS + worker->id));
+
+            len = test_key(peek, sizeof(peek), "t", j * NUM_THREADS + other);
+            CHECK(valid_value(hashtable_concurrent_get(table, peek, len), j, other));
+
+            /* every thread fights over the hot keys, whose values are all thread ids */
+            len = test_key(peek, sizeof(peek), "hot", j % HOT_KEYS);
+            old = NULL;     // only written if there was a value to replace
+            CHECK(hashtable_concurrent_set(table, peek, len, TEST_VALUE(worker->id), 1, &old) == 0);
+            CHECK(old == NULL || (uintptr_t)old - 1 < NUM_THREADS);
+        }
+
+        for(size_t i = 0; i < KEYS_PER_THREAD; i++)
+        {
+            size_t v = i * NUM_THREADS + worker->id;
+
+            len = test_key(key, sizeof(key), "t", v);
+            CHECK(hashtable_concurrent_set(table, key, len, TEST_VALUE(v + CONCURRENT_REPLACED), 1, &old) == 0);
+            CHECK(old == TEST_VALUE(v));
+        }
+
+        /* and remove them all, so the next round displaces keys through half empty buckets */
+        for(size_t i = 0; i < KEYS_PER_THREAD; i++)
+        {
+            size_t v = i * NUM_THREADS + worker->id;
+
+            len = test_key(key, sizeof(key), "t", v);
+            CHECK(hashtable_concurrent_get(table, key, len) == TEST_VALUE(v + CONCURRENT_REPLACED));
+            CHECK(hashtable_concurrent_remove(table, key, len, &old) == 0);
+            CHECK(old == TEST_VALUE(v + CONCURRENT_REPLACED));
+            CHECK(hashtable_concurrent_exists_pair(table, key, len) == 0);
+        }
+    }
+
+    return NULL;
+}
+
+
+static void test_stress(void)
+{
+    stress_worker_t workers[NUM_THREADS];
+    hashtable_concurrent_t *table = hashtable_concurrent_create(NUM_THREADS * KEYS_PER_THREAD + HOT_KEYS);
+
+    CHECK(table != NULL);
+
+    for(size_t i = 0; i < NUM_THREADS; i++)
+    {
+        workers[i].table = table;
+        workers[i].id = i;
+        CHECK(pthread_create(&workers[i].thread, NULL, stress, &workers[i]) == 0);
+    }
+
+    for(size_t i = 0; i < NUM_THREADS; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    CHECK(hashtable_concurrent_size(table) == HOT_KEYS);
+    CHECK(hashtable_concurrent_destroy(table, NULL) == 0);
+}
+
+
+int main(void)
+{
+    set_hashtable_seed(0);
+
+    test_round_trip();
+    test_stress();
+
+    return 0;
+}
@@ -0,0 +1,129 @@
+/* Tests for counter tables (hashtable_counter.c): many threads adding to shared keys directly and through their own
+ * local buffers, with every count exact once they are done. */
+
+#include <pthread.h>
+#include <string.h>
+#include "../hashtable_counter.h"
+#include "test.h"
+
+#define NUM_THREADS 8
+#define NUM_KEYS    5000
+#define ADDS        200000
+
+
+typedef struct counter_worker
+{
+    hashtable_counter_t *table;
+    size_t id;
+    pthread_t thread;
+}counter_worker_t;
+
+
+static int sum_count(const char *key, size_t keylen, int64_t count, void *ctx)
+{
+    (void)key;
+    (void)keylen;
+    *(int64_t *)ctx += count;
+
+    return 0;
+}
+
+
+/* half the threads add straight into the table, the other half through a buffer smaller than their working set */
+static void *add_counts(void *arg)
+{
+    counter_worker_t *worker = arg;
+    hashtable_counter_local_t *local = NULL;
+    char key[32];
+    size_t len;
+
+    if(worker->id % 2)
+        CHECK((local = hashtable_counter_local_create(worker->table, 64)) != NULL);
+
+    for(size_t i = 0; i < ADDS; i++)
+    {
+        len = test_key(key, sizeof(key), "k", i % NUM_KEYS);
+        if(local)
+            CHECK(hashtable_counter_local_add(local, key, len, 1) == 0);
+        else CHECK(hashtable_counter_add(worker->table, key, len, 1) == 0);
+    }
+
+    if(local)
+        CHECK(hashtable_counter_local_destroy(local) == 0);
+
+    return NULL;
+}
+
+
+static void test_threaded_counts(void)
+{
+    counter_worker_t workers[NUM_THREADS];
+    hashtable_counter_t *table = hashtable_counter_create(NUM_KEYS);
+    int64_t total = 0;
+    char key[32];
+
+    CHECK(table != NULL);
+
+    for(size_t i = 0; i < NUM_THREADS; i++)
+    {
+        workers[i].table = table;
+        workers[i].id = i;
+        CHECK(pthread_create(&workers[i].thread, NULL, add_counts, &workers[i]) == 0);
+    }
+
+    for(size_t i = 0; i < NUM_THREADS; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    CHECK(hashtable_counter_size(table) == NUM_KEYS);
+    for(size_t i = 0; i < NUM_KEYS; i++)
+        CHECK(hashtable_counter_get(table, key, test_key(key, sizeof(key), "k", i)) == NUM_THREADS * ADDS / NUM_KEYS);
+    CHECK(hashtable_counter_get(table, "missing", 7) == 0);
+
+    CHECK(hashtable_counter_foreach(table, sum_count, &total) == 0);
+    CHECK(total == (int64_t)NUM_THREADS * ADDS);
+
+    CHECK(hashtable_counter_destroy(table) == 0);
+}
+
+
+static void test_full(void)
+{
+    hashtable_counter_t *table = hashtable_counter_create(100);
+    char key[64];
+    size_t len, added = 0;
+
+    /* a full table still counts the keys it has, and refuses only new ones */
+    for(size_t i = 0; i < 100000; i++)
+    {
+        len = test_key(key, sizeof(key), "k", i);
+        if(hashtable_counter_add(table, key, len, 2) != 0)
+            break;
+        added++;
+    }
+    CHECK(added >= 100 && added < 100000);
+    CHECK(hashtable_counter_add(table, "k0", 2, -5) == 0);
+    CHECK(hashtable_counter_get(table, "k0", 2) == -3);
+
+    /* keys too long for a local buffer go straight through it, to be refused by the full table */
+    hashtable_counter_local_t *local = hashtable_counter_local_create(table, 4);
+    memset(key, 'x', sizeof(key));
+    CHECK(hashtable_counter_local_add(local, "k1", 2, 1) == 0);
+    CHECK(hashtable_counter_local_add(local, key, sizeof(key), 1) == -1);
+    CHECK(hashtable_counter_get(table, "k1", 2) == 2);
+    CHECK(hashtable_counter_local_flush(local) == 0);
+    CHECK(hashtable_counter_get(table, "k1", 2) == 3);
+    CHECK(hashtable_counter_local_destroy(local) == 0);
+
+    CHECK(hashtable_counter_destroy(table) == 0);
+}
+
+
+int main(void)
+{
+    set_hashtable_seed(0);
+
+    test_threaded_counts();
+    test_full();
+
+    return 0;
+}
@@ -0,0 +1,200 @@
+/* Tests for per-item expiry (hashtable_set_expiry, hashtable_expire): lazy expiry on lookup, and the timer wheel
+ * checked against a brute force scan as time jumps across every level of cascades. */
+
+#include <string.h>
+#include "../hashtable.h"
+#include "test.h"
+
+#define NUM_KEYS 20000
+
+static uint64_t now;
+
+static uint64_t test_clock(void)
+{
+    return now;
+}
+
+
+static void test_lazy_expiry(void)
+{
+    hashtable_t *table = hashtable_create(4, 1);
+    char key[32];
+
+    hashtable_set_clock(table, test_clock);
+    now = 100;
+
+    /* these items exist before the table has a wheel, so they are upgraded as they are given an expiry time */
+    for(size_t i = 0; i < 100; i++)
+        CHECK(hashtable_set_no_replace(&table, key, test_key(key, sizeof(key), "k", i), TEST_VALUE(i)) == 0);
+
+    CHECK(hashtable_set_expiry(table, "k1", 2, 150) == 0);
+    CHECK(hashtable_set_expiry(table, "k2", 2, 150) == 0);
+    CHECK(hashtable_set_expiry(table, "k3", 2, 150) == 0);
+    CHECK(hashtable_set_expiry(table, "k3", 2, 0) == 0);      // never mind
+    CHECK(hashtable_set_expiry(table, "missing", 7, 150) == -1);
+    CHECK(hashtable_set_replace(&table, "k2", 2, TEST_VALUE(200)) == 0);     // keeps its expiry time
+
+    for(size_t i = 100; i < 200; i++)
+        CHECK(hashtable_set_no_replace(&table, key, test_key(key, sizeof(key), "k", i), TEST_VALUE(i)) == 0);
+
+    CHECK(hashtable_get(table, "k1", 2) == TEST_VALUE(1));
+    now = 150;
+    CHECK(hashtable_get(table, "k1", 2) == NULL);
+    CHECK(hashtable_exists_pair(table, "k2", 2) == 0);
+    CHECK(hashtable_get(table, "k3", 2) == TEST_VALUE(3));
+    CHECK(table->num_items == 198);
+
+    /* an expired key may be set again, as if it were absent */
+    CHECK(hashtable_set_expiry(table, "k4", 2, 160) == 0);
+    now = 160;
+    CHECK(hashtable_set_no_replace(&table, "k4", 2, TEST_VALUE(400)) == 0);
+    CHECK(hashtable_get(table, "k4", 2) == TEST_VALUE(400));
+    CHECK(hashtable_expire(table, 1000, 0) == 0);
+
+    for(size_t i = 5; i < 200; i++)
+        CHECK(hashtable_get(table, key, test_key(key, sizeof(key), "k", i)) == TEST_VALUE(i));
+
+    hashtable_destroy(table, NULL);
+}
+
+
+static void test_wheel(void)
+{
+    static uint64_t expires_at[NUM_KEYS];
+    static int alive[NUM_KEYS];
+    hashtable_t *table = hashtable_create(16, 1);
+    uint64_t random = 2463534242ULL;
+    char key[32];
+    size_t len;
+
+    hashtable_set_clock(table, test_clock);
+    now = 1000;
+
+    /* expiry times spread from a few ticks to 2^40 ahead, far past the 2^24 ticks the wheel spans */
+    for(size_t i = 0; i < NUM_KEYS; i++)
+    {
+        len = test_key(key, sizeof(key), "k", i);
+        CHECK(hashtable_set_no_replace(&table, key, len, TEST_VALUE(i)) == 0);
+
+        expires_at[i] = now + 1 + test_random(&random) % ((uint64_t)1 << (test_random(&random) % 41));
+        alive[i] = 1;
+        CHECK(hashtable_set_expiry(table, key, len, expires_at[i]) == 0);
+    }
+
+    for(size_t step = 0; step < 300; step++)
+    {
+        size_t removed, expected = 0, left = 0;
+
+        now += ((uint64_t)1 << (test_random(&random) % 36)) + test_random(&random) % 100;
+
+        removed = hashtable_expire(table, now, 0);
+        for(size_t i = 0; i < NUM_KEYS; i++)
+        {
+            if(alive[i] && expires_at[i] <= now)
+            {
+                alive[i] = 0;
+                expected++;
+            }
+            left += alive[i];
+        }
+        CHECK(removed == expected);
+        CHECK(table->num_items == left);
+
+        for(size_t i = step % 61; i < NUM_KEYS; i += 61)
+            CHECK(hashtable_exists_pair(table, key, test_key(key, sizeof(key), "k", i)) == alive[i]);
+    }
+
+    /* the end of time, which must neither overflow nor take time in proportion to the ticks left */
+    now = UINT64_MAX;
+    hashtable_expire(table, UINT64_MAX, 0);
+    CHECK(table->num_items == 0);
+    CHECK(hashtable_expire(table, UINT64_MAX, 0) == 0);
+
+    hashtable_destroy(table, NULL);
+}
+
+
+static void test_budget(void)
+{
+    hashtable_t *table = hashtable_create(16, 1);
+    char key[32];
+    size_t len, total = 0, removed;
+
+    hashtable_set_clock(table, test_clock);
+    now = 0;
+
+    for(size_t i = 0; i < 1000; i++)
+    {
+        len = test_key(key, sizeof(key), "k", i);
+        CHECK(hashtable_set_no_replace(&table, key, len, TEST_VALUE(i)) == 0);
+        CHECK(hashtable_set_expiry(table, key, len, 1 + i % 300) == 0);
+    }
+
+    /* an idle stretch of a billion ticks costs nothing once the wheel is empty */
+    while((removed = hashtable_expire(table, 1000000000, 64)) != 0)
+    {
+        CHECK(removed <= 64);
+        total += removed;
+    }
+    CHECK(total == 1000 && table->num_items == 0);
+
+    hashtable_destroy(table, NULL);
+}
+
+
+static void test_due_after_expire(void)
+{
+    hashtable_t *table = hashtable_create(16, 1);
+
+    hashtable_set_clock(table, test_clock);
+    now = 0;
+
+    CHECK(hashtable_set_no_replace(&table, "a", 1, TEST_VALUE(0)) == 0);
+    CHECK(hashtable_set_no_replace(&table, "b", 1, TEST_VALUE(1)) == 0);
+    CHECK(hashtable_set_no_replace(&table, "c", 1, TEST_VALUE(2)) == 0);
+
+    CHECK(hashtable_set_expiry(table, "a", 1, 100) == 0);
+    CHECK(hashtable_expire(table, 100, 0) == 1);
+
+    /* items falling due at, or before, a tick the wheel has already processed are still found there */
+    CHECK(hashtable_set_expiry(table, "b", 1, 100) == 0);
+    CHECK(hashtable_expire(table, 100, 0) == 1);
+    CHECK(hashtable_set_expiry(table, "c", 1, 50) == 0);
+    CHECK(hashtable_expire(table, 100, 0) == 1);
+    CHECK(table->num_items == 0);
+
+    hashtable_destroy(table, NULL);
+}
+
+
+static void test_bounded_expiry(void)
+{
+    hashtable_t *table = hashtable_create_bounded(4, 1, 2, 0, HASHTABLE_EVICT_LRU, NULL, NULL);
+
+    hashtable_set_clock(table, test_clock);
+    now = 10;
+
+    CHECK(hashtable_set_no_replace(&table, "a", 1, TEST_VALUE(0)) == 0);
+    CHECK(hashtable_set_expiry(table, "a", 1, 20) == 0);
+    CHECK(hashtable_set_no_replace(&table, "b", 1, TEST_VALUE(1)) == 0);
+    CHECK(hashtable_set_no_replace(&table, "c", 1, TEST_VALUE(2)) == 0);     // evicts a, timer and all
+    CHECK(!hashtable_exists_pair(table, "a", 1));
+    CHECK(hashtable_expire(table, 30, 0) == 0);
+    CHECK(table->num_items == 2);
+
+    hashtable_destroy(table, NULL);
+}
+
+
+int main(void)
+{
+    set_hashtable_seed(0);
+
+    test_lazy_expiry();
+    test_wheel();
+    test_budget();
+    test_due_after_expire();
+    test_bounded_expiry();
+
+    return 0;
+}
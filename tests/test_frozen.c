@@ -0,0 +1,70 @@
+/* Tests for frozen tables (hashtable_frozen.c): an image written by hashtable_freeze and mapped back holds exactly
+ * the keys and value bytes of the table it was frozen from. */
+
+#include <stdio.h>
+#include <string.h>
+#include "../hashtable_frozen.h"
+#include "test.h"
+
+#define NUM_KEYS 50000
+#define IMAGE    "test_frozen.img"     // written to the directory the test runs in
+
+
+static char values[NUM_KEYS][32];
+
+static size_t value_size(const void *value)
+{
+    return strlen(value) + 1;
+}
+
+
+int main(void)
+{
+    hashtable_t *table;
+    hashtable_mapped_t *mapped;
+    char key[32];
+    size_t len, value_len;
+    const char *value;
+
+    set_hashtable_seed(0);
+
+    CHECK((table = hashtable_create(64, 1)) != NULL);
+    for(size_t i = 0; i < NUM_KEYS; i++)
+    {
+        len = test_key(key, sizeof(key), "key", i);
+        test_key(values[i], sizeof(values[i]), "value", i * 7);
+        CHECK(hashtable_set_no_replace(&table, key, len, values[i]) == 0);
+    }
+    CHECK(hashtable_set_no_replace(&table, "", 0, "empty") == 0);
+
+    CHECK(hashtable_freeze(table, IMAGE, value_size) == 0);
+    hashtable_destroy(table, NULL);
+
+    CHECK((mapped = hashtable_open_mapped(IMAGE)) != NULL);
+    CHECK(mapped->header->num_items == NUM_KEYS + 1);
+
+    for(size_t i = 0; i < NUM_KEYS; i++)
+    {
+        len = test_key(key, sizeof(key), "key", i);
+        CHECK((value = hashtable_mapped_get(mapped, key, len, &value_len)) != NULL);
+        CHECK(value_len == strlen(values[i]) + 1 && strcmp(value, values[i]) == 0);
+
+        /* and keys never stored are not found, whichever bucket they land in */
+        len = test_key(key, sizeof(key), "missing", i);
+        CHECK(hashtable_mapped_get(mapped, key, len, NULL) == NULL);
+        CHECK(hashtable_mapped_exists_pair(mapped, key, len) == 0);
+    }
+    CHECK(strcmp(hashtable_mapped_get(mapped, "", 0, NULL), "empty") == 0);
+
+    CHECK(hashtable_close_mapped(mapped) == 0);
+
+    /* anything but an image is refused */
+    FILE *f = fopen(IMAGE, "wb");
+    CHECK(f != NULL && fputs("not a frozen table", f) >= 0 && fclose(f) == 0);
+    CHECK(hashtable_open_mapped(IMAGE) == NULL);
+    CHECK(hashtable_open_mapped("no/such/image") == NULL);
+
+    remove(IMAGE);
+
+    return 0;
+}
@@ -0,0 +1,364 @@
+/* Tests for the chained hashtable_t (hashtable.c): round-trips, growth and the optional modes which need no clock
+ * or threads of their own. Bounded tables, expiry and background resize have tests of their own. */
+
+#include <string.h>
+#include "../hashtable.h"
+#include "../hashtable_keypool.h"
+#include "test.h"
+
+#define NUM_KEYS 100000
+
+
+static void test_round_trip(void)
+{
+    hashtable_t *table = hashtable_create(1, 1);
+    char key[32];
+    size_t len;
+
+    CHECK(table != NULL);
+
+    CHECK(hashtable_set_no_replace(&table, "key", 3, TEST_VALUE(1)) == 0);
+    CHECK(hashtable_get(table, "key", 3) == TEST_VALUE(1));
+    CHECK(hashtable_get(table, "key1", 4) == NULL);     // a longer key sharing the prefix is a different key
+    CHECK(hashtable_get(table, "ke", 2) == NULL);
+    CHECK(hashtable_set_no_replace(&table, "key", 3, TEST_VALUE(2)) == -1);
+    CHECK(hashtable_get(table, "key", 3) == TEST_VALUE(1));
+    CHECK(hashtable_set_replace(&table, "key", 3, TEST_VALUE(2)) == 0);
+    CHECK(hashtable_get(table, "key", 3) == TEST_VALUE(2));
+    CHECK(table->num_items == 1);
+
+    CHECK(hashtable_set_no_replace(&table, "", 0, TEST_VALUE(3)) == 0);     // the empty key is a key like any other
+    CHECK(hashtable_exists_pair(table, "", 0) == 1);
+
+    CHECK(hashtable_remove(table, "key", 3) == 0);
+    CHECK(hashtable_remove(table, "key", 3) == -1);
+    CHECK(hashtable_exists_pair(table, "key", 3) == 0);
+    CHECK(hashtable_remove(table, "", 0) == 0);
+    CHECK(table->num_items == 0);
+
+    /* growth under load, then removal from the middle of every chain */
+    for(size_t i = 0; i < NUM_KEYS; i++)
+    {
+        len = test_key(key, sizeof(key), "key", i);
+        CHECK(hashtable_set_no_replace(&table, key, len, TEST_VALUE(i)) == 0);
+    }
+    CHECK(table->num_items == NUM_KEYS);
+    CHECK(table->table_size > 1);
+    CHECK(table->num_items / table->table_size < table->max_load_factor);
+
+    for(size_t i = 0; i < NUM_KEYS; i++)
+    {
+        len = test_key(key, sizeof(key), "key", i);
+        CHECK(hashtable_get(table, key, len) == TEST_VALUE(i));
+    }
+
+    for(size_t i = 0; i < NUM_KEYS; i += 3)
+    {
+        len = test_key(key, sizeof(key), "key", i);
+        CHECK(hashtable_remove(table, key, len) == 0);
+    }
+
+    for(size_t i = 0; i < NUM_KEYS; i++)
+    {
+        len = test_key(key, sizeof(key), "key", i);
+        CHECK(hashtable_exists_pair(table, key, len) == (i % 3 != 0));
+    }
+
+    CHECK(hashtable_destroy(table, NULL) == 0);
+}
+
+
+static int count_item(const char *key, size_t keylen, void *value, void *ctx)
+{
+    (void)key;
+    (void)keylen;
+    (void)value;
+    (*(size_t *)ctx)++;
+
+    return 0;
+}
+
+
+static int stop_at_third(const char *key, size_t keylen, void *value, void *ctx)
+{
+    (void)key;
+    (void)keylen;
+    (void)value;
+
+    return ++(*(size_t *)ctx) == 3 ? 7 : 0;
+}
+
+
+static void test_foreach(void)
+{
+    hashtable_t *table = hashtable_create(8, 2);
+    char key[32];
+    size_t count = 0;
+
+    for(size_t i = 0; i < 1000; i++)
+        CHECK(hashtable_set_no_replace(&table, key, test_key(key, sizeof(key), "k", i), TEST_VALUE(i)) == 0);
+
+    CHECK(hashtable_foreach(table, count_item, &count) == 0);
+    CHECK(count == 1000);
+
+    count = 0;
+    CHECK(hashtable_foreach(table, stop_at_third, &count) == 7);
+    CHECK(count == 3);
+
+    hashtable_destroy(table, NULL);
+}
+
+
+static size_t freed;
+
+static void count_free(void *value)
+{
+    (void)value;
+    freed++;
+}
+
+
+static void test_deallocators(void)
+{
+    hashtable_t *table = hashtable_create(4, 1);
+
+    table->deallocator = count_free;
+    freed = 0;
+
+    CHECK(hashtable_set_no_replace(&table, "a", 1, TEST_VALUE(1)) == 0);
+    CHECK(hashtable_set_replace_and_destroy(&table, "a", 1, TEST_VALUE(2), count_free) == 0);
+    CHECK(freed == 1);
+    CHECK(hashtable_set_no_replace(&table, "b", 1, TEST_VALUE(3)) == 0);
+    CHECK(hashtbale_remove_and_destroy(table, "b", 1, count_free) == 0);
+    CHECK(freed == 2);
+
+    hashtable_destroy(table, NULL);     // falls back to the table's own deallocator
+    CHECK(freed == 3);
+}
+
+
+static void test_multimap(void)
+{
+    hashtable_t *table = hashtable_create_multimap(4, 1);
+    void *const *values;
+    size_t count;
+
+    CHECK(table != NULL);
+    for(size_t i = 0; i < 10; i++)
+        CHECK(hashtable_add(&table, "k", 1, TEST_VALUE(i)) == 0);
+    CHECK(hashtable_add(&table, "other", 5, TEST_VALUE(100)) == 0);
+
+    CHECK(hashtable_get_all(table, "k", 1, &values, &count) == 0);
+    CHECK(count == 10);
+    for(size_t i = 0; i < count; i++)
+        CHECK(values[i] == TEST_VALUE(i));
+    CHECK(hashtable_get(table, "k", 1) == TEST_VALUE(0));
+
+    CHECK(hashtable_set_replace(&table, "k", 1, TEST_VALUE(50)) == 0);    // replaces the whole run
+    CHECK(hashtable_get_all(table, "k", 1, &values, &count) == 0);
+    CHECK(count == 1 && values[0] == TEST_VALUE(50));
+    CHECK(hashtable_get_all(table, "missing", 7, &values, &count) == -1);
+
+    hashtable_destroy(table, NULL);
+}
+
+
+static void test_inline(void)
+{
+    hashtable_t *table = hashtable_create(4, 1);
+    char big[HASHTABLE_INLINE_MAX + 1] = {0};
+    const void *bytes;
+    size_t len;
+
+    CHECK(hashtable_set_inline(&table, "pi", 2, "3.14159", 8) == 0);
+    bytes = hashtable_get_inline(table, "pi", 2, &len);
+    CHECK(bytes != NULL && len == 8 && memcmp(bytes, "3.14159", 8) == 0);
+    CHECK(hashtable_get(table, "pi", 2) == bytes);
+
+    CHECK(hashtable_set_inline(&table, "pi", 2, "3", 2) == 0);
+    bytes = hashtable_get_inline(table, "pi", 2, &len);
+    CHECK(bytes != NULL && len == 2 && memcmp(bytes, "3", 2) == 0);
+
+    CHECK(hashtable_set_inline(&table, "big", 3, big, sizeof(big)) == -1);
+    CHECK(hashtable_set_replace(&table, "pi", 2, TEST_VALUE(1)) == 0);
+    CHECK(hashtable_get_inline(table, "pi", 2, NULL) == NULL);     // no longer inline
+    CHECK(hashtable_get(table, "pi", 2) == TEST_VALUE(1));
+
+    hashtable_destroy(table, NULL);
+}
+
+
+static void test_emplace(void)
+{
+    hashtable_t *table = hashtable_create(1, 1);
+    int inserted;
+    void **slot;
+
+    slot = hashtable_emplace(&table, "k", 1, &inserted);
+    CHECK(slot != NULL && inserted == 1 && *slot == NULL);
+    *slot = TEST_VALUE(1);
+
+    slot = hashtable_emplace(&table, "k", 1, &inserted);
+    CHECK(slot != NULL && inserted == 0 && *slot == TEST_VALUE(1));
+    CHECK(hashtable_get(table, "k", 1) == TEST_VALUE(1));
+
+    hashtable_destroy(table, NULL);
+}
+
+
+static void test_prefilter(void)
+{
+    hashtable_t *table = hashtable_create(16, 1);
+    char key[32];
+    size_t len;
+
+    for(size_t i = 0; i < 1000; i++)
+        CHECK(hashtable_set_no_replace(&table, key, test_key(key, sizeof(key), "in", i), TEST_VALUE(i)) == 0);
+    CHECK(hashtable_enable_prefilter(table, 10) == 0);
+
+    /* items added after the filter, and across growth, must never be filtered out */
+    for(size_t i = 1000; i < 20000; i++)
+        CHECK(hashtable_set_no_replace(&table, key, test_key(key, sizeof(key), "in", i), TEST_VALUE(i)) == 0);
+
+    for(size_t i = 0; i < 20000; i++)
+    {
+        len = test_key(key, sizeof(key), "in", i);
+        CHECK(hashtable_get(table, key, len) == TEST_VALUE(i));
+        len = test_key(key, sizeof(key), "out", i);
+        CHECK(hashtable_get(table, key, len) == NULL);
+    }
+
+    for(size_t i = 0; i < 20000; i += 2)
+        CHECK(hashtable_remove(table, key, test_key(key, sizeof(key), "in", i)) == 0);
+    for(size_t i = 1; i < 20000; i += 2)
+        CHECK(hashtable_exists_pair(table, key, test_key(key, sizeof(key), "in", i)) == 1);
+
+    CHECK(hashtable_enable_prefilter(table, 0) == 0);
+    hashtable_destroy(table, NULL);
+}
+
+
+static void test_build_parallel(void)
+{
+    static char storage[NUM_KEYS][16];
+    static const char *keys[NUM_KEYS + 1];
+    static size_t lens[NUM_KEYS + 1];
+    static void *values[NUM_KEYS + 1];
+    hashtable_t *table;
+
+    for(size_t i = 0; i < NUM_KEYS; i++)
+    {
+        lens[i] = test_key(storage[i], sizeof(storage[i]), "b", i);
+        keys[i] = storage[i];
+        values[i] = TEST_VALUE(i);
+    }
+
+    keys[NUM_KEYS] = storage[0];     // a duplicate, the first occurrence wins
+    lens[NUM_KEYS] = lens[0];
+    values[NUM_KEYS] = TEST_VALUE(NUM_KEYS);
+
+    table = hashtable_build_parallel(keys, lens, values, NUM_KEYS + 1, 0);
+    CHECK(table != NULL);
+    CHECK(table->num_items == NUM_KEYS);
+    for(size_t i = 0; i < NUM_KEYS; i++)
+        CHECK(hashtable_get(table, keys[i], lens[i]) == TEST_VALUE(i));
+
+    hashtable_destroy(table, NULL);
+}
+
+
+static void test_threaded_growth(void)
+{
+    hashtable_t *table = hashtable_create(HASHTABLE_PARALLEL_GROW_MIN, 1);
+    char key[32];
+    size_t len;
+
+    CHECK(hashtable_set_threads(table, 4) == 0);
+    for(size_t i = 0; i < 4 * HASHTABLE_PARALLEL_GROW_MIN; i++)
+    {
+        len = test_key(key, sizeof(key), "g", i);
+        CHECK(hashtable_set_no_replace(&table, key, len, TEST_VALUE(i)) == 0);
+    }
+    CHECK(table->table_size >= 4 * HASHTABLE_PARALLEL_GROW_MIN);
+
+    for(size_t i = 0; i < 4 * HASHTABLE_PARALLEL_GROW_MIN; i++)
+    {
+        len = test_key(key, sizeof(key), "g", i);
+        CHECK(hashtable_get(table, key, len) == TEST_VALUE(i));
+    }
+
+    hashtable_destroy(table, NULL);
+}
+
+
+static int check_key_matches(const char *key, size_t keylen, void *value, void *ctx)
+{
+    char expected[64];
+
+    (void)ctx;
+    CHECK(test_key(expected, sizeof(expected), "/usr/share/doc/pkg/file", (uintptr_t)value - 1) == keylen);
+    CHECK(memcmp(expected, key, keylen) == 0 && key[keylen] == '\0');
+
+    return 0;
+}
+
+
+static void test_shared_keys(void)
+{
+    hashtable_keypool_t *pool = hashtable_keypool_create(0);
+    hashtable_t *first = hashtable_create(4, 1), *second = hashtable_create(4, 1), *prefixed = hashtable_create(4, 1);
+    char key[64];
+    size_t len;
+
+    CHECK(pool != NULL);
+    CHECK(hashtable_set_keypool(first, pool) == 0);
+    CHECK(hashtable_set_keypool(second, pool) == 0);
+    CHECK(hashtable_set_key_prefixes(prefixed, '/') == 0);
+
+    for(size_t i = 0; i < 1000; i++)
+    {
+        len = test_key(key, sizeof(key), "/usr/share/doc/pkg/file", i);
+        CHECK(hashtable_set_no_replace(&first, key, len, TEST_VALUE(i)) == 0);
+        CHECK(hashtable_set_no_replace(&second, key, len, TEST_VALUE(i)) == 0);
+        CHECK(hashtable_set_no_replace(&prefixed, key, len, TEST_VALUE(i)) == 0);
+    }
+    CHECK(hashtable_keypool_size(pool) == 1000);
+
+    len = test_key(key, sizeof(key), "/usr/share/doc/pkg/file", 7);
+    CHECK(hashtable_keypool_lookup(pool, key, len) != NULL);
+    CHECK(hashtable_get(second, hashtable_keypool_lookup(pool, key, len), len) == TEST_VALUE(7));
+
+    for(size_t i = 0; i < 1000; i++)
+    {
+        len = test_key(key, sizeof(key), "/usr/share/doc/pkg/file", i);
+        CHECK(hashtable_get(prefixed, key, len) == TEST_VALUE(i));
+    }
+    CHECK(hashtable_get(prefixed, "/usr/share/doc/pkg/", 19) == NULL);
+    CHECK(hashtable_foreach(prefixed, check_key_matches, NULL) == 0);
+
+    hashtable_destroy(first, NULL);
+    CHECK(hashtable_keypool_size(pool) == 1000);     // still held by the second table
+    hashtable_destroy(second, NULL);
+    CHECK(hashtable_keypool_size(pool) == 0);
+    CHECK(hashtable_keypool_destroy(pool) == 0);
+    hashtable_destroy(prefixed, NULL);
+}
+
+
+int main(void)
+{
+    set_hashtable_seed(0);
+
+    test_round_trip();
+    test_foreach();
+    test_deallocators();
+    test_multimap();
+    test_inline();
+    test_emplace();
+    test_prefilter();
+    test_build_parallel();
+    test_threaded_growth();
+    test_shared_keys();
+
+    return 0;
+}
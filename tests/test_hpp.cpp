@@ -0,0 +1,87 @@
+/* Tests for jsc::hash_map (hashtable.hpp): values are constructed once, destroyed once whichever way they leave the
+ * table, and an exception thrown from for_each reaches the caller with the table intact. */
+
+#include <stdexcept>
+#include <string>
+
+#include "../hashtable.hpp"
+#include "test.h"
+
+
+static int live;
+
+struct tracked
+{
+    int value;
+
+    explicit tracked(int v) : value(v) { live++; }
+    tracked(const tracked &other) : value(other.value) { live++; }
+    ~tracked() { live--; }
+};
+
+
+static void test_lifetimes()
+{
+    {
+        jsc::hash_map<tracked> map(1);
+
+        for(int i = 0; i < 10000; i++)
+            CHECK(map.try_emplace(std::to_string(i), i).second);
+        CHECK(map.size() == 10000 && live == 10000);
+
+        auto [value, inserted] = map.try_emplace("5", 500);
+        CHECK(!inserted && value->value == 5 && live == 10000);     // nothing was constructed
+
+        auto assigned = map.insert_or_assign("5", tracked(50));
+        CHECK(!assigned.second && assigned.first->value == 50);
+        CHECK(map.insert_or_assign("new", tracked(1)).second);
+        CHECK(live == 10001);
+
+        CHECK(map.erase("7") && !map.erase("7"));
+        CHECK(!map.contains("7") && map.find("7") == nullptr);
+        CHECK(map.find("8")->value == 8);
+        CHECK(live == 10000);
+
+        jsc::hash_map<tracked> moved(std::move(map));
+        CHECK(moved.size() == 10000 && map.size() == 0);
+    }
+    CHECK(live == 0);
+}
+
+
+static void test_for_each_throws()
+{
+    jsc::hash_map<std::pmr::string> map;
+    size_t visited = 0;
+
+    for(int i = 0; i < 100; i++)
+        map.try_emplace(std::to_string(i), "a value long enough to need an allocation of its own");
+
+    try
+    {
+        map.for_each([&](std::string_view, std::pmr::string &) {
+            if(++visited == 10)
+                throw std::runtime_error("stop");
+        });
+        CHECK(!"for_each swallowed the exception");
+    }
+    catch(const std::runtime_error &)
+    {
+    }
+    CHECK(visited == 10);
+
+    visited = 0;
+    map.for_each([&](std::string_view, std::pmr::string &value) { visited += !value.empty(); });
+    CHECK(visited == 100);
+}
+
+
+int main()
+{
+    set_hashtable_seed(0);
+
+    test_lifetimes();
+    test_for_each_throws();
+
+    return 0;
+}
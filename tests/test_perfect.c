@@ -0,0 +1,52 @@
+/* Tests for minimal perfect tables (hashtable_perfect.c): every key of the source table is found with its value,
+ * and no other key is, across table sizes around the edges of the dense and sparse pilot buckets. */
+
+#include <string.h>
+#include "../hashtable_perfect.h"
+#include "test.h"
+
+
+static void test_perfect(size_t num_keys)
+{
+    hashtable_t *table = hashtable_create(64, 1);
+    hashtable_perfect_t *perfect;
+    char key[32];
+    size_t len;
+
+    for(size_t i = 0; i < num_keys; i++)
+    {
+        len = test_key(key, sizeof(key), "key", i);
+        CHECK(hashtable_set_no_replace(&table, key, len, TEST_VALUE(i)) == 0);
+    }
+
+    CHECK((perfect = hashtable_build_perfect(table)) != NULL);
+    CHECK(perfect->num_items == num_keys);
+    hashtable_destroy(table, NULL);     // the keys were copied
+
+    for(size_t i = 0; i < num_keys; i++)
+    {
+        len = test_key(key, sizeof(key), "key", i);
+        CHECK(hashtable_perfect_get(perfect, key, len) == TEST_VALUE(i));
+        CHECK(hashtable_perfect_exists_pair(perfect, key, len) == 1);
+        len = test_key(key, sizeof(key), "missing", i);
+        CHECK(hashtable_perfect_get(perfect, key, len) == NULL);
+    }
+    CHECK(hashtable_perfect_exists_pair(perfect, "key", 3) == 0);
+
+    CHECK(hashtable_perfect_destroy(perfect) == 0);
+}
+
+
+int main(void)
+{
+    set_hashtable_seed(0);
+
+    test_perfect(0);
+    test_perfect(1);
+    for(size_t n = 2; n < 64; n++)     // small tables, whose slot counts are often powers of two
+        test_perfect(n);
+    test_perfect(1000);
+    test_perfect(200000);
+
+    return 0;
+}
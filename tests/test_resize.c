@@ -0,0 +1,109 @@
+/* Tests for background resize (hashtable_set_background_resize): every operation keeps working, and sees every
+ * item exactly once, while a migrator thread moves the buckets underneath it. */
+
+#include <string.h>
+#include "../hashtable.h"
+#include "test.h"
+
+#define NUM_KEYS 400000
+
+
+static int count_item(const char *key, size_t keylen, void *value, void *ctx)
+{
+    (void)key;
+    (void)keylen;
+    (void)value;
+    (*(size_t *)ctx)++;
+
+    return 0;
+}
+
+
+static void test_background_resize(void)
+{
+    hashtable_t *table = hashtable_create(64, 1);
+    uint64_t random = 0x9e3779b97f4a7c15ULL;
+    size_t len, count, resizes = 0;
+    char key[32];
+
+    CHECK(hashtable_set_background_resize(table, 1) == 0);
+
+    for(size_t i = 0; i < NUM_KEYS; i++)
+    {
+        len = test_key(key, sizeof(key), "key", i);
+        CHECK(hashtable_set_no_replace(&table, key, len, TEST_VALUE(i)) == 0);
+        resizes += table->resize != NULL;
+
+        /* look back at a random earlier key, replace another and remove and restore a third, all of which may
+         * sit in either array while the migrator runs */
+        size_t j = test_random(&random) % (i + 1);
+        len = test_key(key, sizeof(key), "key", j);
+        CHECK(hashtable_get(table, key, len) == TEST_VALUE(j));
+        CHECK(hashtable_set_replace(&table, key, len, TEST_VALUE(j)) == 0);
+
+        j = test_random(&random) % (i + 1);
+        len = test_key(key, sizeof(key), "key", j);
+        CHECK(hashtable_remove(table, key, len) == 0);
+        CHECK(hashtable_exists_pair(table, key, len) == 0);
+        CHECK(hashtable_set_no_replace(&table, key, len, TEST_VALUE(j)) == 0);
+
+        if(i % 50000 == 0)
+        {
+            count = 0;
+            CHECK(hashtable_foreach(table, count_item, &count) == 0);
+            CHECK(count == i + 1);
+        }
+    }
+    CHECK(resizes > 0);     // some operations really did overlap a migration
+
+    count = 0;
+    CHECK(hashtable_foreach(table, count_item, &count) == 0);
+    CHECK(count == NUM_KEYS);
+
+    CHECK(hashtable_resize_finish(table) == 0);
+    CHECK(table->resize == NULL);
+    for(size_t i = 0; i < NUM_KEYS; i++)
+    {
+        len = test_key(key, sizeof(key), "key", i);
+        CHECK(hashtable_get(table, key, len) == TEST_VALUE(i));
+    }
+
+    CHECK(hashtable_set_background_resize(table, 0) == 0);
+    hashtable_destroy(table, NULL);
+}
+
+
+static size_t freed;
+
+static void count_free(void *value)
+{
+    (void)value;
+    freed++;
+}
+
+
+static void test_destroy_during_resize(void)
+{
+    hashtable_t *table = hashtable_create(1024, 1);
+    char key[32];
+
+    CHECK(hashtable_set_background_resize(table, 1) == 0);
+    for(size_t i = 0; i < 1025; i++)
+        CHECK(hashtable_set_no_replace(&table, key, test_key(key, sizeof(key), "key", i), TEST_VALUE(i)) == 0);
+
+    /* the migrator may or may not have finished, either way every value is destroyed once */
+    freed = 0;
+    hashtable_destroy(table, count_free);
+    CHECK(freed == 1025);
+}
+
+
+int main(void)
+{
+    set_hashtable_seed(0);
+
+    test_background_resize();
+    test_destroy_during_resize();
+
+    return 0;
+}
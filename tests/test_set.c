@@ -0,0 +1,53 @@
+/* Tests for hash sets (hashtable_set.c): membership round-trips and growth from a single slot. */
+
+#include <string.h>
+#include "../hashtable.h"
+#include "../hashtable_set.h"
+#include "test.h"
+
+#define NUM_KEYS 100000
+
+
+int main(void)
+{
+    hashtable_set_t *set;
+    char key[32];
+    size_t len;
+
+    set_hashtable_seed(0);
+
+    CHECK((set = hashtable_set_create(1, 1)) != NULL);
+
+    CHECK(hashtable_set_add(set, "", 0) == 0);
+    CHECK(hashtable_set_add(set, "", 0) == 1);
+    CHECK(hashtable_set_contains(set, "", 0) == 1);
+    CHECK(hashtable_set_discard(set, "", 0) == 0);
+    CHECK(hashtable_set_discard(set, "", 0) == -1);
+
+    for(size_t i = 0; i < NUM_KEYS; i++)
+    {
+        len = test_key(key, sizeof(key), "key", i);
+        CHECK(hashtable_set_add(set, key, len) == 0);
+    }
+    CHECK(set->num_items == NUM_KEYS);
+    CHECK(set->table_size > 1);
+
+    /* the shorter key of a pair with the same prefix is a different member */
+    CHECK(hashtable_set_contains(set, "key1", 3) == 0);
+
+    for(size_t i = 0; i < NUM_KEYS; i++)
+    {
+        len = test_key(key, sizeof(key), "key", i);
+        CHECK(hashtable_set_add(set, key, len) == 1);
+        if(i % 2)
+            CHECK(hashtable_set_discard(set, key, len) == 0);
+    }
+
+    for(size_t i = 0; i < NUM_KEYS; i++)
+        CHECK(hashtable_set_contains(set, key, test_key(key, sizeof(key), "key", i)) == (i % 2 == 0));
+    CHECK(set->num_items == NUM_KEYS / 2);
+
+    CHECK(hashtable_set_destroy(set) == 0);
+
+    return 0;
+}
@@ -0,0 +1,171 @@
+/* Tests for the split-ordered table (hashtable_splitorder.c): single-threaded round-trips, then many threads
+ * inserting, reading and removing while the table grows from a single bucket, and a compaction afterwards. */
+
+#include <pthread.h>
+#include <string.h>
+#include "../hashtable_splitorder.h"
+#include "test.h"
+
+#define NUM_THREADS     8
+#define KEYS_PER_THREAD 30000
+#define HOT_KEYS        16
+
+
+typedef struct stress_worker
+{
+    hashtable_splitorder_t *table;
+    size_t id;
+    pthread_t thread;
+}stress_worker_t;
+
+
+static void test_round_trip(void)
+{
+    hashtable_splitorder_t *table = hashtable_splitorder_create(1);
+    char key[64];
+    void *old;
+    size_t len;
+
+    CHECK(table != NULL);
+    CHECK(hashtable_splitorder_set(table, "", 0, TEST_VALUE(0), 0, NULL) == 0);
+    CHECK(hashtable_splitorder_get(table, "", 0) == TEST_VALUE(0));
+    CHECK(hashtable_splitorder_set(table, "", 0, TEST_VALUE(1), 0, NULL) == -1);
+    CHECK(hashtable_splitorder_set(table, "", 0, TEST_VALUE(1), 1, &old) == 0 && old == TEST_VALUE(0));
+    CHECK(hashtable_splitorder_remove(table, "", 0, &old) == 0 && old == TEST_VALUE(1));
+    CHECK(hashtable_splitorder_remove(table, "", 0, &old) == -1);
+    CHECK(hashtable_splitorder_size(table) == 0);
+
+    /* keys of any length, unlike the concurrent cuckoo table */
+    memset(key, 'x', sizeof(key));
+    CHECK(hashtable_splitorder_set(table, key, sizeof(key), TEST_VALUE(2), 0, NULL) == 0);
+    CHECK(hashtable_splitorder_get(table, key, sizeof(key)) == TEST_VALUE(2));
+    CHECK(hashtable_splitorder_get(table, key, sizeof(key) - 1) == NULL);
+    CHECK(hashtable_splitorder_remove(table, key, sizeof(key), NULL) == 0);
+
+    for(size_t i = 0; i < 100000; i++)
+    {
+        len = test_key(key, sizeof(key), "k", i);
+        CHECK(hashtable_splitorder_set(table, key, len, TEST_VALUE(i), 0, NULL) == 0);
+    }
+    CHECK(hashtable_splitorder_size(table) == 100000);
+
+    /* remove all but every hundredth key, after which compaction hands back most of the buckets */
+    for(size_t i = 0; i < 100000; i++)
+    {
+        len = test_key(key, sizeof(key), "k", i);
+        if(i % 100 != 0)
+            CHECK(hashtable_splitorder_remove(table, key, len, NULL) == 0);
+    }
+    CHECK(hashtable_splitorder_compact(table) == 0);
+    CHECK(hashtable_splitorder_size(table) == 1000);
+
+    for(size_t i = 0; i < 100000; i++)
+    {
+        len = test_key(key, sizeof(key), "k", i);
+        CHECK(hashtable_splitorder_get(table, key, len) == (i % 100 == 0 ? TEST_VALUE(i) : NULL));
+    }
+
+    /* and the buckets given back are made again as it grows once more */
+    for(size_t i = 0; i < 100000; i++)
+    {
+        len = test_key(key, sizeof(key), "k", i);
+        CHECK(hashtable_splitorder_set(table, key, len, TEST_VALUE(i), 1, NULL) == 0);
+    }
+    CHECK(hashtable_splitorder_size(table) == 100000);
+    for(size_t i = 0; i < 100000; i++)
+        CHECK(hashtable_splitorder_get(table, key, test_key(key, sizeof(key), "k", i)) == TEST_VALUE(i));
+
+    CHECK(hashtable_splitorder_destroy(table, NULL) == 0);
+}
+
+
+static void *stress(void *arg)
+{
+    stress_worker_t *worker = arg;
+    hashtable_splitorder_t *table = worker->table;
+    uint64_t random = 0x2545f4914f6cdd1dULL * (worker->id + 1);
+    char key[32], peek[32];
+    size_t len;
+    void *old, *value;
+
+    for(size_t i = 0; i < KEYS_PER_THREAD; i++)
+    {
+        size_t v = i * NUM_THREADS + worker->id, j = test_random(&random) % (v + 1);
+
+        len = test_key(key, sizeof(key), "t", v);
+        CHECK(hashtable_splitorder_set(table, key, len, TEST_VALUE(v), 0, NULL) == 0);
+        CHECK(hashtable_splitorder_get(table, key, len) == TEST_VALUE(v));
+
+        /* another thread's key is either not there yet or has its own value, never another's */
+        len = test_key(peek, sizeof(peek), "t", j);
+        value = hashtable_splitorder_get(table, peek, len);
+        CHECK(value == NULL || value == TEST_VALUE(j));
+
+        /* every thread replaces, removes and restores the hot keys, whose values are all thread ids, so that
+         * nodes are unlinked and reclaimed while other threads walk through them */
+        len = test_key(peek, sizeof(peek), "hot", j % HOT_KEYS);
+        old = NULL;     // only written if there was a value to replace
+        CHECK(hashtable_splitorder_set(table, peek, len, TEST_VALUE(worker->id), 1, &old) == 0);
+        CHECK(old == NULL || (uintptr_t)old - 1 < NUM_THREADS);
+        if(hashtable_splitorder_remove(table, peek, len, &old) == 0)
+            CHECK((uintptr_t)old - 1 < NUM_THREADS);
+        hashtable_splitorder_set(table, peek, len, TEST_VALUE(worker->id), 0, NULL);
+    }
+
+    /* then remove our odd keys again */
+    for(size_t i = 1; i < KEYS_PER_THREAD; i += 2)
+    {
+        size_t v = i * NUM_THREADS + worker->id;
+
+        len = test_key(key, sizeof(key), "t", v);
+        CHECK(hashtable_splitorder_remove(table, key, len, &old) == 0 && old == TEST_VALUE(v));
+        CHECK(hashtable_splitorder_exists_pair(table, key, len) == 0);
+    }
+
+    return NULL;
+}
+
+
+static void test_stress(void)
+{
+    stress_worker_t workers[NUM_THREADS];
+    hashtable_splitorder_t *table = hashtable_splitorder_create(1);
+    size_t len;
+    char key[32];
+
+    CHECK(table != NULL);
+
+    for(size_t i = 0; i < NUM_THREADS; i++)
+    {
+        workers[i].table = table;
+        workers[i].id = i;
+        CHECK(pthread_create(&workers[i].thread, NULL, stress, &workers[i]) == 0);
+    }
+
+    for(size_t i = 0; i < NUM_THREADS; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    CHECK(hashtable_splitorder_size(table) == NUM_THREADS * KEYS_PER_THREAD / 2 + HOT_KEYS);
+
+    CHECK(hashtable_splitorder_compact(table) == 0);
+    for(size_t v = 0; v < NUM_THREADS * KEYS_PER_THREAD; v++)
+    {
+        len = test_key(key, sizeof(key), "t", v);
+        CHECK(hashtable_splitorder_get(table, key, len) == (v / NUM_THREADS % 2 == 0 ? TEST_VALUE(v) : NULL));
+    }
+    for(size_t i = 0; i < HOT_KEYS; i++)
+        CHECK(hashtable_splitorder_exists_pair(table, key, test_key(key, sizeof(key), "hot", i)));
+
+    CHECK(hashtable_splitorder_destroy(table, NULL) == 0);
+}
+
+
+int main(void)
+{
+    set_hashtable_seed(0);
+
+    test_round_trip();
+    test_stress();
+
+    return 0;
+}
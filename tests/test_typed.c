@@ -0,0 +1,78 @@
+/* Tests for HASHTABLE_DEFINE (hashtable_typed.h): round-trips and growth, and removals checked against a plain
+ * array, since backward shift deletion moves the keys left behind. */
+
+#include "../hashtable_typed.h"
+#include "test.h"
+
+#define NUM_KEYS 100000
+
+/* a deliberately poor hash, so that runs are long and removals shift a lot */
+static inline uint64_t clustered_hash(uint64_t key)
+{
+    return key / 16;
+}
+
+HASHTABLE_DEFINE(counts, uint64_t, uint32_t, hashtable_typed_hash_u64, HASHTABLE_TYPED_EQ)
+HASHTABLE_DEFINE(clustered, uint64_t, uint64_t, clustered_hash, HASHTABLE_TYPED_EQ)
+
+
+static void test_counts(void)
+{
+    counts_t *table = counts_create(1);
+    uint32_t *count;
+
+    CHECK(table != NULL);
+
+    for(uint64_t i = 0; i < 3 * NUM_KEYS; i++)
+    {
+        if((count = counts_get(table, i % NUM_KEYS)) != NULL)
+            (*count)++;
+        else CHECK(counts_set(table, i % NUM_KEYS, 1, 0) == 0);
+    }
+    CHECK(table->num_items == NUM_KEYS);
+
+    for(uint64_t i = 0; i < NUM_KEYS; i++)
+        CHECK(*counts_get(table, i) == 3);
+    CHECK(counts_set(table, 0, 9, 0) == -1 && *counts_get(table, 0) == 3);
+    CHECK(counts_set(table, 0, 9, 1) == 0 && *counts_get(table, 0) == 9);
+    CHECK(counts_get(table, NUM_KEYS) == NULL);
+
+    CHECK(counts_destroy(table) == 0);
+}
+
+
+static void test_removal(void)
+{
+    static int present[NUM_KEYS];
+    clustered_t *table = clustered_create(16);
+    uint64_t random = 0x9e3779b97f4a7c15ULL;
+
+    for(size_t round = 0; round < 4 * NUM_KEYS; round++)
+    {
+        uint64_t key = test_random(&random) % NUM_KEYS;
+
+        if(present[key])
+            CHECK(clustered_remove(table, key) == 0);
+        else CHECK(clustered_set(table, key, key * 3, 0) == 0);
+        present[key] = !present[key];
+    }
+
+    for(uint64_t key = 0; key < NUM_KEYS; key++)
+    {
+        uint64_t *value = clustered_get(table, key);
+
+        CHECK(clustered_exists_pair(table, key) == present[key]);
+        CHECK(!present[key] || *value == key * 3);
+    }
+
+    CHECK(clustered_destroy(table) == 0);
+}
+
+
+int main(void)
+{
+    test_counts();
+    test_removal();
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+/* Tests for integer keyed tables (hashtable_u64.c): round-trips, replacement and growth from a single slot. */
+
+#include "../hashtable.h"
+#include "../hashtable_u64.h"
+#include "test.h"
+
+#define NUM_KEYS 100000
+
+
+static size_t freed;
+
+static void count_free(void *value)
+{
+    (void)value;
+    freed++;
+}
+
+
+int main(void)
+{
+    hashtable_u64_t *table;
+
+    set_hashtable_seed(0);
+
+    CHECK((table = hashtable_u64_create(1, 1)) != NULL);
+
+    /* keys that differ only in their high bits, which is all the Fibonacci hash keeps */
+    for(uint64_t i = 0; i < NUM_KEYS; i++)
+        CHECK(hashtable_u64_set_no_replace(table, i << 40, TEST_VALUE(i)) == 0);
+    CHECK(table->num_items == NUM_KEYS);
+    CHECK(table->table_size >= NUM_KEYS);
+
+    CHECK(hashtable_u64_set_no_replace(table, 0, TEST_VALUE(1)) == -1);
+    CHECK(hashtable_u64_set(table, 0, TEST_VALUE(7), 1, count_free) == 0 && freed == 1);
+    CHECK(hashtable_u64_get(table, 0) == TEST_VALUE(7));
+    CHECK(hashtable_u64_get(table, 1) == NULL);
+    CHECK(hashtable_u64_exists_pair(table, UINT64_MAX) == 0);
+
+    for(uint64_t i = 1; i < NUM_KEYS; i++)
+    {
+        CHECK(hashtable_u64_get(table, i << 40) == TEST_VALUE(i));
+        if(i % 2)
+            CHECK(hashtable_u64_remove_and_destroy(table, i << 40, count_free) == 0);
+    }
+    CHECK(hashtable_u64_remove(table, (uint64_t)1 << 40) == -1);
+    CHECK(table->num_items == NUM_KEYS / 2);
+
+    for(uint64_t i = 1; i < NUM_KEYS; i++)
+        CHECK(hashtable_u64_exists_pair(table, i << 40) == (i % 2 == 0));
+
+    freed = 0;
+    CHECK(hashtable_u64_destroy(table, count_free) == 0);
+    CHECK(freed == NUM_KEYS / 2);
+
+    return 0;
+}